@@ -0,0 +1,54 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_BENCH_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_BENCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Snapshot of the process resource usage so that benchmarks can report deltas
+struct bench_usage {
+    uint64_t wallNs;
+    uint64_t cpuNs;
+    long voluntarySwitches;
+    long involuntarySwitches;
+    long readSyscalls;
+    long writeSyscalls;
+
+    static bench_usage now();
+    bench_usage operator-(const bench_usage& other) const;
+};
+
+// Number of operator new calls made by the benchmark process so far
+unsigned long allocationCount();
+
+void printResult(const std::string& benchName, const std::string& metric, double value, const std::string& unit);
+
+// Individual benchmarks. They all take the remaining command line arguments and return a process exit code
+int runIdleWakeupsBench(const std::vector<std::string>& args);
+int runReportBatchingBench(const std::vector<std::string>& args);
+int runMappingAllocationsBench(const std::vector<std::string>& args);
+int runDecodersBench(const std::vector<std::string>& args);
+int runSimulatedTabletsBench(const std::vector<std::string>& args);
+int runControlStallsBench(const std::vector<std::string>& args);
+int runMessageQueueBench(const std::vector<std::string>& args);
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_BENCH_H
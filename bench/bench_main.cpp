@@ -0,0 +1,111 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sys/resource.h>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <functional>
+#include "bench.h"
+
+bench_usage bench_usage::now() {
+    struct timespec wall;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    bench_usage snapshot;
+    snapshot.wallNs = (uint64_t)wall.tv_sec * 1000000000 + wall.tv_nsec;
+    snapshot.cpuNs = ((uint64_t)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000 +
+            ((uint64_t)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000;
+    snapshot.voluntarySwitches = usage.ru_nvcsw;
+    snapshot.involuntarySwitches = usage.ru_nivcsw;
+
+    // The kernel keeps a count of read and write syscalls for every process
+    snapshot.readSyscalls = 0;
+    snapshot.writeSyscalls = 0;
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    long value;
+    while (io >> key >> value) {
+        if (key == "syscr:") {
+            snapshot.readSyscalls = value;
+        } else if (key == "syscw:") {
+            snapshot.writeSyscalls = value;
+        }
+    }
+
+    return snapshot;
+}
+
+bench_usage bench_usage::operator-(const bench_usage& other) const {
+    return bench_usage {
+        wallNs - other.wallNs,
+        cpuNs - other.cpuNs,
+        voluntarySwitches - other.voluntarySwitches,
+        involuntarySwitches - other.involuntarySwitches,
+        readSyscalls - other.readSyscalls,
+        writeSyscalls - other.writeSyscalls
+    };
+}
+
+void printResult(const std::string& benchName, const std::string& metric, double value, const std::string& unit) {
+    std::cout << std::left << std::setw(32) << benchName
+              << std::setw(28) << metric
+              << std::right << std::setw(16) << std::fixed << std::setprecision(2) << value
+              << " " << unit << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::map<std::string, std::function<int(const std::vector<std::string>&)> > benches = {
+            {"idle_wakeups", runIdleWakeupsBench},
+            {"report_batching", runReportBatchingBench},
+            {"mapping_allocations", runMappingAllocationsBench},
+            {"decoders", runDecodersBench},
+            {"simulated_tablets", runSimulatedTabletsBench},
+            {"control_stalls", runControlStallsBench},
+            {"message_queue", runMessageQueueBench},
+    };
+
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (args.empty()) {
+        // Run everything with default arguments
+        int result = 0;
+        for (auto bench : benches) {
+            result |= bench.second(args);
+        }
+
+        return result;
+    }
+
+    auto bench = benches.find(args[0]);
+    if (bench == benches.end()) {
+        std::cout << "Unknown benchmark " << args[0] << ". Available benchmarks:" << std::endl;
+        for (auto available : benches) {
+            std::cout << "  " << available.first << std::endl;
+        }
+
+        return 1;
+    }
+
+    return bench->second(std::vector<std::string>(args.begin() + 1, args.end()));
+}
@@ -0,0 +1,127 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include "bench.h"
+#include "event_loop.h"
+#include "data_plane.h"
+#include "null_output_sink.h"
+#include "simulated_usb_transport.h"
+#include "usb_devices.h"
+#include "xp_pen_handler.h"
+#include "huion_handler.h"
+
+namespace {
+    // Stands in for the control plane blocking on something slow, like an attach retry or a GUI client
+    void stall(long stallMs) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(stallMs));
+    }
+
+    void printStallResults(const std::string& name, simulated_usb_transport& transport) {
+        std::string benchName = "control_stalls/" + name;
+        const latency_histogram& lag = transport.getDeliveryLag();
+        printResult(benchName, "reports", transport.getReportsDelivered(), "");
+        printResult(benchName, "dropped reports", transport.getReportsDropped(), "");
+        printResult(benchName, "lag p99", lag.getPercentile(99.0) / 1000.0, "us");
+        printResult(benchName, "lag max", lag.getMax() / 1000.0, "us");
+    }
+
+    void runStallCase(bool useDataPlane, long durationMs, long stallMs) {
+        // The transport unhooks itself from the loop when it goes away, so the loops have to outlive it
+        event_loop controlLoop;
+        simulated_usb_transport* transport = new simulated_usb_transport();
+        data_plane plane(transport);
+        null_output_sink sink;
+        usb_devices devices(transport);
+
+        std::map<short, vendor_handler*> vendorHandlers;
+        for (vendor_handler* handler : std::initializer_list<vendor_handler*>{new xp_pen_handler(),
+                                                                              new huion_handler()}) {
+            handler->setConfig(nlohmann::json({}));
+            handler->setTransport(transport);
+            handler->setDataPlane(&plane);
+            handler->setEventLoop(&controlLoop);
+            for (auto productId : handler->getProductIds()) {
+                handler->getProductHandler(productId)->setOutputSink(&sink);
+            }
+
+            vendorHandlers[handler->getVendorId()] = handler;
+        }
+
+        transport->plug(simulated_usb_transport::artist22RPro(1000000, 0));
+        transport->plug(simulated_usb_transport::huionH1161(1000000, 1));
+        devices.getCandidateDevices(vendorHandlers);
+
+        // Either everything shares the control loop like it used to, or USB gets the data plane to itself
+        event_loop* usbLoop = useDataPlane ? plane.getEventLoop() : &controlLoop;
+        devices.registerEventSources(usbLoop);
+        if (useDataPlane) {
+            plane.start();
+        }
+
+        bool running = true;
+        controlLoop.addTimer(durationMs, [&running]() {
+            running = false;
+        });
+
+        // Stall the control loop for stallMs out of every 500ms
+        std::function<void()> scheduleStall;
+        scheduleStall = [&]() {
+            controlLoop.addTimer(500 - stallMs, [&]() {
+                stall(stallMs);
+                scheduleStall();
+            });
+        };
+        scheduleStall();
+
+        while (running) {
+            controlLoop.runOnce(useDataPlane ? -1 : devices.getNextTimeout());
+        }
+
+        plane.stop();
+        printStallResults(useDataPlane ? "data_plane" : "single_thread", *transport);
+
+        for (auto handler : vendorHandlers) {
+            delete handler.second;
+        }
+
+        delete transport;
+    }
+}
+
+// Streams from two simulated tablets at 1 kHz while the control plane regularly blocks, once with everything on a
+// single thread and once with USB handling on the data plane. Takes the run time and the stall length in ms.
+int runControlStallsBench(const std::vector<std::string>& args) {
+    long durationMs = 2000;
+    long stallMs = 100;
+    if (args.size() > 0) {
+        durationMs = std::stol(args[0]);
+    }
+
+    if (args.size() > 1) {
+        stallMs = std::min(std::stol(args[1]), 499L);
+    }
+
+    runStallCase(false, durationMs, stallMs);
+    runStallCase(true, durationMs, stallMs);
+
+    return 0;
+}
@@ -0,0 +1,325 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <iostream>
+#include <functional>
+#include <map>
+#include "bench.h"
+#include "event_loop.h"
+#include "null_output_sink.h"
+#include "report_capture.h"
+#include "artist_22r_pro.h"
+#include "artist_24_pro.h"
+#include "artist_13_3_pro.h"
+#include "artist_12_pro.h"
+#include "deco_pro_small.h"
+#include "deco_pro_medium.h"
+#include "deco_01v2.h"
+#include "huion_tablet.h"
+#include "xp_pen_handler.h"
+#include "huion_handler.h"
+
+namespace {
+    typedef std::vector<std::vector<unsigned char> > report_stream;
+
+    struct decoder_case {
+        std::string name;
+        std::function<transfer_handler*()> create;
+        report_stream reports;
+        // Reports packed back to back into each transfer of the stream
+        int reportsPerTransfer = 1;
+    };
+
+    // A pen stroke moving across the tablet with varying pressure and tilt, touching down half of the time and with
+    // the stylus buttons pressed now and then
+    void addXpPenStroke(report_stream& stream, int length) {
+        for (int index = 0; index < length; ++index) {
+            unsigned char status = 0xa0 | (index % 2 == 0 ? 0x01 : 0x00);
+            if (index % 16 == 5) {
+                status |= 0x02;
+            } else if (index % 16 == 11) {
+                status |= 0x04;
+            }
+
+            int position = index * 37;
+            int pressure = (index * 113) & 0x1fff;
+            stream.push_back({0x02, status,
+                              (unsigned char)(position & 0xff), (unsigned char)((position >> 8) & 0x7f),
+                              (unsigned char)(position & 0xff), (unsigned char)((position >> 8) & 0x7f),
+                              (unsigned char)(pressure & 0xff), (unsigned char)(pressure >> 8),
+                              (unsigned char)(index % 60), (unsigned char)-(index % 60), 0x00, 0x00});
+        }
+    }
+
+    // Presses and releases the first pad button, then turns the dials given by dialBits one step each way
+    void addXpPenFrame(report_stream& stream, std::vector<unsigned char> dialBits) {
+        stream.push_back({0x02, 0xf0, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
+        stream.push_back({0x02, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
+        for (auto dialBit : dialBits) {
+            stream.push_back({0x02, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, dialBit, 0x00, 0x00, 0x00, 0x00});
+        }
+    }
+
+    // Touch pad movement, a tap and roller turns on the Deco Pro pointer interface
+    void addDecoProTouch(report_stream& stream) {
+        stream.push_back({0x01, 0x00, 0x05, 0x00, 0x03, 0x00, 0x00, 0x00});
+        stream.push_back({0x01, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x00});
+        stream.push_back({0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00});
+        stream.push_back({0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00});
+    }
+
+    report_stream xpPenStream(std::vector<unsigned char> dialBits) {
+        report_stream stream;
+        addXpPenStroke(stream, 64);
+        addXpPenFrame(stream, dialBits);
+
+        return stream;
+    }
+
+    report_stream decoProStream() {
+        report_stream stream = xpPenStream({0x01, 0x02, 0x04, 0x08});
+        addDecoProTouch(stream);
+
+        return stream;
+    }
+
+    // Packs every count reports of the stream into one transfer, as a device with a larger packet size would. The
+    // stream is repeated until it divides evenly so that every report is decoded as often as when unpacked.
+    report_stream packReports(const report_stream& stream, int count) {
+        report_stream packed;
+        std::vector<unsigned char> transfer;
+        for (size_t index = 0; index < stream.size() * count; ++index) {
+            auto& report = stream[index % stream.size()];
+            transfer.insert(transfer.end(), report.begin(), report.end());
+            if ((index + 1) % count == 0) {
+                packed.push_back(transfer);
+                transfer.clear();
+            }
+        }
+
+        return packed;
+    }
+
+    report_stream huionStream(int version) {
+        report_stream stream;
+        for (int index = 0; index < 64; ++index) {
+            unsigned char touching = index % 2 == 0 ? 0x01 : 0x00;
+            int position = index * 37;
+            int pressure = (index * 113) & 0x1fff;
+            unsigned char lowX = position & 0xff;
+            unsigned char highX = (position >> 8) & 0x7f;
+            unsigned char lowPressure = pressure & 0xff;
+            unsigned char highPressure = pressure >> 8;
+
+            switch (version) {
+                case 1:
+                    stream.push_back({0x08, (unsigned char)(0xc0 | touching), lowX, highX, lowX, highX,
+                                      lowPressure, highPressure, 0x00, 0x00, 0x00, 0x00});
+                    break;
+                case 2:
+                    stream.push_back({0x08, (unsigned char)(0x80 | touching), lowX, highX, lowX, highX,
+                                      lowPressure, highPressure, 0x00, 0x00,
+                                      (unsigned char)(index % 60), (unsigned char)-(index % 60)});
+                    break;
+                default:
+                    stream.push_back({0x07, (unsigned char)(0x80 | touching), lowX, highX, lowX, highX,
+                                      lowPressure, highPressure, 0x00, 0x00, 0x00, 0x00});
+                    break;
+            }
+        }
+
+        // Pad button press and release
+        unsigned char reportId = version == 3 ? 0x07 : 0x08;
+        stream.push_back({reportId, 0xe0, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
+        stream.push_back({reportId, 0xe0, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
+
+        return stream;
+    }
+
+    device_context* bindNullOutput(transfer_handler* handler, null_output_sink* sink, libusb_device_handle* handle) {
+        handler->setOutputSink(sink);
+        device_context* context = handler->getDeviceContext(handle);
+        context->penEvents.setDevice(sink->createPen(uinput_pen_args()));
+        context->padEvents.setDevice(sink->createPad(uinput_pad_args()));
+        context->pointerEvents.setDevice(sink->createPointer(uinput_pointer_args()));
+
+        return context;
+    }
+
+    void printDecoderResults(const std::string& name, long reports, const bench_usage& usage,
+                             unsigned long allocations, unsigned long events) {
+        std::string benchName = "decoders/" + name;
+        printResult(benchName, "reports/sec", reports * 1000000000.0 / usage.wallNs, "");
+        printResult(benchName, "events/report", (double)events / reports, "");
+        printResult(benchName, "ns/report", (double)usage.wallNs / reports, "ns");
+        printResult(benchName, "allocations/report", (double)allocations / reports, "");
+        printResult(benchName, "syscalls/report",
+                    (double)(usage.readSyscalls + usage.writeSyscalls) / reports, "");
+    }
+
+    int runDecoderCase(decoder_case& decoderCase, long reports) {
+        null_output_sink sink;
+        transfer_handler* handler = decoderCase.create();
+        handler->setConfig(nlohmann::json({}));
+        device_context* context = bindNullOutput(handler, &sink, reinterpret_cast<libusb_device_handle*>(handler));
+
+        // Warm up the caches and the branch predictors before measuring
+        size_t streamLength = decoderCase.reports.size();
+        for (size_t index = 0; index < streamLength; ++index) {
+            auto& report = decoderCase.reports[index];
+            handler->processTransfer(context, report.data(), report.size(), event_loop::monotonicNow());
+        }
+
+        long transfers = reports / decoderCase.reportsPerTransfer;
+        unsigned long eventsStart = sink.getEventsWritten();
+        bench_usage start = bench_usage::now();
+        unsigned long allocationsStart = allocationCount();
+        for (long index = 0; index < transfers; ++index) {
+            auto& report = decoderCase.reports[index % streamLength];
+            handler->processTransfer(context, report.data(), report.size(), event_loop::monotonicNow());
+        }
+        unsigned long allocations = allocationCount() - allocationsStart;
+        bench_usage usage = bench_usage::now() - start;
+
+        long decoded = transfers * decoderCase.reportsPerTransfer;
+        printDecoderResults(decoderCase.name, decoded, usage, allocations, sink.getEventsWritten() - eventsStart);
+
+        delete handler;
+
+        return 0;
+    }
+
+    // Replays a capture recorded by the daemon through the handlers of the products found in it, over and over until
+    // the requested number of reports went through
+    int runCaptureCase(const std::string& capturePath, long reports) {
+        report_capture_reader reader;
+        if (!reader.open(capturePath)) {
+            return 1;
+        }
+
+        null_output_sink sink;
+        std::map<short, vendor_handler*> vendorHandlers;
+        for (vendor_handler* handler : std::initializer_list<vendor_handler*>{new xp_pen_handler(), new huion_handler()}) {
+            vendorHandlers[handler->getVendorId()] = handler;
+        }
+
+        struct bound_report {
+            transfer_handler* handler;
+            device_context* context;
+            const unsigned char* data;
+            size_t length;
+        };
+
+        std::map<uint32_t, std::pair<transfer_handler*, device_context*> > devices;
+        std::vector<bound_report> stream;
+        captured_report report;
+        while (reader.next(report)) {
+            uint32_t deviceKey = (report.vendorId << 16) | report.productId;
+            auto device = devices.find(deviceKey);
+            if (device == devices.end()) {
+                transfer_handler* handler = nullptr;
+                device_context* context = nullptr;
+                auto vendorRecord = vendorHandlers.find(report.vendorId);
+                if (vendorRecord != vendorHandlers.end()) {
+                    handler = vendorRecord->second->getProductHandler(report.productId);
+                }
+
+                if (handler != nullptr) {
+                    handler->setConfig(nlohmann::json({}));
+                    context = bindNullOutput(handler, &sink, reinterpret_cast<libusb_device_handle*>(
+                            (uintptr_t)deviceKey));
+                }
+
+                device = devices.insert({deviceKey, {handler, context}}).first;
+            }
+
+            if (device->second.first != nullptr) {
+                stream.push_back({device->second.first, device->second.second, report.data, report.length});
+            }
+        }
+
+        if (stream.empty()) {
+            std::cout << "No reports in " << capturePath << " belong to a known product" << std::endl;
+            return 1;
+        }
+
+        // Reports are decoded straight out of the mapping, so keep a private copy that decoders may not write into
+        std::vector<std::vector<unsigned char> > buffers;
+        for (auto& bound : stream) {
+            buffers.emplace_back(bound.data, bound.data + bound.length);
+        }
+
+        unsigned long eventsStart = sink.getEventsWritten();
+        bench_usage start = bench_usage::now();
+        unsigned long allocationsStart = allocationCount();
+        for (long index = 0; index < reports; ++index) {
+            size_t position = index % stream.size();
+            bound_report& bound = stream[position];
+            bound.handler->processTransfer(bound.context, buffers[position].data(), bound.length,
+                                           event_loop::monotonicNow());
+        }
+        unsigned long allocations = allocationCount() - allocationsStart;
+        bench_usage usage = bench_usage::now() - start;
+
+        printDecoderResults("capture", reports, usage, allocations, sink.getEventsWritten() - eventsStart);
+
+        for (auto handler : vendorHandlers) {
+            delete handler.second;
+        }
+
+        return 0;
+    }
+}
+
+// Drives synthetic report streams through every decoder, and optionally a capture through the handlers it needs.
+// Events go to a null sink so that only decoding and mapping are measured.
+int runDecodersBench(const std::vector<std::string>& args) {
+    long reports = 200000;
+    if (!args.empty()) {
+        reports = std::stol(args[0]);
+    }
+
+    std::vector<decoder_case> cases = {
+            {"artist_22r_pro", []() { return new artist_22r_pro(); }, xpPenStream({0x01, 0x02, 0x10, 0x20})},
+            {"artist_24_pro", []() { return new artist_24_pro(); }, xpPenStream({0x01, 0x02, 0x10, 0x20})},
+            {"artist_13_3_pro", []() { return new artist_13_3_pro(); }, xpPenStream({0x01, 0x02})},
+            {"artist_12_pro", []() { return new artist_12_pro(); }, xpPenStream({0x01, 0x02})},
+            {"deco_pro_small", []() { return new deco_pro_small(); }, decoProStream()},
+            {"deco_pro_medium", []() { return new deco_pro_medium(); }, decoProStream()},
+            {"deco_01v2", []() { return new deco_01v2(); }, xpPenStream({})},
+            {"huion_tablet_v1", []() { return new huion_tablet(0x006d); }, huionStream(1)},
+            {"huion_tablet_v2", []() { return new huion_tablet(0x006d); }, huionStream(2)},
+            {"huion_tablet_v3", []() { return new huion_tablet(0x006d); }, huionStream(3)},
+            // Several reports per transfer have to come out exactly as they do one at a time
+            {"artist_22r_pro_x4", []() { return new artist_22r_pro(); },
+             packReports(xpPenStream({0x01, 0x02, 0x10, 0x20}), 4), 4},
+            {"huion_tablet_v2_x4", []() { return new huion_tablet(0x006d); }, packReports(huionStream(2), 4), 4},
+    };
+
+    int result = 0;
+    for (auto& decoderCase : cases) {
+        result |= runDecoderCase(decoderCase, reports);
+    }
+
+    if (args.size() > 1) {
+        result |= runCaptureCase(args[1], reports);
+    }
+
+    return result;
+}
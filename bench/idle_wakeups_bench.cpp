@@ -0,0 +1,80 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <libusb-1.0/libusb.h>
+#include <iostream>
+#include "bench.h"
+#include "event_loop.h"
+#include "usb_devices.h"
+#include "libusb_transport.h"
+
+// Compares how often the daemon wakes up while no tablet is sending anything. The legacy mode reproduces the
+// previous main loop that polled libusb with a 1us timeout on every pass.
+int runIdleWakeupsBench(const std::vector<std::string>& args) {
+    long durationMs = 2000;
+    if (!args.empty()) {
+        durationMs = std::stol(args[0]);
+    }
+
+    libusb_transport transport;
+    usb_devices devices(&transport);
+
+    // Previous behaviour
+    unsigned long legacyWakeups = 0;
+    bench_usage start = bench_usage::now();
+    uint64_t deadline = event_loop::monotonicNow() + (uint64_t)durationMs * 1000000;
+    while (event_loop::monotonicNow() < deadline) {
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 1;
+        libusb_handle_events_timeout_completed(transport.getContext(), &tv, NULL);
+        ++legacyWakeups;
+    }
+    bench_usage legacy = bench_usage::now() - start;
+
+    // Event loop behaviour
+    event_loop loop;
+    bool running = true;
+    devices.registerEventSources(&loop);
+    loop.addTimer(durationMs, [&running]() {
+        running = false;
+    });
+
+    start = bench_usage::now();
+    unsigned long wakeupsBefore = loop.getWakeups();
+    while (running) {
+        loop.runOnce(devices.getNextTimeout());
+    }
+    bench_usage epoll = bench_usage::now() - start;
+    unsigned long epollWakeups = loop.getWakeups() - wakeupsBefore;
+
+    double legacySeconds = legacy.wallNs / 1e9;
+    double epollSeconds = epoll.wallNs / 1e9;
+
+    printResult("idle_wakeups/legacy_poll", "wakeups/sec", legacyWakeups / legacySeconds, "");
+    printResult("idle_wakeups/legacy_poll", "cpu", 100.0 * legacy.cpuNs / legacy.wallNs, "%");
+    printResult("idle_wakeups/legacy_poll", "context switches/sec",
+                (legacy.voluntarySwitches + legacy.involuntarySwitches) / legacySeconds, "");
+    printResult("idle_wakeups/event_loop", "wakeups/sec", epollWakeups / epollSeconds, "");
+    printResult("idle_wakeups/event_loop", "cpu", 100.0 * epoll.cpuNs / epoll.wallNs, "%");
+    printResult("idle_wakeups/event_loop", "context switches/sec",
+                (epoll.voluntarySwitches + epoll.involuntarySwitches) / epollSeconds, "");
+
+    return 0;
+}
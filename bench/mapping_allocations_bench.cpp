@@ -0,0 +1,79 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <iostream>
+#include "bench.h"
+#include "artist_22r_pro.h"
+#include "event_loop.h"
+#include "null_output_sink.h"
+
+namespace {
+    class mapping_artist_22r_pro : public artist_22r_pro {
+    public:
+        device_context* bindOutput(libusb_device_handle* handle, output_sink* sink) {
+            setOutputSink(sink);
+            device_context* context = getDeviceContext(handle);
+            context->penEvents.setDevice(sink->createPen(uinput_pen_args()));
+            context->padEvents.setDevice(sink->createPad(uinput_pad_args()));
+
+            return context;
+        }
+    };
+}
+
+// Pad buttons and dials go through the compiled mapping tables and must not touch the heap
+int runMappingAllocationsBench(const std::vector<std::string>& args) {
+    long reports = 100000;
+    if (!args.empty()) {
+        reports = std::stol(args[0]);
+    }
+
+    null_output_sink sink;
+    mapping_artist_22r_pro handler;
+    handler.setConfig(nlohmann::json({}));
+    device_context* context = handler.bindOutput(reinterpret_cast<libusb_device_handle*>(&handler), &sink);
+
+    // Button press, button release, left dial down and right dial up frames
+    unsigned char frames[4][12] = {
+            {0x02, 0xf0, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+            {0x02, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+            {0x02, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00},
+            {0x02, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00},
+    };
+
+    bench_usage start = bench_usage::now();
+    unsigned long allocationsStart = allocationCount();
+    for (long index = 0; index < reports; ++index) {
+        handler.processTransfer(context, frames[index % 4], sizeof(frames[0]),
+                                 event_loop::monotonicNow());
+    }
+    unsigned long allocationsEnd = allocationCount();
+    bench_usage usage = bench_usage::now() - start;
+
+    unsigned long allocations = allocationsEnd - allocationsStart;
+    printResult("mapping_allocations/pad_dial", "allocations/report", (double)allocations / reports, "");
+    printResult("mapping_allocations/pad_dial", "cpu/report", (double)usage.cpuNs / reports, "ns");
+
+    if (allocations != 0) {
+        std::cout << "Pad and dial handling allocated " << allocations << " times" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <map>
+#include <memory>
+#include "bench.h"
+#include "unix_socket_message_queue.h"
+#include "event_loop.h"
+
+namespace {
+    struct heap_message_deleter {
+        void operator()(unix_socket_message* message) const {
+            delete[] message->data;
+            delete message;
+        }
+    };
+
+    typedef std::unique_ptr<unix_socket_message, heap_message_deleter> heap_message;
+
+    // The message queue as it was before, a map of vectors by destination and vendor with every message and its data
+    // allocated on their own. It was never thread safe, so it gets a mutex here to stand in for how it would have had
+    // to be shared.
+    class locked_message_queue {
+    public:
+        // It kept messages for any vendor, whether they were ever taken out or not
+        void addConsumer(message_destination destination, short vendor) {}
+
+        heap_message newMessage(size_t dataLength) {
+            heap_message message(new unix_socket_message());
+            message->data = new unsigned char[dataLength];
+            message->length = dataLength;
+            return message;
+        }
+
+        bool addMessage(heap_message message) {
+            std::lock_guard<std::mutex> lock(mutex);
+            messages[message->destination][message->vendor].push_back(message.release());
+            return true;
+        }
+
+        void getMessagesFor(message_destination destination, short vendor, std::vector<heap_message>& taken) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto record = messages[destination].find(vendor);
+            if (record != messages[destination].end() && record->second.size() > 0) {
+                auto returnedItems = std::vector<unix_socket_message*>(record->second);
+                record->second.clear();
+                for (auto message : returnedItems) {
+                    taken.emplace_back(message);
+                }
+            }
+        }
+
+        void getResponses(std::vector<heap_message>& taken) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto returnedItems = std::vector<unix_socket_message*>();
+            for (auto it = messages[message_destination::gui].begin(); it != messages[message_destination::gui].end(); ++it) {
+                returnedItems.insert(returnedItems.end(), it->second.begin(), it->second.end());
+            }
+
+            messages[message_destination::gui].clear();
+            for (auto message : returnedItems) {
+                taken.emplace_back(message);
+            }
+        }
+    private:
+        std::mutex mutex;
+        std::map<message_destination, std::map<short, std::vector<unix_socket_message*> > > messages;
+    };
+
+    // Two socket threads sending requests for two vendors and a USB thread posting responses, all while the control
+    // thread drains the queue the way the daemon does. Producers keep at most half the queue capacity in flight so
+    // that nothing gets dropped.
+    template <typename Queue>
+    void measureContention(const std::string& name, long messagesPerProducer) {
+        Queue queue;
+        queue.addConsumer(message_destination::driver, 0x28bd);
+        queue.addConsumer(message_destination::driver, 0x256c);
+        const int producers = 3;
+        const long total = messagesPerProducer * producers;
+        const long window = unix_socket_message_queue::capacity / 2;
+        std::atomic<long> produced(0);
+        std::atomic<long> consumed(0);
+
+        auto produce = [&](message_destination destination, short vendor) {
+            for (long index = 0; index < messagesPerProducer; ++index) {
+                while (produced.load(std::memory_order_relaxed) - consumed.load(std::memory_order_relaxed) >= window) {
+                    std::this_thread::yield();
+                }
+
+                auto message = queue.newMessage(16);
+                message->destination = destination;
+                message->vendor = vendor;
+                queue.addMessage(std::move(message));
+                produced++;
+            }
+        };
+
+        unsigned long allocationsBefore = allocationCount();
+        bench_usage start = bench_usage::now();
+        std::thread firstSocket(produce, message_destination::driver, 0x28bd);
+        std::thread secondSocket(produce, message_destination::driver, 0x256c);
+        std::thread usb(produce, message_destination::gui, 0x28bd);
+
+        uint64_t longestDrainNs = 0;
+        std::vector<decltype(queue.newMessage(0))> batch;
+        while (consumed.load() < total) {
+            uint64_t drainStart = event_loop::monotonicNow();
+            queue.getMessagesFor(message_destination::driver, 0x28bd, batch);
+            queue.getMessagesFor(message_destination::driver, 0x256c, batch);
+            queue.getResponses(batch);
+            long drainedNow = batch.size();
+            batch.clear();
+
+            consumed += drainedNow;
+            if (drainedNow > 0) {
+                longestDrainNs = std::max(longestDrainNs, event_loop::monotonicNow() - drainStart);
+            }
+        }
+
+        firstSocket.join();
+        secondSocket.join();
+        usb.join();
+        bench_usage elapsed = bench_usage::now() - start;
+        unsigned long allocations = allocationCount() - allocationsBefore;
+
+        std::string benchName = "message_queue/" + name;
+        printResult(benchName, "messages/sec", total / (elapsed.wallNs / 1e9), "");
+        printResult(benchName, "allocations/message", (double)allocations / total, "");
+        printResult(benchName, "longest drain", longestDrainNs / 1e3, "us");
+        printResult(benchName, "cpu", 100.0 * elapsed.cpuNs / elapsed.wallNs, "%");
+    }
+}
+
+namespace {
+    // A GUI sending to a vendor whose handler never takes out messages while another vendor's are taken out as usual.
+    // The ones nobody asks for have to be dropped instead of piling up.
+    void measureUnpolledVendor(long messages) {
+        unix_socket_message_queue queue;
+        queue.addConsumer(message_destination::driver, 0x28bd);
+        std::vector<pooled_message> batch;
+
+        for (long index = 0; index < messages; ++index) {
+            auto message = queue.newMessage(16);
+            message->destination = message_destination::driver;
+            message->vendor = index % 2 == 0 ? 0x28bd : 0x256c;
+            queue.addMessage(std::move(message));
+
+            if (index % 64 == 63) {
+                queue.getMessagesFor(message_destination::driver, 0x28bd, batch);
+                batch.clear();
+            }
+        }
+
+        queue.getMessagesFor(message_destination::driver, 0x28bd, batch);
+        batch.clear();
+
+        printResult("message_queue/unpolled_vendor", "dropped", queue.getDroppedMessages(), "");
+        printResult("message_queue/unpolled_vendor", "still held", queue.getMessagePool()->getOutstanding(), "");
+    }
+}
+
+// Takes the number of messages each producer thread sends
+int runMessageQueueBench(const std::vector<std::string>& args) {
+    long messagesPerProducer = 200000;
+    if (args.size() > 0) {
+        messagesPerProducer = std::stol(args[0]);
+    }
+
+    measureContention<locked_message_queue>("locked_map", messagesPerProducer);
+    measureContention<unix_socket_message_queue>("lock_free", messagesPerProducer);
+    measureUnpolledVendor(messagesPerProducer);
+
+    return 0;
+}
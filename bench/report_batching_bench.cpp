@@ -0,0 +1,141 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <iostream>
+#include "bench.h"
+#include "artist_22r_pro.h"
+#include "event_loop.h"
+
+namespace {
+    // Writes every batch to an fd so that the write syscalls can be counted without a real uinput device
+    class fd_output_sink : public output_sink {
+    public:
+        explicit fd_output_sink(int fd)
+        : fd(fd) {
+        }
+
+        int createPen(const uinput_pen_args& penArgs) override { return fd; }
+        int createPad(const uinput_pad_args& padArgs) override { return fd; }
+        int createPointer(const uinput_pointer_args& pointerArgs) override { return fd; }
+
+        bool write(int device, const struct input_event* events, size_t count) override {
+            ssize_t expected = count * sizeof(struct input_event);
+            return ::write(device, events, expected) == expected;
+        }
+
+        void destroyDevice(int device) override {}
+    private:
+        int fd;
+    };
+
+    // Gives the benchmark access to the output devices and optionally restores the old one write per event path
+    class batching_artist_22r_pro : public artist_22r_pro {
+    public:
+        explicit batching_artist_22r_pro(bool legacy)
+        : legacy(legacy) {
+        }
+
+        device_context* bindOutput(libusb_device_handle* handle, output_sink* sink) {
+            setOutputSink(sink);
+            device_context* context = getDeviceContext(handle);
+            context->penEvents.setDevice(sink->createPen(uinput_pen_args()));
+            context->padEvents.setDevice(sink->createPad(uinput_pad_args()));
+
+            return context;
+        }
+
+    protected:
+        bool uinput_send(input_event_batch& batch, uint16_t type, uint16_t code, int32_t value) {
+            if (!legacy) {
+                return artist_22r_pro::uinput_send(batch, type, code, value);
+            }
+
+            struct timeval timestamp;
+            gettimeofday(&timestamp, NULL);
+            struct input_event event = {
+                    .time = timestamp,
+                    .type = type,
+                    .code = code,
+                    .value = value
+            };
+
+            return batch.getSink()->write(batch.getDevice(), &event, 1);
+        }
+
+    private:
+        bool legacy;
+    };
+
+    bench_usage runReports(batching_artist_22r_pro& handler, device_context* context, long reports) {
+        unsigned char report[12] = {0x02, 0xa1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+        bench_usage start = bench_usage::now();
+        for (long index = 0; index < reports; ++index) {
+            // Move the pen diagonally while pressing down
+            report[2] = index & 0xff;
+            report[3] = (index >> 8) & 0x7f;
+            report[4] = index & 0xff;
+            report[5] = (index >> 8) & 0x7f;
+            report[6] = index & 0xff;
+            report[7] = (index >> 8) & 0x1f;
+            report[8] = index % 60;
+            report[9] = -(index % 60);
+
+            handler.processTransfer(context, report, sizeof(report), event_loop::monotonicNow());
+        }
+
+        return bench_usage::now() - start;
+    }
+}
+
+// Compares one write() per event with one write() per report for the Artist 22R Pro pen path
+int runReportBatchingBench(const std::vector<std::string>& args) {
+    long reports = 200000;
+    if (!args.empty()) {
+        reports = std::stol(args[0]);
+    }
+
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        std::cout << "Could not open /dev/null" << std::endl;
+        return 1;
+    }
+
+    fd_output_sink sink(fd);
+
+    batching_artist_22r_pro legacyHandler(true);
+    device_context* legacyContext = legacyHandler.bindOutput(reinterpret_cast<libusb_device_handle*>(&legacyHandler), &sink);
+    bench_usage legacy = runReports(legacyHandler, legacyContext, reports);
+
+    batching_artist_22r_pro batchedHandler(false);
+    device_context* batchedContext = batchedHandler.bindOutput(reinterpret_cast<libusb_device_handle*>(&batchedHandler), &sink);
+    bench_usage batched = runReports(batchedHandler, batchedContext, reports);
+
+    close(fd);
+
+    printResult("report_batching/per_event", "write syscalls/report", (double)legacy.writeSyscalls / reports, "");
+    printResult("report_batching/per_event", "cpu/report", (double)legacy.cpuNs / reports, "ns");
+    printResult("report_batching/batched", "write syscalls/report", (double)batched.writeSyscalls / reports, "");
+    printResult("report_batching/batched", "cpu/report", (double)batched.cpuNs / reports, "ns");
+
+    return 0;
+}
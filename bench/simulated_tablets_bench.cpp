@@ -0,0 +1,510 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <iostream>
+#include <deque>
+#include <algorithm>
+#include "bench.h"
+#include "event_loop.h"
+#include "null_output_sink.h"
+#include "simulated_usb_transport.h"
+#include "usb_devices.h"
+#include "hotplug_event.h"
+#include "hotplug_debouncer.h"
+#include "xp_pen_handler.h"
+#include "huion_handler.h"
+#include "capability_cache.h"
+#include "unix_socket_message_queue.h"
+
+namespace {
+    int LIBUSB_CALL queueHotplugEvent(libusb_context* context, libusb_device* device, libusb_hotplug_event event,
+                                      void* userData) {
+        std::deque<hotplug_event>* events = (std::deque<hotplug_event>*)userData;
+        events->push_back({event, device});
+        return 0;
+    }
+
+    void handleHotplugEvents(usb_devices& devices, const std::map<short, vendor_handler*>& vendorHandlers,
+                             std::deque<hotplug_event>& events) {
+        while (!events.empty()) {
+            auto event = events.front();
+            events.pop_front();
+            if (event.event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+                devices.handleDeviceAttach(vendorHandlers, event.device);
+            } else if (event.event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+                devices.handleDeviceDetach(vendorHandlers, event.device);
+            }
+        }
+    }
+
+    // Starts up with four tablets that each take requestLatency to answer a synchronous request, claiming them on the
+    // given number of threads
+    void measureStartup(int workers, uint64_t requestLatency) {
+        event_loop loop;
+        simulated_usb_transport transport;
+        null_output_sink sink;
+        usb_devices devices(&transport);
+        devices.setProbeWorkers(workers);
+
+        std::map<short, vendor_handler*> vendorHandlers;
+        for (vendor_handler* handler : std::initializer_list<vendor_handler*>{new xp_pen_handler(),
+                                                                              new huion_handler()}) {
+            handler->setConfig(nlohmann::json({}));
+            handler->setTransport(&transport);
+            handler->setEventLoop(&loop);
+            for (auto productId : handler->getProductIds()) {
+                handler->getProductHandler(productId)->setOutputSink(&sink);
+            }
+
+            vendorHandlers[handler->getVendorId()] = handler;
+        }
+
+        for (int index = 0; index < 2; ++index) {
+            simulated_tablet artist = simulated_usb_transport::artist22RPro(0);
+            artist.requestLatency = requestLatency;
+            transport.plug(artist);
+
+            simulated_tablet huion = simulated_usb_transport::huionH1161(0);
+            huion.requestLatency = requestLatency;
+            transport.plug(huion);
+        }
+
+        bench_usage start = bench_usage::now();
+        devices.getCandidateDevices(vendorHandlers);
+        bench_usage startup = bench_usage::now() - start;
+
+        uint64_t slowestProbeNs = 0;
+        for (auto& device : devices.getStartupTimes()) {
+            slowestProbeNs = std::max(slowestProbeNs, device.probeNs);
+        }
+
+        std::string name = "simulated_tablets/startup_x" + std::to_string(workers);
+        printResult(name, "attach time", startup.wallNs / 1e6, "ms");
+        printResult(name, "slowest device", slowestProbeNs / 1e6, "ms");
+
+        for (auto handler : vendorHandlers) {
+            delete handler.second;
+        }
+    }
+
+    // Plugs each tablet in twice, the second time with its capabilities already cached
+    void measureCachedAttach(uint64_t requestLatency) {
+        event_loop loop;
+        simulated_usb_transport transport;
+        null_output_sink sink;
+        usb_devices devices(&transport);
+        capability_cache cache;
+
+        std::map<short, vendor_handler*> vendorHandlers;
+        for (vendor_handler* handler : std::initializer_list<vendor_handler*>{new xp_pen_handler(),
+                                                                              new huion_handler()}) {
+            handler->setConfig(nlohmann::json({}));
+            handler->setTransport(&transport);
+            handler->setCapabilityCache(&cache);
+            handler->setEventLoop(&loop);
+            for (auto productId : handler->getProductIds()) {
+                handler->getProductHandler(productId)->setOutputSink(&sink);
+            }
+
+            vendorHandlers[handler->getVendorId()] = handler;
+        }
+
+        std::vector<std::pair<std::string, simulated_tablet> > tablets = {
+                {"artist", simulated_usb_transport::artist22RPro(0)},
+                {"huion", simulated_usb_transport::huionH1161(0)}
+        };
+
+        for (auto& tablet : tablets) {
+            tablet.second.requestLatency = requestLatency;
+            for (const char* run : {"first attach", "cached attach"}) {
+                libusb_device* device = transport.plug(tablet.second);
+                uint64_t start = event_loop::monotonicNow();
+                devices.handleDeviceAttach(vendorHandlers, device);
+                uint64_t attachNs = event_loop::monotonicNow() - start;
+                printResult("simulated_tablets/" + tablet.first, run, attachNs / 1e6, "ms");
+
+                transport.unplug(device);
+                devices.handleDeviceDetach(vendorHandlers, device);
+            }
+        }
+
+        for (auto handler : vendorHandlers) {
+            delete handler.second;
+        }
+    }
+}
+
+// Runs the whole daemon data path, from enumeration through the vendor handlers and the decoders, against simulated
+// tablets instead of hardware. Takes the run time in milliseconds and the interval between two reports of a tablet
+// in microseconds, where 0 sends reports as fast as the daemon takes them.
+int runSimulatedTabletsBench(const std::vector<std::string>& args) {
+    long durationMs = 2000;
+    long reportIntervalUs = 0;
+    if (args.size() > 0) {
+        durationMs = std::stol(args[0]);
+    }
+
+    if (args.size() > 1) {
+        reportIntervalUs = std::stol(args[1]);
+    }
+
+    uint64_t reportInterval = (uint64_t)reportIntervalUs * 1000;
+    // The transport unhooks itself from the loop when it goes away, so the loop has to outlive it
+    event_loop loop;
+    simulated_usb_transport transport;
+    null_output_sink sink;
+    usb_devices devices(&transport);
+
+    std::map<short, vendor_handler*> vendorHandlers;
+    for (vendor_handler* handler : std::initializer_list<vendor_handler*>{new xp_pen_handler(), new huion_handler()}) {
+        handler->setConfig(nlohmann::json({}));
+        handler->setTransport(&transport);
+        handler->setEventLoop(&loop);
+        for (auto productId : handler->getProductIds()) {
+            handler->getProductHandler(productId)->setOutputSink(&sink);
+        }
+
+        vendorHandlers[handler->getVendorId()] = handler;
+    }
+
+    // Startup with both tablets already plugged in
+    transport.plug(simulated_usb_transport::artist22RPro(reportInterval));
+    transport.plug(simulated_usb_transport::huionH1161(reportInterval));
+
+    bench_usage start = bench_usage::now();
+    auto supportedDevices = devices.getCandidateDevices(vendorHandlers);
+    bench_usage startup = bench_usage::now() - start;
+
+    std::deque<hotplug_event> hotplugEvents;
+    std::vector<libusb_hotplug_callback_handle> callbackHandles;
+    for (auto vendorProducts : supportedDevices) {
+        for (auto product : vendorProducts.second) {
+            libusb_hotplug_callback_handle callbackHandle;
+            if (transport.registerHotplugCallback(vendorProducts.first, product, queueHotplugEvent, &hotplugEvents,
+                                                  &callbackHandle) == LIBUSB_SUCCESS) {
+                callbackHandles.push_back(callbackHandle);
+            }
+        }
+    }
+
+    devices.registerEventSources(&loop);
+
+    // Steady state streaming
+    bool running = true;
+    int timerId = loop.addTimer(durationMs, [&running]() {
+        running = false;
+    });
+
+    unsigned long reportsBefore = transport.getReportsDelivered();
+    unsigned long eventsBefore = sink.getEventsWritten();
+    start = bench_usage::now();
+    while (running) {
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+    }
+    bench_usage streaming = bench_usage::now() - start;
+    loop.cancelTimer(timerId);
+    unsigned long reports = transport.getReportsDelivered() - reportsBefore;
+    unsigned long events = sink.getEventsWritten() - eventsBefore;
+
+    // Hotplug a third tablet and wait for its first report to come through the handlers
+    reportsBefore = transport.getReportsDelivered();
+    start = bench_usage::now();
+    libusb_device* hotplugged = transport.plug(simulated_usb_transport::artist22RPro(reportInterval));
+    while (transport.getReportsDelivered() - reportsBefore < 3) {
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+    }
+    bench_usage hotplug = bench_usage::now() - start;
+
+    transport.unplug(hotplugged);
+    loop.runOnce(0);
+    handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+
+    // Hotplug a tablet that can't be claimed the first few times. The others have to keep streaming while it gets
+    // retried, so no single pass through the loop may take long.
+    simulated_tablet flakyTablet = simulated_usb_transport::artist22RPro(reportInterval);
+    flakyTablet.busyOpens = 3;
+    uint64_t longestPassNs = 0;
+    start = bench_usage::now();
+    libusb_device* flaky = transport.plug(flakyTablet);
+    while (transport.getReportsDelivered(flaky) < 3) {
+        uint64_t passStart = event_loop::monotonicNow();
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+        longestPassNs = std::max(longestPassNs, event_loop::monotonicNow() - passStart);
+    }
+    bench_usage flakyAttach = bench_usage::now() - start;
+
+    transport.unplug(flaky);
+    loop.runOnce(0);
+    handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+
+    // Unplug a tablet and plug it back in within the grace period, it should get its virtual devices back
+    for (auto handler : vendorHandlers) {
+        handler.second->setDisconnectGracePeriod(1000);
+    }
+
+    libusb_device* reconnecting = transport.plug(simulated_usb_transport::artist22RPro(reportInterval));
+    while (transport.getReportsDelivered(reconnecting) < 3) {
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+    }
+
+    int devicesCreated = sink.getDevicesCreated();
+    transport.unplug(reconnecting);
+    loop.runOnce(0);
+    handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+
+    start = bench_usage::now();
+    reconnecting = transport.plug(simulated_usb_transport::artist22RPro(reportInterval));
+    while (transport.getReportsDelivered(reconnecting) < 3) {
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+    }
+    bench_usage reconnect = bench_usage::now() - start;
+    int devicesRecreated = sink.getDevicesCreated() - devicesCreated;
+
+    // Gone for good this time, its virtual devices have to go once the grace period is over
+    int liveDevices = sink.getLiveDevices();
+    transport.unplug(reconnecting);
+    bool graceOver = false;
+    timerId = loop.addTimer(1100, [&graceOver]() {
+        graceOver = true;
+    });
+    while (!graceOver) {
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+    }
+    int devicesRemoved = liveDevices - sink.getLiveDevices();
+
+    for (auto handler : vendorHandlers) {
+        handler.second->setDisconnectGracePeriod(0);
+    }
+
+    // A connector bouncing twice while the tablet goes in. Only the last arrival should get claimed.
+    hotplug_debouncer debouncer(&loop, &transport, [&devices, &vendorHandlers](const hotplug_event& event) {
+        std::deque<hotplug_event> settled = {event};
+        handleHotplugEvents(devices, vendorHandlers, settled);
+    });
+    debouncer.setWindow(100);
+
+    libusb_device* bouncing = nullptr;
+    for (int bounce = 0; bounce < 3; ++bounce) {
+        bouncing = transport.plug(simulated_usb_transport::artist22RPro(reportInterval));
+        if (bounce < 2) {
+            transport.unplug(bouncing);
+        }
+    }
+
+    start = bench_usage::now();
+    while (transport.getReportsDelivered(bouncing) < 3) {
+        loop.runOnce(devices.getNextTimeout());
+        while (!hotplugEvents.empty()) {
+            debouncer.push(hotplugEvents.front());
+            hotplugEvents.pop_front();
+        }
+    }
+    bench_usage bounced = bench_usage::now() - start;
+    unsigned long bounceTransitions = debouncer.getDeliveredTransitions();
+    unsigned long bounceSuppressed = debouncer.getSuppressedTransitions();
+
+    transport.unplug(bouncing);
+    while (debouncer.getDeliveredTransitions() == bounceTransitions) {
+        loop.runOnce(devices.getNextTimeout());
+        while (!hotplugEvents.empty()) {
+            debouncer.push(hotplugEvents.front());
+            hotplugEvents.pop_front();
+        }
+    }
+
+    // A claimed tablet whose connector bounces, so that it re-enumerates and comes back as a new device each time while
+    // staying on the same port. The old one has to go and only the last new one gets claimed, both once it settled.
+    auto pumpDebouncer = [&](long ms) {
+        uint64_t until = event_loop::monotonicNow() + ms * 1000000ULL;
+        while (event_loop::monotonicNow() < until) {
+            int timeout = devices.getNextTimeout();
+            long left = (long)((until - event_loop::monotonicNow()) / 1000000) + 1;
+            loop.runOnce(timeout < 0 || timeout > left ? left : timeout);
+            while (!hotplugEvents.empty()) {
+                debouncer.push(hotplugEvents.front());
+                hotplugEvents.pop_front();
+            }
+        }
+    };
+
+    simulated_tablet reenumeratingTablet = simulated_usb_transport::artist22RPro(reportInterval);
+    libusb_device* reenumerating = transport.plug(reenumeratingTablet);
+    while (transport.getReportsDelivered(reenumerating) < 3) {
+        pumpDebouncer(1);
+    }
+    uint8_t port;
+    transport.getPortNumbers(reenumerating, &port, 1);
+    reenumeratingTablet.port = port;
+
+    unsigned long transitionsBefore = debouncer.getDeliveredTransitions();
+    unsigned long suppressedBefore = debouncer.getSuppressedTransitions();
+    transport.unplug(reenumerating);
+    for (int bounce = 0; bounce < 2; ++bounce) {
+        pumpDebouncer(40);
+        reenumerating = transport.plug(reenumeratingTablet);
+        if (bounce == 0) {
+            pumpDebouncer(40);
+            transport.unplug(reenumerating);
+        }
+    }
+    unsigned long reenumerationWhileBouncing = debouncer.getDeliveredTransitions() - transitionsBefore;
+
+    start = bench_usage::now();
+    while (transport.getReportsDelivered(reenumerating) < 3) {
+        pumpDebouncer(1);
+    }
+    bench_usage reenumerated = bench_usage::now() - start;
+    unsigned long reenumerationTransitions = debouncer.getDeliveredTransitions() - transitionsBefore;
+    unsigned long reenumerationSuppressed = debouncer.getSuppressedTransitions() - suppressedBefore;
+
+    transitionsBefore = debouncer.getDeliveredTransitions();
+    transport.unplug(reenumerating);
+    while (debouncer.getDeliveredTransitions() == transitionsBefore) {
+        pumpDebouncer(1);
+    }
+
+    // A tablet that also sends mouse reports nobody decodes on its second interface. Once the endpoint is found to be
+    // useless, its reports should stop costing anything.
+    simulated_tablet noisyTablet = simulated_usb_transport::huionH1161(reportInterval);
+    noisyTablet.noiseEndpoint = 0x82;
+    noisyTablet.noiseReport = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    libusb_device* noisy = transport.plug(noisyTablet);
+    while (transport.getReportsDelivered(noisy) < 500) {
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+    }
+    unsigned long noiseHandled = transport.getNoiseDelivered(noisy);
+
+    transport.unplug(noisy);
+    loop.runOnce(0);
+    handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+
+    // The GUI asking a tablet for its settings while it streams. The responses come in between its reports, which have
+    // to keep coming the whole time.
+    unix_socket_message_queue messageQueue;
+    for (auto handler : vendorHandlers) {
+        handler.second->setMessageQueue(&messageQueue);
+    }
+
+    simulated_tablet answeringTablet = simulated_usb_transport::artist22RPro(reportInterval);
+    answeringTablet.messageResponse = {0x02, 0xb0, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    libusb_device* answering = transport.plug(answeringTablet);
+    while (transport.getReportsDelivered(answering) < 3) {
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+    }
+
+    const int messagesSent = 20;
+    for (int index = 0; index < messagesSent; ++index) {
+        pooled_message message = messageQueue.newMessage(2);
+        message->destination = message_destination::driver;
+        message->vendor = answeringTablet.vendorId;
+        message->device = answeringTablet.productId;
+        message->interface = 0x02;
+        message->expectResponse = true;
+        message->responseLength = answeringTablet.messageResponse.size();
+        message->responseInterface = answeringTablet.reportEndpoint;
+        message->data[0] = 0x02;
+        message->data[1] = 0xb0;
+        messageQueue.addMessage(std::move(message));
+    }
+
+    unsigned long droppedBefore = transport.getReportsDropped();
+    reportsBefore = transport.getReportsDelivered(answering);
+    int responsesReceived = 0;
+    int reportsTakenAsResponses = 0;
+    uint64_t answeredNs = 0;
+    start = bench_usage::now();
+    vendorHandlers[answeringTablet.vendorId]->handleMessages();
+    while ((responsesReceived < messagesSent || transport.getReportsDelivered(answering) - reportsBefore < 100) &&
+           (bench_usage::now() - start).wallNs < 2000000000) {
+        loop.runOnce(devices.getNextTimeout());
+        handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+        // The tablet streaming since startup is of the same product and gets the messages as well. It never answers,
+        // its pen reports are as long as the response and must not be mistaken for one.
+        std::vector<pooled_message> responses;
+        messageQueue.getResponses(responses);
+        for (auto& response : responses) {
+            if (!std::equal(answeringTablet.messageResponse.begin(), answeringTablet.messageResponse.end(),
+                            response->data)) {
+                reportsTakenAsResponses++;
+            } else if (++responsesReceived == messagesSent) {
+                answeredNs = (bench_usage::now() - start).wallNs;
+            }
+        }
+    }
+    unsigned long reportsWhileAnswering = transport.getReportsDelivered(answering) - reportsBefore;
+    unsigned long droppedWhileAnswering = transport.getReportsDropped() - droppedBefore;
+
+    transport.unplug(answering);
+    loop.runOnce(0);
+    handleHotplugEvents(devices, vendorHandlers, hotplugEvents);
+
+    // Four tablets behind a dock that takes 5ms per request, probed one after another and then all at once
+    measureStartup(1, 5000000);
+    measureStartup(4, 5000000);
+    measureCachedAttach(5000000);
+
+    double streamingSeconds = streaming.wallNs / 1e9;
+    printResult("simulated_tablets/startup", "attach time", startup.wallNs / 1e6, "ms");
+    printResult("simulated_tablets/hotplug", "first report after", hotplug.wallNs / 1e6, "ms");
+    printResult("simulated_tablets/flaky_attach", "first report after", flakyAttach.wallNs / 1e6, "ms");
+    printResult("simulated_tablets/flaky_attach", "longest loop pass", longestPassNs / 1e6, "ms");
+    printResult("simulated_tablets/reconnect", "first report after", reconnect.wallNs / 1e6, "ms");
+    printResult("simulated_tablets/reconnect", "devices recreated", devicesRecreated, "");
+    printResult("simulated_tablets/reconnect", "removed after grace", devicesRemoved, "");
+    printResult("simulated_tablets/bouncing", "first report after", bounced.wallNs / 1e6, "ms");
+    printResult("simulated_tablets/bouncing", "transitions handled", bounceTransitions, "");
+    printResult("simulated_tablets/bouncing", "suppressed", bounceSuppressed, "");
+    printResult("simulated_tablets/reenumerating", "first report after", reenumerated.wallNs / 1e6, "ms");
+    printResult("simulated_tablets/reenumerating", "handled while bouncing", reenumerationWhileBouncing, "");
+    printResult("simulated_tablets/reenumerating", "transitions handled", reenumerationTransitions, "");
+    printResult("simulated_tablets/reenumerating", "suppressed", reenumerationSuppressed, "");
+    printResult("simulated_tablets/noisy", "noise of 500 handled", noiseHandled, "");
+    printResult("simulated_tablets/messages", "responses of 20", responsesReceived, "");
+    printResult("simulated_tablets/messages", "all answered after", answeredNs / 1e6, "ms");
+    printResult("simulated_tablets/messages", "reports taken as responses", reportsTakenAsResponses, "");
+    printResult("simulated_tablets/messages", "reports of next 100", reportsWhileAnswering, "");
+    printResult("simulated_tablets/messages", "dropped of next 100", droppedWhileAnswering, "");
+    printResult("simulated_tablets/streaming", "reports/sec", reports / streamingSeconds, "");
+    printResult("simulated_tablets/streaming", "events/sec", events / streamingSeconds, "");
+    printResult("simulated_tablets/streaming", "cpu", 100.0 * streaming.cpuNs / streaming.wallNs, "%");
+    printResult("simulated_tablets/streaming", "wakeups/report", (double)loop.getWakeups() / reports, "");
+
+    for (auto callbackHandle : callbackHandles) {
+        transport.deregisterHotplugCallback(callbackHandle);
+    }
+
+    for (auto handler : vendorHandlers) {
+        delete handler.second;
+    }
+
+    if (reports == 0) {
+        std::cout << "No reports made it through the simulated tablets" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
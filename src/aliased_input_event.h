@@ -19,6 +19,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef USERSPACE_TABLET_DRIVER_DAEMON_ALIASED_INPUT_EVENT_H
 #define USERSPACE_TABLET_DRIVER_DAEMON_ALIASED_INPUT_EVENT_H
 
+#include <cstddef>
+
 struct aliased_input_event {
 public:
     int event_type;
@@ -26,4 +28,15 @@ public:
     int event_data;
 };
 
+// Read-only view into a compiled mapping table
+struct aliased_input_event_span {
+public:
+    const aliased_input_event* first;
+    const aliased_input_event* last;
+
+    const aliased_input_event* begin() const { return first; }
+    const aliased_input_event* end() const { return last; }
+    size_t size() const { return last - first; }
+};
+
 #endif //USERSPACE_TABLET_DRIVER_DAEMON_ALIASED_INPUT_EVENT_H
@@ -31,11 +31,12 @@ public:
     void setConfig(nlohmann::json config);
     int sendInitKeyOnInterface();
     bool attachToInterfaceId(int interfaceId);
+    bool readCapabilities(libusb_device_handle* handle, device_capabilities& capabilities);
     bool attachDevice(libusb_device_handle* handle, int interfaceId);
-    bool handleTransferData(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
+    bool handleTransferData(device_context* context, unsigned char* data, size_t dataLen);
 private:
-    void handleDigitizerEvent(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
-    void handleFrameEvent(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
+    void handleDigitizerEvent(device_context* context, unsigned char* data, size_t dataLen);
+    void handleFrameEvent(device_context* context, unsigned char* data, size_t dataLen);
 };
 
 
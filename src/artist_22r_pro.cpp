@@ -21,6 +21,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <unistd.h>
 #include <linux/uinput.h>
 #include "artist_22r_pro.h"
+#include "xp_pen_capabilities.h"
 
 artist_22r_pro::artist_22r_pro() {
     productIds.push_back(0x091b);
@@ -32,6 +33,8 @@ artist_22r_pro::artist_22r_pro() {
     for (int currentAssignedButton = BTN_A; currentAssignedButton <= BTN_SELECT; ++currentAssignedButton) {
         padButtonAliases.push_back(currentAssignedButton);
     }
+
+    setReportLength(0x02, 12);
 }
 
 artist_22r_pro::~artist_22r_pro() {
@@ -98,6 +101,10 @@ int artist_22r_pro::sendInitKeyOnInterface() {
     return 0x02;
 }
 
+bool artist_22r_pro::readCapabilities(libusb_device_handle* handle, device_capabilities& capabilities) {
+    return readXpPenCapabilities(transport, handle, capabilities);
+}
+
 bool artist_22r_pro::attachToInterfaceId(int interfaceId) {
     switch (interfaceId) {
         case 2:
@@ -108,17 +115,16 @@ bool artist_22r_pro::attachToInterfaceId(int interfaceId) {
 }
 
 bool artist_22r_pro::attachDevice(libusb_device_handle *handle, int interfaceId) {
-    unsigned char* buf = new unsigned char[12];
-
     // We need to get a few more bits of information
-    if (libusb_get_string_descriptor(handle, 0x64, 0x0409, buf, 12) != 12) {
+    device_capabilities capabilities;
+    if (!getCapabilities(handle, capabilities)) {
         std::cout << "Could not get descriptor" << std::endl;
         return false;
     }
 
-    int maxWidth = (buf[3] << 8) + buf[2];
-    int maxHeight = (buf[5] << 8) + buf[4];
-    int maxPressure = (buf[9] << 8) + buf[8];
+    int maxWidth = capabilities.maxWidth;
+    int maxHeight = capabilities.maxHeight;
+    int maxPressure = capabilities.maxPressure;
 
     unsigned short vendorId = 0x28bd;
     unsigned short productId = 0xf91b;
@@ -148,29 +154,30 @@ bool artist_22r_pro::attachDevice(libusb_device_handle *handle, int interfaceId)
         {"XP-Pen Artist 22R Pro Pad"},
     };
 
-    uinputPens[handle] = create_pen(penArgs);
-    uinputPads[handle] = create_pad(padArgs);
+    getDeviceContext(handle)->penEvents.setDevice(create_pen(penArgs));
+    getDeviceContext(handle)->padEvents.setDevice(create_pad(padArgs));
 
     return true;
 }
 
-bool artist_22r_pro::handleTransferData(libusb_device_handle* handle, unsigned char *data, size_t dataLen) {
+bool artist_22r_pro::handleTransferData(device_context* context, unsigned char *data, size_t dataLen) {
     switch (data[0]) {
         // Unified interface
         case 0x02:
-            handleDigitizerEvent(handle, data, dataLen);
-            handleFrameEvent(handle, data, dataLen);
+            handleDigitizerEvent(context, data, dataLen);
+            handleFrameEvent(context, data, dataLen);
 
             break;
 
+        // Nothing we know how to decode
         default:
-            break;
+            return false;
     }
 
     return true;
 }
 
-void artist_22r_pro::handleDigitizerEvent(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void artist_22r_pro::handleDigitizerEvent(device_context* context, unsigned char *data, size_t dataLen) {
     if (data[1] < 0xb0) {
         // Extract the X and Y position
         int penX = (data[3] << 8) + data[2];
@@ -182,10 +189,10 @@ void artist_22r_pro::handleDigitizerEvent(libusb_device_handle *handle, unsigned
             // Grab the pressure amount
             pressure = (data[7] << 8) + data[6];
 
-            uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 1);
-            uinput_send(uinputPens[handle], EV_ABS, ABS_PRESSURE, pressure);
+            uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 1);
+            uinput_send(context->penEvents, EV_ABS, ABS_PRESSURE, pressure);
         } else {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 0);
         }
 
         // Grab the tilt values
@@ -194,26 +201,26 @@ void artist_22r_pro::handleDigitizerEvent(libusb_device_handle *handle, unsigned
 
         // Check to see if the stylus buttons are being pressed
         if (0x02 & data[1]) {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 1);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 1);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
         } else if (0x04 & data[1]) {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 1);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 1);
         } else {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
         }
 
-        uinput_send(uinputPens[handle], EV_ABS, ABS_X, penX);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_Y, penY);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_TILT_X, tiltx);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_TILT_Y, tilty);
+        uinput_send(context->penEvents, EV_ABS, ABS_X, penX);
+        uinput_send(context->penEvents, EV_ABS, ABS_Y, penY);
+        uinput_send(context->penEvents, EV_ABS, ABS_TILT_X, tiltx);
+        uinput_send(context->penEvents, EV_ABS, ABS_TILT_Y, tilty);
 
-        uinput_send(uinputPens[handle], EV_SYN, SYN_REPORT, 1);
+        uinput_send(context->penEvents, EV_SYN, SYN_REPORT, 1);
     }
 }
 
-void artist_22r_pro::handleFrameEvent(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void artist_22r_pro::handleFrameEvent(device_context* context, unsigned char *data, size_t dataLen) {
     if (data[1] >= 0xf0) {
         // Extract the button being pressed (If there is one)
         long button = (data[4] << 16) + (data[3] << 8) + data[2];
@@ -241,50 +248,50 @@ void artist_22r_pro::handleFrameEvent(libusb_device_handle *handle, unsigned cha
 
         if (leftDialValue != 0) {
             bool send_reset = false;
-            auto dialMap = dialMapping.getDialMap(EV_REL, REL_WHEEL, leftDialValue);
+            auto dialMap = dialMapping.getDialMap(REL_WHEEL, leftDialValue);
             for (auto dmap : dialMap) {
-                uinput_send(uinputPads[handle], dmap.event_type, dmap.event_value, dmap.event_data);
+                uinput_send(context->padEvents, dmap.event_type, dmap.event_value, dmap.event_data);
                 if (dmap.event_type == EV_KEY) {
                     send_reset = true;
                 }
             }
 
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
 
             if (send_reset) {
                 for (auto dmap : dialMap) {
                     // We have to handle key presses manually here because this device does not send reset events
                     if (dmap.event_type == EV_KEY) {
-                        uinput_send(uinputPads[handle], dmap.event_type, dmap.event_value, 0);
+                        uinput_send(context->padEvents, dmap.event_type, dmap.event_value, 0);
                     }
                 }
             }
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
 
             shouldSyn = false;
             dialEvent = true;
         } else if (rightDialValue != 0) {
             bool send_reset = false;
-            auto dialMap = dialMapping.getDialMap(EV_REL, REL_HWHEEL, rightDialValue);
+            auto dialMap = dialMapping.getDialMap(REL_HWHEEL, rightDialValue);
             for (auto dmap : dialMap) {
-                uinput_send(uinputPads[handle], dmap.event_type, dmap.event_value, dmap.event_data);
+                uinput_send(context->padEvents, dmap.event_type, dmap.event_value, dmap.event_data);
                 if (dmap.event_type == EV_KEY) {
                     send_reset = true;
                 }
             }
 
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
 
             if (send_reset) {
                 for (auto dmap : dialMap) {
                     // We have to handle key presses manually here because this device does not send reset events
                     if (dmap.event_type == EV_KEY) {
-                        uinput_send(uinputPads[handle], dmap.event_type, dmap.event_value, 0);
+                        uinput_send(context->padEvents, dmap.event_type, dmap.event_value, 0);
                     }
                 }
             }
 
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
 
             shouldSyn = false;
             dialEvent = true;
@@ -293,23 +300,23 @@ void artist_22r_pro::handleFrameEvent(libusb_device_handle *handle, unsigned cha
         if (button != 0) {
             auto padMap = padMapping.getPadMap(padButtonAliases[position - 1]);
             for (auto pmap : padMap) {
-                uinput_send(uinputPads[handle], pmap.event_type, pmap.event_value, 1);
+                uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 1);
             }
-            lastPressedButton[handle] = position;
+            context->lastPressedButton = position;
         } else if (!dialEvent) {
-            if (lastPressedButton.find(handle) != lastPressedButton.end() && lastPressedButton[handle] > 0) {
-                auto padMap = padMapping.getPadMap(padButtonAliases[lastPressedButton[handle] - 1]);
+            if (context->lastPressedButton > 0) {
+                auto padMap = padMapping.getPadMap(padButtonAliases[context->lastPressedButton - 1]);
                 for (auto pmap : padMap) {
-                    uinput_send(uinputPads[handle], pmap.event_type, pmap.event_value, 0);
+                    uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 0);
                 }
-                lastPressedButton[handle] = -1;
+                context->lastPressedButton = -1;
             } else {
                 std::cout << "Got a phantom button up event" << std::endl;
             }
         }
 
         if (shouldSyn) {
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
         }
     }
 }
@@ -0,0 +1,35 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_ATTACH_ATTEMPT_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_ATTACH_ATTEMPT_H
+
+#include <libusb-1.0/libusb.h>
+
+// A device that could not be claimed yet. It waits on a timer of the control loop for its next try instead of
+// holding up everything else.
+struct attach_attempt {
+    libusb_device* device;
+    struct libusb_device_descriptor descriptor;
+    // Tries made so far
+    int attempts;
+    long retryDelayMs;
+    int timerId;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_ATTACH_ATTEMPT_H
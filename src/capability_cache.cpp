@@ -0,0 +1,157 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cerrno>
+#include "capability_cache.h"
+
+bool device_capabilities::operator==(const device_capabilities& other) const {
+    return maxWidth == other.maxWidth &&
+           maxHeight == other.maxHeight &&
+           maxPressure == other.maxPressure &&
+           firmware == other.firmware &&
+           aliasedProductId == other.aliasedProductId;
+}
+
+bool device_capabilities::operator!=(const device_capabilities& other) const {
+    return !(*this == other);
+}
+
+capability_cache::capability_cache(const std::string& path) : path(path), entries(nlohmann::json::object()) {
+    load();
+}
+
+std::string capability_cache::makeKey(const struct libusb_device_descriptor& descriptor, const std::string& serial) {
+    std::stringstream key;
+    key << std::hex << std::setfill('0')
+        << std::setw(4) << descriptor.idVendor << ":"
+        << std::setw(4) << descriptor.idProduct << ":"
+        << std::setw(4) << descriptor.bcdDevice << ":"
+        << serial;
+
+    return key.str();
+}
+
+void capability_cache::bind(libusb_device_handle* handle, const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    keys[handle] = key;
+    servedFromCache.erase(handle);
+}
+
+void capability_cache::unbind(libusb_device_handle* handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    keys.erase(handle);
+    servedFromCache.erase(handle);
+}
+
+bool capability_cache::lookup(libusb_device_handle* handle, device_capabilities& capabilities) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto key = keys.find(handle);
+    if (key == keys.end() || !entries.contains(key->second)) {
+        return false;
+    }
+
+    const nlohmann::json& entry = entries[key->second];
+    try {
+        capabilities.maxWidth = entry.at("maxWidth");
+        capabilities.maxHeight = entry.at("maxHeight");
+        capabilities.maxPressure = entry.at("maxPressure");
+        capabilities.firmware = entry.at("firmware");
+        capabilities.aliasedProductId = entry.at("aliasedProductId");
+    } catch (nlohmann::detail::exception&) {
+        std::cout << "Ignoring malformed cached capabilities for " << key->second << std::endl;
+        return false;
+    }
+
+    servedFromCache.insert(handle);
+    return true;
+}
+
+void capability_cache::store(libusb_device_handle* handle, const device_capabilities& capabilities) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto key = keys.find(handle);
+    if (key == keys.end()) {
+        return;
+    }
+
+    nlohmann::json entry = {
+            {"maxWidth", capabilities.maxWidth},
+            {"maxHeight", capabilities.maxHeight},
+            {"maxPressure", capabilities.maxPressure},
+            {"firmware", capabilities.firmware},
+            {"aliasedProductId", capabilities.aliasedProductId}
+    };
+
+    if (entries.contains(key->second) && entries[key->second] == entry) {
+        return;
+    }
+
+    entries[key->second] = entry;
+    save();
+}
+
+bool capability_cache::wasServedFromCache(libusb_device_handle* handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return servedFromCache.find(handle) != servedFromCache.end();
+}
+
+void capability_cache::load() {
+    if (path.empty()) {
+        return;
+    }
+
+    std::ifstream file(path, std::ifstream::in);
+    if (!file.is_open()) {
+        return;
+    }
+
+    try {
+        file >> entries;
+    } catch (nlohmann::detail::parse_error&) {
+        std::cout << "Could not parse the capability cache " << path << ", starting with an empty one" << std::endl;
+    }
+
+    if (!entries.is_object()) {
+        entries = nlohmann::json::object();
+    }
+}
+
+void capability_cache::save() {
+    if (path.empty()) {
+        return;
+    }
+
+    // Written next to the cache and renamed over it so that a crash never leaves half a file behind
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ofstream::out | std::ofstream::trunc);
+    if (!file.is_open()) {
+        std::cout << "Could not write the capability cache " << path << std::endl;
+        return;
+    }
+
+    file << entries;
+    file.close();
+
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        std::cout << "Could not replace the capability cache " << path << " errno: " << errno << std::endl;
+    }
+}
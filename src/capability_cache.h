@@ -0,0 +1,71 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_CAPABILITY_CACHE_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_CAPABILITY_CACHE_H
+
+#include <libusb-1.0/libusb.h>
+#include <map>
+#include <set>
+#include <mutex>
+#include <string>
+#include "includes/json.hpp"
+
+// What a tablet reports about itself through vendor specific string descriptors
+struct device_capabilities {
+    int maxWidth = 0;
+    int maxHeight = 0;
+    int maxPressure = 0;
+    // Firmware name and the product id it resolves to, for tablets that share a product id between models
+    std::string firmware;
+    int aliasedProductId = 0;
+
+    bool operator==(const device_capabilities& other) const;
+    bool operator!=(const device_capabilities& other) const;
+};
+
+// Capabilities of every tablet seen so far, keyed by vendor id, product id, device release and serial number, so that
+// re-plugging a known tablet doesn't have to wait for the descriptor reads. Handles of attached devices are bound to
+// their key while they are being claimed. Safe to use from several probing threads at once.
+class capability_cache {
+public:
+    // Without a path nothing is persisted
+    explicit capability_cache(const std::string& path = "");
+
+    static std::string makeKey(const struct libusb_device_descriptor& descriptor, const std::string& serial);
+
+    void bind(libusb_device_handle* handle, const std::string& key);
+    void unbind(libusb_device_handle* handle);
+
+    bool lookup(libusb_device_handle* handle, device_capabilities& capabilities);
+    // Saves the file if the capabilities are new or changed
+    void store(libusb_device_handle* handle, const device_capabilities& capabilities);
+    // Whether anything was served from the cache for the handle, which then is worth checking against the device
+    bool wasServedFromCache(libusb_device_handle* handle);
+private:
+    void load();
+    void save();
+
+    std::mutex mutex;
+    std::string path;
+    nlohmann::json entries;
+    std::map<libusb_device_handle*, std::string> keys;
+    std::set<libusb_device_handle*> servedFromCache;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_CAPABILITY_CACHE_H
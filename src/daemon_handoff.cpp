@@ -0,0 +1,229 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include "daemon_handoff.h"
+#include "socket_server.h"
+#include "unix_socket_message.h"
+
+std::vector<handed_off_device> daemon_handoff::requestHandOff() {
+    std::vector<handed_off_device> handedOff;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        std::cout << "Could not create socket to take over from" << std::endl;
+        return handedOff;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(struct sockaddr_un));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_server::getSocketLocation().c_str(), sizeof(address.sun_path) - 1);
+
+    if (connect(sock, (struct sockaddr*)&address, sizeof(struct sockaddr_un)) == -1) {
+        std::cout << "No running daemon to take over from" << std::endl;
+        close(sock);
+        return handedOff;
+    }
+
+    unix_socket_message_header request;
+    memset(&request, 0, sizeof(request));
+    request.destination = message_destination::eventHandler;
+    request.device = handOffRequest;
+    request.expectResponse = true;
+    request.signature = socket_server::versionSignature;
+    if (write(sock, &request, sizeof(request)) != sizeof(request)) {
+        std::cout << "Could not ask the running daemon to hand over" << std::endl;
+        close(sock);
+        return handedOff;
+    }
+
+    struct pollfd pollFd = {sock, POLLIN, 0};
+    if (poll(&pollFd, 1, handOffTimeoutMs) <= 0) {
+        std::cout << "Running daemon did not hand over in time" << std::endl;
+        close(sock);
+        return handedOff;
+    }
+
+    // The fds arrive along with the first bytes of the response header
+    unix_socket_message_header response;
+    struct iovec headerVector = {&response, sizeof(response)};
+    char control[CMSG_SPACE(sizeof(int) * maxHandedOffDevices)];
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &headerVector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = recvmsg(sock, &message, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    std::vector<int> fds;
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int* headerFds = (int*)CMSG_DATA(header);
+            fds.insert(fds.end(), headerFds, headerFds + count);
+        }
+    }
+
+    std::vector<unsigned char> data;
+    bool valid = received == sizeof(response) && response.signature == socket_server::versionSignature &&
+            response.device == handOffRequest && response.length >= 0;
+    if (valid) {
+        data.resize(response.length);
+        ssize_t totalRead = 0;
+        while (totalRead < response.length) {
+            ssize_t s = read(sock, data.data() + totalRead, response.length - totalRead);
+            if (s <= 0) {
+                valid = false;
+                break;
+            }
+
+            totalRead += s;
+        }
+    }
+
+    // A 16 bit device count, then the vendor, product and signature length of each as 16 bit values followed by the
+    // signature. The fds come in the same order.
+    size_t offset = 0;
+    auto readShort = [&data, &offset, &valid]() {
+        uint16_t value = 0;
+        if (offset + sizeof(value) > data.size()) {
+            valid = false;
+            return value;
+        }
+
+        memcpy(&value, data.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return value;
+    };
+
+    uint16_t count = valid ? readShort() : 0;
+    for (uint16_t index = 0; valid && index < count && index < fds.size(); ++index) {
+        handed_off_device device;
+        device.vendorId = readShort();
+        device.productId = readShort();
+        uint16_t signatureLength = readShort();
+        if (!valid || offset + signatureLength > data.size()) {
+            valid = false;
+            break;
+        }
+
+        device.signature.assign((const char*)data.data() + offset, signatureLength);
+        offset += signatureLength;
+        device.fd = fds[index];
+        handedOff.push_back(device);
+    }
+
+    if (!valid) {
+        std::cout << "Got a malformed hand over from the running daemon" << std::endl;
+    }
+
+    for (size_t index = handedOff.size(); index < fds.size(); ++index) {
+        close(fds[index]);
+    }
+
+    // The old daemon closes the connection once it has released the tablets and given up the socket
+    char drain;
+    while (poll(&pollFd, 1, handOffTimeoutMs) > 0 && read(sock, &drain, sizeof(drain)) > 0) {
+    }
+
+    close(sock);
+    std::cout << "Took over " << handedOff.size() << " virtual devices from the running daemon" << std::endl;
+
+    return handedOff;
+}
+
+bool daemon_handoff::sendHandOff(int socket, const std::vector<handed_off_device>& devices) {
+    size_t count = std::min(devices.size(), (size_t)maxHandedOffDevices);
+
+    std::vector<unsigned char> data;
+    auto writeShort = [&data](uint16_t value) {
+        data.insert(data.end(), (unsigned char*)&value, (unsigned char*)&value + sizeof(value));
+    };
+
+    writeShort(count);
+    for (size_t index = 0; index < count; ++index) {
+        writeShort(devices[index].vendorId);
+        writeShort(devices[index].productId);
+        writeShort(devices[index].signature.size());
+        data.insert(data.end(), devices[index].signature.begin(), devices[index].signature.end());
+    }
+
+    unix_socket_message_header response;
+    memset(&response, 0, sizeof(response));
+    response.destination = message_destination::gui;
+    response.device = handOffRequest;
+    response.length = data.size();
+    response.signature = socket_server::versionSignature;
+
+    struct iovec vectors[2] = {{&response, sizeof(response)}, {data.data(), data.size()}};
+    char control[CMSG_SPACE(sizeof(int) * maxHandedOffDevices)];
+    memset(control, 0, sizeof(control));
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = vectors;
+    message.msg_iovlen = 2;
+
+    if (count > 0) {
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        int* headerFds = (int*)CMSG_DATA(header);
+        for (size_t index = 0; index < count; ++index) {
+            headerFds[index] = devices[index].fd;
+        }
+    }
+
+    ssize_t sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    if (sent < 0) {
+        std::cout << "Could not hand the virtual devices over" << std::endl;
+        return false;
+    }
+
+    // Whatever did not fit into the first message follows as plain data
+    size_t total = sizeof(response) + data.size();
+    while ((size_t)sent < total) {
+        ssize_t s;
+        if ((size_t)sent < sizeof(response)) {
+            s = send(socket, (char*)&response + sent, sizeof(response) - sent, MSG_NOSIGNAL);
+        } else {
+            s = send(socket, data.data() + (sent - sizeof(response)), total - sent, MSG_NOSIGNAL);
+        }
+
+        if (s <= 0) {
+            std::cout << "Could not hand the virtual devices over" << std::endl;
+            return false;
+        }
+
+        sent += s;
+    }
+
+    std::cout << "Handed " << count << " virtual devices over" << std::endl;
+    return true;
+}
@@ -0,0 +1,41 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_DAEMON_HANDOFF_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_DAEMON_HANDOFF_H
+
+#include <vector>
+#include "handed_off_device.h"
+
+// Passes the virtual devices of a running daemon to one replacing it over the daemon socket, the fds travel as
+// SCM_RIGHTS. The old daemon exits once they are sent, and the new one claims the tablets and takes the devices back.
+class daemon_handoff {
+public:
+    // Asks the running daemon for its devices and waits until it has let go of the tablets
+    static std::vector<handed_off_device> requestHandOff();
+    static bool sendHandOff(int socket, const std::vector<handed_off_device>& devices);
+
+    // Event handler request asking the daemon to hand its devices over and exit
+    static const short handOffRequest = 0x0006;
+private:
+    // More than any number of tablets anyone has plugged in, and well below what fits into one message
+    static const size_t maxHandedOffDevices = 64;
+    static const int handOffTimeoutMs = 10000;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_DAEMON_HANDOFF_H
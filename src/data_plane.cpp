@@ -0,0 +1,137 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <iostream>
+#include "data_plane.h"
+
+data_plane::data_plane(usb_transport* transport)
+: transport(transport), running(false), threadId(std::thread::id()) {
+    callDoneFd = eventfd(0, EFD_CLOEXEC);
+    if (callDoneFd == -1) {
+        std::cout << "Could not create eventfd errno: " << errno << std::endl;
+    }
+}
+
+data_plane::~data_plane() {
+    stop();
+    close(callDoneFd);
+}
+
+event_loop* data_plane::getEventLoop() {
+    return &eventLoop;
+}
+
+void data_plane::start() {
+    if (running) {
+        return;
+    }
+
+    running = true;
+    thread = std::thread(&data_plane::run, this);
+
+    // Anything posted from here on has to wait for the data plane thread to pick it up
+    threadId = thread.get_id();
+    eventLoop.setOwnerThread(thread.get_id());
+}
+
+void data_plane::stop() {
+    if (!running) {
+        return;
+    }
+
+    running = false;
+    // Wake the loop up so that it sees it should stop
+    eventLoop.post([]() {});
+    thread.join();
+
+    // The loop belongs to whoever uses it again
+    threadId = std::thread::id();
+    eventLoop.setOwnerThread(std::thread::id());
+}
+
+bool data_plane::isRunning() {
+    return running;
+}
+
+bool data_plane::isDataPlaneThread() {
+    return threadId.load() == std::this_thread::get_id();
+}
+
+void data_plane::post(std::function<void()> task) {
+    eventLoop.post(task);
+}
+
+void data_plane::call(const std::function<void()>& task) {
+    if (!running || isDataPlaneThread()) {
+        task();
+        return;
+    }
+
+    int doneFd = callDoneFd;
+    eventLoop.post([&task, doneFd]() {
+        task();
+
+        uint64_t counter = 1;
+        if (write(doneFd, &counter, sizeof(counter)) != sizeof(counter)) {
+            std::cout << "Could not signal a finished data plane call errno: " << errno << std::endl;
+        }
+    });
+
+    // Only the control thread waits in here, the data plane never blocks on it
+    uint64_t counter;
+    while (read(callDoneFd, &counter, sizeof(counter)) == -1 && errno == EINTR) {
+    }
+}
+
+void data_plane::setRealtimeSettings(const realtime_settings& settings) {
+    // Until the thread runs there is nothing to apply them to
+    if (!running) {
+        realtimeSettings = settings;
+        return;
+    }
+
+    call([this, &settings]() {
+        realtimeSettings = settings;
+        realtimeStatus = realtimeSettings.apply(realtimeStatus);
+    });
+}
+
+realtime_status data_plane::getRealtimeStatus() {
+    realtime_status status;
+    call([this, &status]() {
+        status = realtimeStatus;
+    });
+
+    return status;
+}
+
+void data_plane::run() {
+    threadId = std::this_thread::get_id();
+    std::cout << "Data plane started" << std::endl;
+
+    realtimeStatus = realtimeSettings.apply(realtimeStatus);
+
+    while (running) {
+        eventLoop.runOnce(transport->getNextTimeout());
+    }
+
+    std::cout << "Data plane stopped" << std::endl;
+}
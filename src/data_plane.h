@@ -0,0 +1,71 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_DATA_PLANE_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_DATA_PLANE_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include "event_loop.h"
+#include "usb_transport.h"
+#include "realtime_settings.h"
+
+// The thread that handles USB events, decodes reports and writes out the input events, with an event loop of its own.
+// Everything on it is owned by that thread: transfers, transfer queues, device contexts and the mappings the decoders
+// use. The control thread hands work that touches any of it over through call or post instead of locking, so that
+// nothing it does can hold up a report.
+class data_plane {
+public:
+    data_plane(usb_transport* transport);
+    ~data_plane();
+
+    event_loop* getEventLoop();
+
+    void start();
+    void stop();
+    bool isRunning();
+    bool isDataPlaneThread();
+
+    // Runs the task on the data plane thread without waiting for it. Runs it right away while the data plane isn't
+    // running or when called from the data plane thread itself. Only the control thread may hand over tasks.
+    void post(std::function<void()> task);
+    // Same as post but waits until the task has run
+    void call(const std::function<void()>& task);
+
+    // Applied to the data plane thread as soon as it runs
+    void setRealtimeSettings(const realtime_settings& settings);
+    realtime_status getRealtimeStatus();
+private:
+    void run();
+
+    usb_transport* transport;
+    event_loop eventLoop;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<std::thread::id> threadId;
+    // Signalled by the data plane once a task handed over through call has run
+    int callDoneFd;
+
+    realtime_settings realtimeSettings;
+    realtime_status realtimeStatus;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_DATA_PLANE_H
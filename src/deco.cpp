@@ -17,11 +17,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "deco.h"
+#include "xp_pen_capabilities.h"
 
 deco::deco() {
     for (int currentAssignedButton = BTN_0; currentAssignedButton < BTN_8; ++currentAssignedButton) {
         padButtonAliases.push_back(currentAssignedButton);
     }
+
+    setReportLength(0x02, 12);
 }
 
 std::string deco::getProductName(int productId) {
@@ -61,6 +64,10 @@ int deco::sendInitKeyOnInterface() {
     return 0x02;
 }
 
+bool deco::readCapabilities(libusb_device_handle* handle, device_capabilities& capabilities) {
+    return readXpPenCapabilities(transport, handle, capabilities);
+}
+
 bool deco::attachToInterfaceId(int interfaceId) {
     switch (interfaceId){
         case 2:
@@ -71,21 +78,22 @@ bool deco::attachToInterfaceId(int interfaceId) {
     }
 }
 
-bool deco::handleTransferData(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+bool deco::handleTransferData(device_context* context, unsigned char *data, size_t dataLen) {
     switch (data[0]) {
         case 0x02:
-            handleDigitizerEvent(handle, data, dataLen);
-            handleUnifiedFrameEvent(handle, data, dataLen);
+            handleDigitizerEvent(context, data, dataLen);
+            handleUnifiedFrameEvent(context, data, dataLen);
             break;
 
+        // Nothing we know how to decode
         default:
-            break;
+            return false;
     }
 
     return true;
 }
 
-void deco::handleDigitizerEvent(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void deco::handleDigitizerEvent(device_context* context, unsigned char *data, size_t dataLen) {
     if (data[1] < 0xb0) {
         // Extract the X and Y position
         int penX = (data[3] << 8) + data[2];
@@ -97,10 +105,10 @@ void deco::handleDigitizerEvent(libusb_device_handle *handle, unsigned char *dat
             // Grab the pressure amount
             pressure = (data[7] << 8) + data[6];
 
-            uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 1);
-            uinput_send(uinputPens[handle], EV_ABS, ABS_PRESSURE, pressure);
+            uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 1);
+            uinput_send(context->penEvents, EV_ABS, ABS_PRESSURE, pressure);
         } else {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 0);
         }
 
         // Grab the tilt values
@@ -109,26 +117,26 @@ void deco::handleDigitizerEvent(libusb_device_handle *handle, unsigned char *dat
 
         // Check to see if the stylus buttons are being pressed
         if (0x02 & data[1]) {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 1);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 1);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
         } else if (0x04 & data[1]) {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 1);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 1);
         } else {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
         }
 
-        uinput_send(uinputPens[handle], EV_ABS, ABS_X, penX);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_Y, penY);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_TILT_X, tiltx);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_TILT_Y, tilty);
+        uinput_send(context->penEvents, EV_ABS, ABS_X, penX);
+        uinput_send(context->penEvents, EV_ABS, ABS_Y, penY);
+        uinput_send(context->penEvents, EV_ABS, ABS_TILT_X, tiltx);
+        uinput_send(context->penEvents, EV_ABS, ABS_TILT_Y, tilty);
 
-        uinput_send(uinputPens[handle], EV_SYN, SYN_REPORT, 1);
+        uinput_send(context->penEvents, EV_SYN, SYN_REPORT, 1);
     }
 }
 
-void deco::handleUnifiedFrameEvent(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void deco::handleUnifiedFrameEvent(device_context* context, unsigned char *data, size_t dataLen) {
     if (data[1] >= 0xf0) {
         long button = data[2];
         // Only 8 buttons on this device
@@ -145,20 +153,20 @@ void deco::handleUnifiedFrameEvent(libusb_device_handle *handle, unsigned char *
         if (button != 0) {
             auto padMap = padMapping.getPadMap(padButtonAliases[position - 1]);
             for (auto pmap : padMap) {
-                uinput_send(uinputPads[handle], pmap.event_type, pmap.event_value, 1);
+                uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 1);
             }
-            lastPressedButton[handle] = position;
+            context->lastPressedButton = position;
         }  else {
-            if (lastPressedButton.find(handle) != lastPressedButton.end() && lastPressedButton[handle] > 0) {
-                auto padMap = padMapping.getPadMap(padButtonAliases[lastPressedButton[handle] - 1]);
+            if (context->lastPressedButton > 0) {
+                auto padMap = padMapping.getPadMap(padButtonAliases[context->lastPressedButton - 1]);
                 for (auto pmap : padMap) {
-                    uinput_send(uinputPads[handle], pmap.event_type, pmap.event_value, 0);
+                    uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 0);
                 }
-                lastPressedButton[handle] = -1;
+                context->lastPressedButton = -1;
             }
         }
 
         // This should always send the SYN no matter what
-        uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+        uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
     }
 }
@@ -30,12 +30,13 @@ public:
     void setConfig(nlohmann::json config);
     int sendInitKeyOnInterface();
     bool attachToInterfaceId(int interfaceId);
+    bool readCapabilities(libusb_device_handle* handle, device_capabilities& capabilities);
     virtual bool attachDevice(libusb_device_handle *handle, int interfaceId) = 0;
-    bool handleTransferData(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
+    bool handleTransferData(device_context* context, unsigned char* data, size_t dataLen);
 
 protected:
-    void handleDigitizerEvent(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
-    void handleUnifiedFrameEvent(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
+    void handleDigitizerEvent(device_context* context, unsigned char* data, size_t dataLen);
+    void handleUnifiedFrameEvent(device_context* context, unsigned char* data, size_t dataLen);
 };
 
 
@@ -19,11 +19,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <unistd.h>
 #include "deco_pro.h"
+#include "xp_pen_capabilities.h"
 
 deco_pro::deco_pro() {
     for (int currentAssignedButton = BTN_0; currentAssignedButton < BTN_8; ++currentAssignedButton) {
         padButtonAliases.push_back(currentAssignedButton);
     }
+
+    setReportLength(0x02, 12);
 }
 
 std::string deco_pro::getProductName(int productId) {
@@ -68,6 +71,10 @@ int deco_pro::sendInitKeyOnInterface() {
     return 0x02;
 }
 
+bool deco_pro::readCapabilities(libusb_device_handle* handle, device_capabilities& capabilities) {
+    return readXpPenCapabilities(transport, handle, capabilities);
+}
+
 bool deco_pro::attachToInterfaceId(int interfaceId) {
     switch (interfaceId){
         case 2:
@@ -80,25 +87,26 @@ bool deco_pro::attachToInterfaceId(int interfaceId) {
     }
 }
 
-bool deco_pro::handleTransferData(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+bool deco_pro::handleTransferData(device_context* context, unsigned char *data, size_t dataLen) {
     switch (data[0]) {
         case 0x02:
-            handleDigitizerEvent(handle, data, dataLen);
-            handleUnifiedFrameEvent(handle, data, dataLen);
+            handleDigitizerEvent(context, data, dataLen);
+            handleUnifiedFrameEvent(context, data, dataLen);
             break;
 
         case 0x01:
-            handleNonUnifiedFrameEvent(handle, data, dataLen);
+            handleNonUnifiedFrameEvent(context, data, dataLen);
             break;
 
+        // Nothing we know how to decode
         default:
-            break;
+            return false;
     }
 
     return true;
 }
 
-void deco_pro::handleDigitizerEvent(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void deco_pro::handleDigitizerEvent(device_context* context, unsigned char *data, size_t dataLen) {
     if (data[1] < 0xb0) {
         // Extract the X and Y position
         int penX = (data[3] << 8) + data[2];
@@ -110,10 +118,10 @@ void deco_pro::handleDigitizerEvent(libusb_device_handle *handle, unsigned char
             // Grab the pressure amount
             pressure = (data[7] << 8) + data[6];
 
-            uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 1);
-            uinput_send(uinputPens[handle], EV_ABS, ABS_PRESSURE, pressure);
+            uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 1);
+            uinput_send(context->penEvents, EV_ABS, ABS_PRESSURE, pressure);
         } else {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 0);
         }
 
         // Grab the tilt values
@@ -122,26 +130,26 @@ void deco_pro::handleDigitizerEvent(libusb_device_handle *handle, unsigned char
 
         // Check to see if the stylus buttons are being pressed
         if (0x02 & data[1]) {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 1);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 1);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
         } else if (0x04 & data[1]) {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 1);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 1);
         } else {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
         }
 
-        uinput_send(uinputPens[handle], EV_ABS, ABS_X, penX);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_Y, penY);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_TILT_X, tiltx);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_TILT_Y, tilty);
+        uinput_send(context->penEvents, EV_ABS, ABS_X, penX);
+        uinput_send(context->penEvents, EV_ABS, ABS_Y, penY);
+        uinput_send(context->penEvents, EV_ABS, ABS_TILT_X, tiltx);
+        uinput_send(context->penEvents, EV_ABS, ABS_TILT_Y, tilty);
 
-        uinput_send(uinputPens[handle], EV_SYN, SYN_REPORT, 1);
+        uinput_send(context->penEvents, EV_SYN, SYN_REPORT, 1);
     }
 }
 
-void deco_pro::handleUnifiedFrameEvent(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void deco_pro::handleUnifiedFrameEvent(device_context* context, unsigned char *data, size_t dataLen) {
     if (data[1] >= 0xf0) {
         long button = data[2];
         // Only 8 buttons on this device
@@ -168,25 +176,25 @@ void deco_pro::handleUnifiedFrameEvent(libusb_device_handle *handle, unsigned ch
 
         if (dialValue != 0) {
             bool send_reset = false;
-            auto dialMap = dialMapping.getDialMap(EV_REL, REL_WHEEL, dialValue);
+            auto dialMap = dialMapping.getDialMap(REL_WHEEL, dialValue);
             for (auto dmap: dialMap) {
-                uinput_send(uinputPads[handle], dmap.event_type, dmap.event_value, dmap.event_data);
+                uinput_send(context->padEvents, dmap.event_type, dmap.event_value, dmap.event_data);
                 if (dmap.event_type == EV_KEY) {
                     send_reset = true;
                 }
             }
 
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
 
             if (send_reset) {
                 for (auto dmap: dialMap) {
                     // We have to handle key presses manually here because this device does not send reset events
                     if (dmap.event_type == EV_KEY) {
-                        uinput_send(uinputPads[handle], dmap.event_type, dmap.event_value, 0);
+                        uinput_send(context->padEvents, dmap.event_type, dmap.event_value, 0);
                     }
                 }
             }
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
 
             shouldSyn = false;
             dialEvent = true;
@@ -194,25 +202,25 @@ void deco_pro::handleUnifiedFrameEvent(libusb_device_handle *handle, unsigned ch
 
         if (touchValue != 0) {
             bool send_reset = false;
-            auto touchMap = dialMapping.getDialMap(EV_REL, REL_HWHEEL, touchValue);
+            auto touchMap = dialMapping.getDialMap(REL_HWHEEL, touchValue);
             for (auto dmap: touchMap) {
-                uinput_send(uinputPads[handle], dmap.event_type, dmap.event_value, dmap.event_data);
+                uinput_send(context->padEvents, dmap.event_type, dmap.event_value, dmap.event_data);
                 if (dmap.event_type == EV_KEY) {
                     send_reset = true;
                 }
             }
 
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
 
             if (send_reset) {
                 for (auto dmap: touchMap) {
                     // We have to handle key presses manually here because this device does not send reset events
                     if (dmap.event_type == EV_KEY) {
-                        uinput_send(uinputPads[handle], dmap.event_type, dmap.event_value, 0);
+                        uinput_send(context->padEvents, dmap.event_type, dmap.event_value, 0);
                     }
                 }
             }
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
 
             shouldSyn = false;
             dialEvent = true;
@@ -221,26 +229,26 @@ void deco_pro::handleUnifiedFrameEvent(libusb_device_handle *handle, unsigned ch
         if (button != 0) {
             auto padMap = padMapping.getPadMap(padButtonAliases[position - 1]);
             for (auto pmap : padMap) {
-                uinput_send(uinputPads[handle], pmap.event_type, pmap.event_value, 1);
+                uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 1);
             }
-            lastPressedButton[handle] = position;
+            context->lastPressedButton = position;
         } else if (!dialEvent) {
-            if (lastPressedButton.find(handle) != lastPressedButton.end() && lastPressedButton[handle] > 0) {
-                auto padMap = padMapping.getPadMap(padButtonAliases[lastPressedButton[handle] - 1]);
+            if (context->lastPressedButton > 0) {
+                auto padMap = padMapping.getPadMap(padButtonAliases[context->lastPressedButton - 1]);
                 for (auto pmap : padMap) {
-                    uinput_send(uinputPads[handle], pmap.event_type, pmap.event_value, 0);
+                    uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 0);
                 }
-                lastPressedButton[handle] = -1;
+                context->lastPressedButton = -1;
             }
         }
 
         if (shouldSyn) {
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
         }
     }
 }
 
-void deco_pro::handleNonUnifiedFrameEvent(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void deco_pro::handleNonUnifiedFrameEvent(device_context* context, unsigned char *data, size_t dataLen) {
     long touchX = data[2] - data[3];
     long touchY = data[4] - data[5];
 
@@ -249,22 +257,22 @@ void deco_pro::handleNonUnifiedFrameEvent(libusb_device_handle *handle, unsigned
     char rollerValue = data[6];
 
     if (touchX != 0 || touchY != 0) {
-        uinput_send(uinputPointers[handle], EV_REL, REL_X, touchX);
-        uinput_send(uinputPointers[handle], EV_REL, REL_Y, touchY);
-        uinput_send(uinputPointers[handle], EV_SYN, SYN_REPORT, 1);
+        uinput_send(context->pointerEvents, EV_REL, REL_X, touchX);
+        uinput_send(context->pointerEvents, EV_REL, REL_Y, touchY);
+        uinput_send(context->pointerEvents, EV_SYN, SYN_REPORT, 1);
     }
 
     if (tapped) {
-        uinput_send(uinputPointers[handle], EV_KEY, BTN_LEFT, 1);
-        wasTapping = true;
-    } else if (wasTapping) {
-        uinput_send(uinputPointers[handle], EV_KEY, BTN_LEFT, 0);
-        wasTapping = false;
+        uinput_send(context->pointerEvents, EV_KEY, BTN_LEFT, 1);
+        context->wasTapping = true;
+    } else if (context->wasTapping) {
+        uinput_send(context->pointerEvents, EV_KEY, BTN_LEFT, 0);
+        context->wasTapping = false;
     }
 
     if (rollerValue != 0) {
-        uinput_send(uinputPointers[handle], EV_REL, REL_WHEEL, rollerValue);
+        uinput_send(context->pointerEvents, EV_REL, REL_WHEEL, rollerValue);
     }
 
-    uinput_send(uinputPointers[handle], EV_SYN, SYN_REPORT, 1);
+    uinput_send(context->pointerEvents, EV_SYN, SYN_REPORT, 1);
 }
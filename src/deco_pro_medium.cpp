@@ -33,17 +33,16 @@ std::string deco_pro_medium::getProductName(int productId) {
 }
 
 bool deco_pro_medium::attachDevice(libusb_device_handle *handle, int interfaceId) {
-    unsigned char* buf = new unsigned char[12];
-
     // We need to get a few more bits of information
-    if (libusb_get_string_descriptor(handle, 0x64, 0x0409, buf, 12) != 12) {
+    device_capabilities capabilities;
+    if (!getCapabilities(handle, capabilities)) {
         std::cout << "Could not get descriptor" << std::endl;
         return false;
     }
 
-    int maxWidth = (buf[3] << 8) + buf[2];
-    int maxHeight = (buf[5] << 8) + buf[4];
-    int maxPressure = (buf[9] << 8) + buf[8];
+    int maxWidth = capabilities.maxWidth;
+    int maxHeight = capabilities.maxHeight;
+    int maxPressure = capabilities.maxPressure;
 
     unsigned short vendorId = 0x28bd;
     unsigned short productId = 0xf904;
@@ -74,8 +73,8 @@ bool deco_pro_medium::attachDevice(libusb_device_handle *handle, int interfaceId
                 {"XP-Pen Deco Pro M Pad"},
         };
 
-        uinputPens[handle] = create_pen(penArgs);
-        uinputPads[handle] = create_pad(padArgs);
+        getDeviceContext(handle)->penEvents.setDevice(create_pen(penArgs));
+        getDeviceContext(handle)->padEvents.setDevice(create_pad(padArgs));
     }
 
     if (interfaceId == 0) {
@@ -87,7 +86,7 @@ bool deco_pro_medium::attachDevice(libusb_device_handle *handle, int interfaceId
                 {"XP-Pen Deco Pro M Pointer"},
         };
 
-        uinputPointers[handle] = create_pointer(pointerArgs);
+        getDeviceContext(handle)->pointerEvents.setDevice(create_pointer(pointerArgs));
     }
 
     return true;
@@ -0,0 +1,66 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_DEVICE_CONTEXT_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_DEVICE_CONTEXT_H
+
+#include <cstdint>
+#include <libusb-1.0/libusb.h>
+#include "input_event_batch.h"
+#include "latency_histogram.h"
+
+// Where a report spends its time on the way from the bus to uinput
+enum latency_stage {
+    // From transfer completion until decoding starts
+    transferLatency = 0,
+    // Decoding, including the pad and dial mapping lookups
+    decodeLatency,
+    // Writing the batched events out
+    writeLatency,
+    // From transfer completion until the last event was written
+    totalLatency,
+    latencyStageCount
+};
+
+// Everything the decoders need while handling a report from one attached device. A pointer to it travels with
+// every transfer so that the hot path never has to look anything up by device handle.
+struct device_context {
+public:
+    libusb_device_handle* handle;
+    int productId = 0;
+
+    // Each batch also knows its output sink and the virtual device it writes to
+    input_event_batch penEvents;
+    input_event_batch padEvents;
+    input_event_batch pointerEvents;
+
+    // CLOCK_MONOTONIC time in nanoseconds at which the report being handled completed on the bus, and how long it took
+    // from there until its events were written out
+    uint64_t reportCompletedAt = 0;
+    uint64_t lastWriteDelay = 0;
+    uint64_t totalWriteDelay = 0;
+    unsigned long reportsWritten = 0;
+
+    latency_histogram latency[latencyStageCount];
+
+    long lastPressedButton = -1;
+    bool wasTapping = false;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_DEVICE_CONTEXT_H
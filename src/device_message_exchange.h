@@ -0,0 +1,42 @@
+/*
+userspace-tablet-driver-daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_DEVICE_MESSAGE_EXCHANGE_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_DEVICE_MESSAGE_EXCHANGE_H
+
+#include <libusb-1.0/libusb.h>
+#include "message_pool.h"
+
+class vendor_handler;
+
+// A message from the GUI on its way to one device. It belongs to the data plane from when it is sent until the
+// response came in or was given up on.
+struct device_message_exchange {
+public:
+    vendor_handler* vendorHandler;
+    libusb_device_handle* handle;
+    unsigned char responseEndpoint;
+    // Holds what goes out to the device until it is sent
+    pooled_message request;
+    // Handed to the GUI once filled in, null when no response is expected
+    pooled_message response;
+    // Set while the response is expected among the reports of a streaming endpoint
+    int timeoutTimer;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_DEVICE_MESSAGE_EXCHANGE_H
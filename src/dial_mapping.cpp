@@ -16,6 +16,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <linux/input.h>
 #include "dial_mapping.h"
 #include <iostream>
 
@@ -23,23 +24,25 @@ dial_mapping::dial_mapping() {
 
 }
 
-std::vector<aliased_input_event> dial_mapping::getDialMap(int eventCode, int value, int data) {
-    auto record = eventDialMap.find(value);
-    if (record != eventDialMap.end()) {
-        std::string strvalue = std::to_string(data);
-        auto value = record->second.find(strvalue);
-        if (value != record->second.end()) {
-            return value->second;
-        }
+size_t dial_mapping::spanIndex(int axis, int direction) {
+    return axis * 2 + (direction > 0 ? 1 : 0);
+}
+
+aliased_input_event_span dial_mapping::getDialMap(int value, int data) const {
+    if (value < 0 || value > REL_MAX || (data != -1 && data != 1)) {
+        return aliased_input_event_span { nullptr, nullptr };
     }
 
-    std::vector<aliased_input_event> temp;
-    aliased_input_event tempEvent {
-        eventCode, value, data
-    };
-    temp.push_back(tempEvent);
+    size_t index = spanIndex(value, data);
+    if (index >= compiledSpans.size()) {
+        return aliased_input_event_span { nullptr, nullptr };
+    }
 
-    return temp;
+    const span_offsets& offsets = compiledSpans[index];
+    return aliased_input_event_span {
+        compiledEvents.data() + offsets.first,
+        compiledEvents.data() + offsets.last
+    };
 }
 
 void dial_mapping::setDialMap(int eventCode, std::string value, const std::vector<aliased_input_event> &events) {
@@ -49,3 +52,33 @@ void dial_mapping::setDialMap(int eventCode, std::string value, const std::vecto
 
     eventDialMap[eventCode][value] = events;
 }
+
+void dial_mapping::compile() {
+    compiledEvents.clear();
+    compiledSpans.assign(spanIndex(REL_MAX, 1) + 1, span_offsets { 0, 0 });
+
+    for (int axis = 0; axis <= REL_MAX; ++axis) {
+        for (int direction : {-1, 1}) {
+            span_offsets& offsets = compiledSpans[spanIndex(axis, direction)];
+            offsets.first = compiledEvents.size();
+
+            bool mapped = false;
+            auto axisRecord = eventDialMap.find(axis);
+            if (axisRecord != eventDialMap.end()) {
+                // The config keys the direction as a string, which we only want to build once
+                auto directionRecord = axisRecord->second.find(std::to_string(direction));
+                if (directionRecord != axisRecord->second.end()) {
+                    compiledEvents.insert(compiledEvents.end(), directionRecord->second.begin(),
+                                          directionRecord->second.end());
+                    mapped = true;
+                }
+            }
+
+            if (!mapped) {
+                compiledEvents.push_back(aliased_input_event { EV_REL, axis, direction });
+            }
+
+            offsets.last = compiledEvents.size();
+        }
+    }
+}
@@ -28,10 +28,24 @@ class dial_mapping {
 public:
     dial_mapping();
 
-    std::vector<aliased_input_event> getDialMap(int eventCode, int value, int data);
+    // Looks up the events for turning the dial on axis value by data, which the decoders only ever report as -1 or 1
+    aliased_input_event_span getDialMap(int value, int data) const;
     void setDialMap(int eventCode, std::string value, const std::vector<aliased_input_event> &events);
+
+    // Flattens the mappings into a table indexed by axis and direction. Unmapped dials send the relative event.
+    void compile();
 private:
+    struct span_offsets {
+        unsigned int first;
+        unsigned int last;
+    };
+
+    static size_t spanIndex(int axis, int direction);
+
     std::map<int, std::map<std::string, std::vector<aliased_input_event> > > eventDialMap;
+
+    std::vector<aliased_input_event> compiledEvents;
+    std::vector<span_offsets> compiledSpans;
 };
 
 
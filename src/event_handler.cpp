@@ -28,6 +28,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 #include <csignal>
+#include <unistd.h>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include "event_handler.h"
@@ -35,22 +37,43 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "vendor_handler.h"
 #include "usb_devices.h"
 #include "huion_handler.h"
+#include "libusb_transport.h"
+#include "daemon_handoff.h"
 
 bool event_handler::running = true;
 event_handler* event_handler::instance = nullptr;
 
-event_handler::event_handler() {
+event_handler::event_handler(const std::vector<handed_off_device>& handedOff) {
     if (instance != nullptr) {
         throw instance;
     }
 
     instance = this;
-    devices = new usb_devices();
+    transport = new libusb_transport();
+    devices = new usb_devices(transport);
+    dataPlane = new data_plane(transport);
+    // Kept next to driver.cfg
+    capabilityCache = new capability_cache(getConfigLocation() + "/capabilities.json");
+    // Events that make it through are handled straight away, while the debouncer still holds the device
+    hotplugDebouncer = new hotplug_debouncer(&eventLoop, transport, [this](const hotplug_event& event) {
+        hotplugEvents.push_back(event);
+        handleHotplugEvents();
+    });
 
     loadConfiguration();
     addHandler(new xp_pen_handler());
     addHandler(new huion_handler());
     saveConfiguration();
+
+    for (auto device : handedOff) {
+        auto handler = vendorHandlers.find(device.vendorId);
+        if (handler == vendorHandlers.end()) {
+            close(device.fd);
+            continue;
+        }
+
+        handler->second->adoptDevice(device, handOffGracePeriodMs);
+    }
 }
 
 event_handler::~event_handler() {
@@ -59,10 +82,14 @@ event_handler::~event_handler() {
         delete handler.second;
     }
 
+    delete capabilityCache;
+    delete hotplugDebouncer;
+    delete dataPlane;
     delete devices;
+    delete transport;
 }
 
-void event_handler::sigHandler(int signo) {
+void event_handler::handleSignal(int signo) {
     if (signo == SIGINT) {
         std::cout << "Caught SIGINT" << std::endl;
         running = false;
@@ -75,7 +102,7 @@ void event_handler::sigHandler(int signo) {
 
     if (signo == SIGHUP) {
         std::cout << "Reloading configuration" << std::endl;
-        instance->loadConfiguration();
+        loadConfiguration();
     }
 }
 
@@ -108,6 +135,56 @@ void event_handler::loadConfiguration() {
         driverConfigJson["deviceConfigurations"] = nlohmann::json({});
     }
 
+    if (!driverConfigJson.contains("daemonSettings") || driverConfigJson["daemonSettings"] == nullptr) {
+        driverConfigJson["daemonSettings"] = nlohmann::json({});
+    }
+
+    if (!driverConfigJson["daemonSettings"].contains("transferQueueDepth")) {
+        driverConfigJson["daemonSettings"]["transferQueueDepth"] = 4;
+    }
+
+    // Tablets connected at startup are claimed on this many threads at once
+    if (!driverConfigJson["daemonSettings"].contains("probeWorkers")) {
+        driverConfigJson["daemonSettings"]["probeWorkers"] = 4;
+    }
+
+    devices->setProbeWorkers(driverConfigJson["daemonSettings"]["probeWorkers"]);
+
+    // Virtual devices of a tablet that disconnects are kept this long in case it comes right back
+    if (!driverConfigJson["daemonSettings"].contains("disconnectGracePeriodMs")) {
+        driverConfigJson["daemonSettings"]["disconnectGracePeriodMs"] = 1000;
+    }
+
+    // Hotplug events of a device are only acted on once it has settled for this long
+    if (!driverConfigJson["daemonSettings"].contains("hotplugDebounceMs")) {
+        driverConfigJson["daemonSettings"]["hotplugDebounceMs"] = 100;
+    }
+
+    hotplugDebouncer->setWindow(driverConfigJson["daemonSettings"]["hotplugDebounceMs"]);
+
+    // Path of a file to record every incoming report to, left empty to not capture anything
+    if (!driverConfigJson["daemonSettings"].contains("captureFile")) {
+        driverConfigJson["daemonSettings"]["captureFile"] = "";
+    }
+
+    // Scheduling, CPU affinity and memory locking of the data plane thread
+    if (!driverConfigJson["daemonSettings"].contains("realtime") ||
+        !driverConfigJson["daemonSettings"]["realtime"].is_object()) {
+        driverConfigJson["daemonSettings"]["realtime"] = realtime_settings::defaultJson();
+    }
+
+    dataPlane->setRealtimeSettings(realtime_settings::fromJson(driverConfigJson["daemonSettings"]["realtime"]));
+
+    // Reports get captured on the data plane
+    std::string captureFile = driverConfigJson["daemonSettings"]["captureFile"];
+    dataPlane->call([this, &captureFile]() {
+        if (captureFile.empty()) {
+            reportCapture.close();
+        } else if (captureFile != reportCapture.getPath()) {
+            reportCapture.open(captureFile);
+        }
+    });
+
     // Upgrade the previous version of the config file if it exists
     if (driverConfigJson.contains("XP-Pen")) {
         driverConfigJson["deviceConfigurations"]["10429"] = nlohmann::json(driverConfigJson["XP-Pen"]);
@@ -122,7 +199,12 @@ void event_handler::loadConfiguration() {
             driverConfigJson["deviceConfigurations"][vendorIdString] = nlohmann::json({});
         }
 
-        handler.second->setConfig(driverConfigJson["deviceConfigurations"][vendorIdString]);
+        // The decoders read their mappings on the data plane
+        dataPlane->call([this, &handler, &vendorIdString]() {
+            handler.second->setConfig(driverConfigJson["deviceConfigurations"][vendorIdString]);
+        });
+        handler.second->setTransferQueueDepth(driverConfigJson["daemonSettings"]["transferQueueDepth"]);
+        handler.second->setDisconnectGracePeriod(driverConfigJson["daemonSettings"]["disconnectGracePeriodMs"]);
     }
 }
 
@@ -152,13 +234,26 @@ void event_handler::addHandler(vendor_handler *handler) {
 
     handler->setConfig(driverConfigJson["deviceConfigurations"][vendorIdString]);
     handler->setMessageQueue(&messageQueue);
+    handler->setTransport(transport);
+    handler->setCapabilityCache(capabilityCache);
+    handler->setDataPlane(dataPlane);
+    handler->setEventLoop(&eventLoop);
+    handler->setReportCapture(&reportCapture);
+    handler->setTransferQueueDepth(driverConfigJson["daemonSettings"]["transferQueueDepth"]);
+    handler->setDisconnectGracePeriod(driverConfigJson["daemonSettings"]["disconnectGracePeriodMs"]);
 }
 
 int event_handler::hotplugCallback(struct libusb_context* context, struct libusb_device* device,
                     libusb_hotplug_event event, void* user_data) {
     std::cout << "Got hotplug event" << std::endl;
     event_handler* eventHandler = (event_handler*)user_data;
-    eventHandler->hotplugEvents.push_back({event, device});
+
+    // Usually called on the data plane, the control thread picks the event up from its own loop. The device is only
+    // guaranteed to be around during this callback, so it is held on to until the event is dealt with.
+    eventHandler->transport->refDevice(device);
+    eventHandler->eventLoop.post([eventHandler, event, device]() {
+        eventHandler->hotplugDebouncer->push({event, device});
+    });
     return 0;
 }
 
@@ -169,36 +264,31 @@ int event_handler::run() {
     for (auto vendorProducts : supportedDevices) {
         for (auto product : vendorProducts.second) {
             libusb_hotplug_callback_handle callbackHandle;
-            if (libusb_hotplug_register_callback(devices->getContext(),
-                                                 static_cast<libusb_hotplug_event>(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
-                                                                                   LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
-                                                 static_cast<libusb_hotplug_flag>(0), vendorProducts.first, product, LIBUSB_HOTPLUG_MATCH_ANY,
-                                                 hotplugCallback, this, &callbackHandle) == LIBUSB_SUCCESS) {
+            if (transport->registerHotplugCallback(vendorProducts.first, product, hotplugCallback, this,
+                                                   &callbackHandle) == LIBUSB_SUCCESS) {
                 callbackHandles.push_back(callbackHandle);
             }
         }
     }
 
-    signal(SIGINT, sigHandler);
-    signal(SIGTERM, sigHandler);
-    signal(SIGHUP, sigHandler);
+    eventLoop.watchSignals({SIGINT, SIGTERM, SIGHUP}, [this](int signo) {
+        handleSignal(signo);
+    });
+    messageQueue.addConsumer(message_destination::eventHandler, 0x0000);
+    socketServer.registerEventSources(&eventLoop, &messageQueue);
+
+    // USB events, decoding and output run on the data plane from here on while this thread takes care of hotplug,
+    // configuration and the sockets. The signals are blocked by now so the data plane inherits that.
+    devices->registerEventSources(dataPlane->getEventLoop());
+    eventLoop.setOwnerThread(std::this_thread::get_id());
+    dataPlane->start();
 
     while (running) {
-        devices->handleEvents();
-        // Handle all new device attach events
-        while (hotplugEvents.size() > 0) {
-            auto event = hotplugEvents.front();
-            if (event.event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
-                devices->handleDeviceAttach(vendorHandlers, event.device);
-            } else if (event.event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
-                devices->handleDeviceDetach(vendorHandlers, event.device);
-            }
-            hotplugEvents.pop_front();
-        }
+        // Sleep until a hotplug event, a socket, a signal or a timer has something for us
+        eventLoop.runOnce(-1);
 
-        // Handle any new incoming socket communications
-        socketServer.handleConnections();
-        socketServer.handleMessages(&messageQueue);
+        // Handle all new device attach events
+        handleHotplugEvents();
 
         // Have all the vendor handlers process messages
         for (auto handler: vendorHandlers) {
@@ -215,16 +305,50 @@ int event_handler::run() {
     std::cout << "Shutting down" << std::endl;
 
     for (auto callbackHandle : callbackHandles) {
-        libusb_hotplug_deregister_callback(NULL, callbackHandle);
+        transport->deregisterHotplugCallback(callbackHandle);
+    }
+
+    dataPlane->stop();
+
+    if (handOffSocket != -1) {
+        handOff();
     }
 
     return 0;
 }
 
+void event_handler::handOff() {
+    // Nothing streams anymore, so whatever the pens were doing is final
+    std::vector<handed_off_device> handedOff;
+    for (auto handler : vendorHandlers) {
+        auto devices = handler.second->handOffDevices();
+        handedOff.insert(handedOff.end(), devices.begin(), devices.end());
+    }
+
+    daemon_handoff::sendHandOff(handOffSocket, handedOff);
+
+    // The new daemon holds its own copies now. The connection stays open until the tablets are released on exit.
+    for (auto device : handedOff) {
+        close(device.fd);
+    }
+}
+
+void event_handler::handleHotplugEvents() {
+    while (hotplugEvents.size() > 0) {
+        auto event = hotplugEvents.front();
+        if (event.event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+            devices->handleDeviceAttach(vendorHandlers, event.device);
+        } else if (event.event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+            devices->handleDeviceDetach(vendorHandlers, event.device);
+        }
+        hotplugEvents.pop_front();
+    }
+}
+
 void event_handler::handleMessages() {
-    auto messages = messageQueue.getMessagesFor(message_destination::eventHandler, 0x0000);
-    for (auto message : messages) {
-        auto response = new unix_socket_message;
+    messageQueue.getMessagesFor(message_destination::eventHandler, 0x0000, receivedMessages);
+    for (auto& message : receivedMessages) {
+        pooled_message response = messageQueue.newMessage(responseBufferSize);
         response->destination = message_destination::gui;
         response->vendor = message->vendor;
         response->device = message->device;
@@ -238,8 +362,7 @@ void event_handler::handleMessages() {
             // Get connected devices
             case 0x0001:
                 std::cout << "Handling get connected devices request" << std::endl;
-                response->data = new unsigned char[4096];
-                memset(response->data, 0, 4096);
+                memset(response->data, 0, responseBufferSize);
                 writePointer = response->data;
                 for (auto handler: vendorHandlers) {
                     auto devices = handler.second->getConnectedDevices();
@@ -252,7 +375,7 @@ void event_handler::handleMessages() {
                 }
                 response->length = writePointer - response->data;
 
-                messageQueue.addMessage(response);
+                messageQueue.addMessage(std::move(response));
 
                 break;
 
@@ -262,8 +385,216 @@ void event_handler::handleMessages() {
 
                 break;
 
+            // Get transfer queue statistics
+            case 0x0003:
+                std::cout << "Handling get transfer queue statistics request" << std::endl;
+                memset(response->data, 0, responseBufferSize);
+                writePointer = response->data;
+                // The queues change as transfers come and go on the data plane, so take the snapshot over there
+                dataPlane->call([this, &response, &writePointer]() {
+                    for (auto handler: vendorHandlers) {
+                        for (auto queue : handler.second->getTransferQueues()) {
+                            // Each record is 23 bytes so make sure the next one still fits
+                            if (writePointer + 23 > response->data + responseBufferSize) {
+                                break;
+                            }
+
+                            short productId = queue->productId;
+                            short depth = queue->transfers.size();
+                            uint64_t completed = queue->completed;
+                            uint64_t ranDry = queue->ranDry;
+
+                            memcpy(writePointer, &handler.first, sizeof(handler.first));
+                            writePointer+=sizeof(handler.first);
+                            memcpy(writePointer, &productId, sizeof(productId));
+                            writePointer+=sizeof(productId);
+                            memcpy(writePointer, &queue->endpoint, sizeof(queue->endpoint));
+                            writePointer+=sizeof(queue->endpoint);
+                            memcpy(writePointer, &depth, sizeof(depth));
+                            writePointer+=sizeof(depth);
+                            memcpy(writePointer, &completed, sizeof(completed));
+                            writePointer+=sizeof(completed);
+                            memcpy(writePointer, &ranDry, sizeof(ranDry));
+                            writePointer+=sizeof(ranDry);
+                        }
+                    }
+                });
+                response->length = writePointer - response->data;
+
+                messageQueue.addMessage(std::move(response));
+
+                break;
+
+            // Get latency histograms
+            case 0x0004:
+                std::cout << "Handling get latency histograms request" << std::endl;
+                memset(response->data, 0, responseBufferSize);
+                writePointer = response->data;
+                // The contexts come and go with the devices on the data plane and are written to there, so take the
+                // snapshot over there
+                dataPlane->call([this, &response, &writePointer]() {
+                    for (auto handler: vendorHandlers) {
+                        for (auto context : handler.second->getDeviceContexts()) {
+                            // Each record is the vendor and product followed by count, p50, p90, p99, p99.9 and max of
+                            // every stage, all as 64 bit values with durations in nanoseconds
+                            if (writePointer + 4 + latency_stage::latencyStageCount * 6 * 8 > response->data + responseBufferSize) {
+                                break;
+                            }
+
+                            short productId = context->productId;
+                            memcpy(writePointer, &handler.first, sizeof(handler.first));
+                            writePointer+=sizeof(handler.first);
+                            memcpy(writePointer, &productId, sizeof(productId));
+                            writePointer+=sizeof(productId);
+
+                            for (int stage = 0; stage < latency_stage::latencyStageCount; ++stage) {
+                                latency_histogram& histogram = context->latency[stage];
+                                uint64_t values[6] = {
+                                        histogram.getCount(),
+                                        histogram.getPercentile(50.0),
+                                        histogram.getPercentile(90.0),
+                                        histogram.getPercentile(99.0),
+                                        histogram.getPercentile(99.9),
+                                        histogram.getMax()
+                                };
+                                memcpy(writePointer, values, sizeof(values));
+                                writePointer+=sizeof(values);
+                            }
+                        }
+                    }
+                });
+                response->length = writePointer - response->data;
+
+                messageQueue.addMessage(std::move(response));
+
+                break;
+
+            // Get the realtime options in effect on the data plane
+            case 0x0005: {
+                std::cout << "Handling get realtime status request" << std::endl;
+                realtime_status status = dataPlane->getRealtimeStatus();
+
+                // Requested and applied option bits, then policy, priority and prefaulted stack size as 32 bit values
+                // and the CPUs the data plane may run on as a 16 bit count followed by 16 bit CPU numbers
+                memset(response->data, 0, responseBufferSize);
+                writePointer = response->data;
+                memcpy(writePointer, &status.requested, sizeof(status.requested));
+                writePointer+=sizeof(status.requested);
+                memcpy(writePointer, &status.applied, sizeof(status.applied));
+                writePointer+=sizeof(status.applied);
+                int32_t values[3] = {status.policy, status.priority, status.prefaultedStackKb};
+                memcpy(writePointer, values, sizeof(values));
+                writePointer+=sizeof(values);
+
+                unsigned short cpuCount = std::min(status.cpus.size(), (size_t)1024);
+                memcpy(writePointer, &cpuCount, sizeof(cpuCount));
+                writePointer+=sizeof(cpuCount);
+                memcpy(writePointer, status.cpus.data(), cpuCount * sizeof(unsigned short));
+                writePointer+=cpuCount * sizeof(unsigned short);
+                response->length = writePointer - response->data;
+
+                messageQueue.addMessage(std::move(response));
+
+                break;
+            }
+
+            // Hand the virtual devices to a daemon taking over and exit
+            case daemon_handoff::handOffRequest:
+                std::cout << "Handling hand off request" << std::endl;
+                handOffSocket = message->originatingSocket;
+                running = false;
+
+                break;
+
+            // Get hotplug statistics
+            case 0x0007: {
+                std::cout << "Handling get hotplug statistics request" << std::endl;
+
+                // Received, delivered and suppressed transitions as 64 bit values
+                uint64_t values[3] = {
+                        hotplugDebouncer->getReceivedTransitions(),
+                        hotplugDebouncer->getDeliveredTransitions(),
+                        hotplugDebouncer->getSuppressedTransitions()
+                };
+                memcpy(response->data, values, sizeof(values));
+                response->length = sizeof(values);
+
+                messageQueue.addMessage(std::move(response));
+
+                break;
+            }
+
+            // Get decoded and discarded reports per endpoint
+            case 0x0008:
+                std::cout << "Handling get endpoint statistics request" << std::endl;
+                memset(response->data, 0, responseBufferSize);
+                writePointer = response->data;
+                // Each record is the vendor, product and endpoint, whether the endpoint is subscribed (0), still being
+                // probed (1) or was unsubscribed (2), then the decoded and discarded report counts as 64 bit values
+                dataPlane->call([this, &response, &writePointer]() {
+                    auto writeRecord = [&response, &writePointer](short vendorId, short productId,
+                                                                  unsigned char endpoint, unsigned char state,
+                                                                  uint64_t decoded, uint64_t discarded) {
+                        if (writePointer + 22 > response->data + responseBufferSize) {
+                            return;
+                        }
+
+                        memcpy(writePointer, &vendorId, sizeof(vendorId));
+                        writePointer+=sizeof(vendorId);
+                        memcpy(writePointer, &productId, sizeof(productId));
+                        writePointer+=sizeof(productId);
+                        memcpy(writePointer, &endpoint, sizeof(endpoint));
+                        writePointer+=sizeof(endpoint);
+                        memcpy(writePointer, &state, sizeof(state));
+                        writePointer+=sizeof(state);
+                        memcpy(writePointer, &decoded, sizeof(decoded));
+                        writePointer+=sizeof(decoded);
+                        memcpy(writePointer, &discarded, sizeof(discarded));
+                        writePointer+=sizeof(discarded);
+                    };
+
+                    for (auto handler: vendorHandlers) {
+                        for (auto queue : handler.second->getTransferQueues()) {
+                            writeRecord(handler.first, queue->productId, queue->endpoint, queue->probing ? 1 : 0,
+                                        queue->decoded, queue->discarded);
+                        }
+
+                        for (auto unused : handler.second->getUnusedEndpoints()) {
+                            writeRecord(handler.first, unused.first.first, unused.first.second, 2, 0, unused.second);
+                        }
+                    }
+                });
+                response->length = writePointer - response->data;
+
+                messageQueue.addMessage(std::move(response));
+
+                break;
+
+            // Get message pool statistics
+            case 0x0009: {
+                std::cout << "Handling get message pool statistics request" << std::endl;
+
+                // Messages taken from the pool, allocations it had to make, messages not returned yet and messages
+                // dropped by the queue as 64 bit values
+                message_pool* pool = messageQueue.getMessagePool();
+                uint64_t values[4] = {
+                        pool->getAcquired(),
+                        pool->getAllocations(),
+                        pool->getOutstanding(),
+                        messageQueue.getDroppedMessages()
+                };
+                memcpy(response->data, values, sizeof(values));
+                response->length = sizeof(values);
+
+                messageQueue.addMessage(std::move(response));
+
+                break;
+            }
+
             default:
                 break;
         }
     }
+
+    receivedMessages.clear();
 }
@@ -29,15 +29,23 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "hotplug_event.h"
 #include "includes/json.hpp"
 #include "socket_server.h"
+#include "event_loop.h"
+#include "report_capture.h"
+#include "usb_transport.h"
+#include "data_plane.h"
+#include "capability_cache.h"
+#include "handed_off_device.h"
+#include "hotplug_debouncer.h"
 
 class event_handler {
 public:
-    event_handler();
+    // Devices handed over by a previous daemon are kept until their tablets are claimed again
+    explicit event_handler(const std::vector<handed_off_device>& handedOff = std::vector<handed_off_device>());
     ~event_handler();
     int run();
 
 private:
-    static void sigHandler(int signo);
+    void handleSignal(int signo);
     static int hotplugCallback(struct libusb_context* context, struct libusb_device* device,
                                        libusb_hotplug_event event, void* user_data);
 
@@ -48,21 +56,37 @@ private:
     void loadConfiguration();
     void saveConfiguration();
 
+    void handleHotplugEvents();
     void handleMessages();
+    void handOff();
 
     static bool running;
     static event_handler* instance;
 
     std::map<short, vendor_handler*> vendorHandlers;
+    usb_transport* transport;
     usb_devices *devices;
+    data_plane* dataPlane;
+    capability_cache* capabilityCache;
 
+    hotplug_debouncer* hotplugDebouncer;
     std::deque<hotplug_event> hotplugEvents;
 
+    // Connection of a daemon taking over, which gets the virtual devices once this one stops
+    int handOffSocket = -1;
+    // How long devices from a previous daemon wait for their tablets to be claimed again
+    const long handOffGracePeriodMs = 5000;
+
     // Config related
     nlohmann::json driverConfigJson;
+    report_capture reportCapture;
 
+    event_loop eventLoop;
     socket_server socketServer;
     unix_socket_message_queue messageQueue;
+    // Kept between calls so that handling requests doesn't allocate
+    std::vector<pooled_message> receivedMessages;
+    static const size_t responseBufferSize = 4096;
 };
 
 
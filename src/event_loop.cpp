@@ -0,0 +1,286 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <iostream>
+#include "event_loop.h"
+
+event_loop::event_loop()
+: timerFd(-1), signalFd(-1), nextTimerId(1), ownerThread(std::thread::id()), postFd(-1), wakeups(0) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1) {
+        std::cout << "Could not create epoll instance errno: " << errno << std::endl;
+        return;
+    }
+
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd == -1) {
+        std::cout << "Could not create timerfd errno: " << errno << std::endl;
+        return;
+    }
+
+    addFd(timerFd, EPOLLIN, [this](uint32_t events) {
+        handleTimers();
+    });
+
+    postFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (postFd == -1) {
+        std::cout << "Could not create eventfd errno: " << errno << std::endl;
+        return;
+    }
+
+    addFd(postFd, EPOLLIN, [this](uint32_t events) {
+        handlePostedTasks();
+    });
+}
+
+event_loop::~event_loop() {
+    timer_callback* task;
+    while (postedTasks.pop(task)) {
+        delete task;
+    }
+
+    if (postFd != -1) {
+        close(postFd);
+    }
+
+    if (signalFd != -1) {
+        close(signalFd);
+    }
+
+    if (timerFd != -1) {
+        close(timerFd);
+    }
+
+    if (epollFd != -1) {
+        close(epollFd);
+    }
+}
+
+bool event_loop::addFd(int fd, uint32_t events, fd_callback callback) {
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        std::cout << "Could not add fd " << fd << " to epoll errno: " << errno << std::endl;
+        return false;
+    }
+
+    fdCallbacks[fd] = callback;
+    return true;
+}
+
+bool event_loop::modifyFd(int fd, uint32_t events) {
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+
+    return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) != -1;
+}
+
+void event_loop::removeFd(int fd) {
+    auto record = fdCallbacks.find(fd);
+    if (record == fdCallbacks.end()) {
+        return;
+    }
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    fdCallbacks.erase(record);
+}
+
+int event_loop::addTimer(long delayMs, timer_callback callback) {
+    uint64_t deadline = monotonicNow() + (uint64_t)delayMs * 1000000;
+    int timerId = nextTimerId++;
+
+    timers.insert({deadline, {timerId, callback}});
+    timerDeadlines[timerId] = deadline;
+    armTimer();
+
+    return timerId;
+}
+
+void event_loop::cancelTimer(int timerId) {
+    auto deadline = timerDeadlines.find(timerId);
+    if (deadline == timerDeadlines.end()) {
+        return;
+    }
+
+    auto range = timers.equal_range(deadline->second);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.id == timerId) {
+            timers.erase(it);
+            break;
+        }
+    }
+
+    timerDeadlines.erase(deadline);
+    armTimer();
+}
+
+bool event_loop::watchSignals(const std::vector<int>& signals, signal_callback callback) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (auto signo : signals) {
+        sigaddset(&mask, signo);
+    }
+
+    // The signals have to be blocked so that they are only delivered through the signalfd
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        std::cout << "Could not block signals errno: " << errno << std::endl;
+        return false;
+    }
+
+    signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalFd == -1) {
+        std::cout << "Could not create signalfd errno: " << errno << std::endl;
+        return false;
+    }
+
+    signalCallback = callback;
+    return addFd(signalFd, EPOLLIN, [this](uint32_t events) {
+        handleSignals();
+    });
+}
+
+void event_loop::setOwnerThread(std::thread::id owner) {
+    ownerThread.store(owner, std::memory_order_release);
+}
+
+bool event_loop::isOwnerThread() {
+    std::thread::id owner = ownerThread.load(std::memory_order_acquire);
+    return owner == std::thread::id() || owner == std::this_thread::get_id();
+}
+
+void event_loop::post(timer_callback task) {
+    if (isOwnerThread()) {
+        task();
+        return;
+    }
+
+    timer_callback* queuedTask = new timer_callback(std::move(task));
+    while (!postedTasks.push(queuedTask)) {
+        // Only happens if the owner fell hundreds of tasks behind, give it the chance to catch up
+        std::this_thread::yield();
+    }
+
+    uint64_t counter = 1;
+    if (write(postFd, &counter, sizeof(counter)) != sizeof(counter)) {
+        std::cout << "Could not wake up the event loop errno: " << errno << std::endl;
+    }
+}
+
+int event_loop::runOnce(int timeoutMs) {
+    const int maxEvents = 32;
+    struct epoll_event events[maxEvents];
+
+    int ready = epoll_wait(epollFd, events, maxEvents, timeoutMs);
+    ++wakeups;
+
+    if (ready == -1) {
+        if (errno != EINTR) {
+            std::cout << "epoll_wait failed errno: " << errno << std::endl;
+        }
+
+        return 0;
+    }
+
+    for (int index = 0; index < ready; ++index) {
+        // Callbacks are allowed to remove any fd, including their own, so look it up every time
+        auto record = fdCallbacks.find(events[index].data.fd);
+        if (record != fdCallbacks.end()) {
+            fd_callback callback = record->second;
+            callback(events[index].events);
+        }
+    }
+
+    return ready;
+}
+
+uint64_t event_loop::monotonicNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+unsigned long event_loop::getWakeups() {
+    return wakeups;
+}
+
+void event_loop::armTimer() {
+    struct itimerspec spec = {};
+
+    // A zeroed it_value disarms the timer when nothing is pending
+    if (!timers.empty()) {
+        uint64_t deadline = timers.begin()->first;
+        spec.it_value.tv_sec = deadline / 1000000000;
+        spec.it_value.tv_nsec = deadline % 1000000000;
+
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1;
+        }
+    }
+
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void event_loop::handleTimers() {
+    uint64_t expirations;
+    while (read(timerFd, &expirations, sizeof(expirations)) > 0) {
+    }
+
+    uint64_t now = monotonicNow();
+    while (!timers.empty() && timers.begin()->first <= now) {
+        timer_entry entry = timers.begin()->second;
+        timers.erase(timers.begin());
+        timerDeadlines.erase(entry.id);
+
+        entry.callback();
+    }
+
+    armTimer();
+}
+
+void event_loop::handlePostedTasks() {
+    uint64_t counter;
+    while (read(postFd, &counter, sizeof(counter)) > 0) {
+    }
+
+    timer_callback* task;
+    while (postedTasks.pop(task)) {
+        (*task)();
+        delete task;
+    }
+}
+
+void event_loop::handleSignals() {
+    struct signalfd_siginfo info;
+    while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+        if (signalCallback) {
+            signalCallback(info.ssi_signo);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_EVENT_LOOP_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_EVENT_LOOP_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <thread>
+#include <vector>
+#include "spsc_queue.h"
+
+// Single epoll based dispatcher. Everything a thread of the daemon waits on (libusb pollfds, sockets, signals and
+// timers) is registered here so that it sleeps until there is actual work to do. None of the methods are thread safe,
+// other threads hand work to the loop through post.
+class event_loop {
+public:
+    typedef std::function<void(uint32_t events)> fd_callback;
+    typedef std::function<void()> timer_callback;
+    typedef std::function<void(int signo)> signal_callback;
+
+    event_loop();
+    ~event_loop();
+
+    bool addFd(int fd, uint32_t events, fd_callback callback);
+    bool modifyFd(int fd, uint32_t events);
+    void removeFd(int fd);
+
+    // One-shot timers. The returned id can be used to cancel the timer before it fires
+    int addTimer(long delayMs, timer_callback callback);
+    void cancelTimer(int timerId);
+
+    bool watchSignals(const std::vector<int>& signals, signal_callback callback);
+
+    // The thread that runs this loop. Until one is set, the loop belongs to whichever thread uses it.
+    void setOwnerThread(std::thread::id owner);
+    bool isOwnerThread();
+    // Runs the task on the owner thread, straight away if called from there. Only a single other thread may post to
+    // a loop since tasks go through a single producer queue.
+    void post(timer_callback task);
+
+    // Waits for at most timeoutMs (-1 waits forever) and dispatches everything that is ready
+    int runOnce(int timeoutMs);
+
+    static uint64_t monotonicNow();
+
+    unsigned long getWakeups();
+private:
+    struct timer_entry {
+        int id;
+        timer_callback callback;
+    };
+
+    void armTimer();
+    void handleTimers();
+    void handleSignals();
+    void handlePostedTasks();
+
+    int epollFd;
+    int timerFd;
+    int signalFd;
+
+    std::map<int, fd_callback> fdCallbacks;
+    std::multimap<uint64_t, timer_entry> timers;
+    std::map<int, uint64_t> timerDeadlines;
+    int nextTimerId;
+    signal_callback signalCallback;
+
+    std::atomic<std::thread::id> ownerThread;
+    int postFd;
+    spsc_queue<timer_callback*, 256> postedTasks;
+
+    unsigned long wakeups;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_EVENT_LOOP_H
@@ -0,0 +1,34 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_HANDED_OFF_DEVICE_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_HANDED_OFF_DEVICE_H
+
+#include <string>
+
+// A virtual device passed from a daemon that is going away to the one replacing it
+struct handed_off_device {
+    // Product handler the device belongs to
+    unsigned short vendorId;
+    unsigned short productId;
+    int fd;
+    // What the device was created for, so that it only goes back to the same tablet
+    std::string signature;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_HANDED_OFF_DEVICE_H
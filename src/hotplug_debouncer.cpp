@@ -0,0 +1,152 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "hotplug_debouncer.h"
+
+hotplug_debouncer::hotplug_debouncer(event_loop* loop, usb_transport* transport, event_callback callback)
+        : eventLoop(loop), transport(transport), callback(callback) {
+}
+
+hotplug_debouncer::~hotplug_debouncer() {
+    for (auto pending : pendingTransitions) {
+        eventLoop->cancelTimer(pending.second.timerId);
+        if (pending.second.left != nullptr) {
+            transport->unrefDevice(pending.second.left);
+        }
+        if (pending.second.arrived != nullptr) {
+            transport->unrefDevice(pending.second.arrived);
+        }
+    }
+}
+
+void hotplug_debouncer::setWindow(long ms) {
+    windowMs = std::max(0L, ms);
+}
+
+void hotplug_debouncer::push(const hotplug_event& event) {
+    receivedTransitions++;
+
+    std::string identity = identify(event.device);
+    auto pending = pendingTransitions.find(identity);
+    if (pending == pendingTransitions.end()) {
+        if (windowMs == 0) {
+            deliveredTransitions++;
+            callback(event);
+            transport->unrefDevice(event.device);
+            return;
+        }
+
+        pending = pendingTransitions.insert({identity, pending_transition {nullptr, nullptr, -1}}).first;
+    } else {
+        eventLoop->cancelTimer(pending->second.timerId);
+    }
+
+    pending_transition& transition = pending->second;
+    if (event.event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+        if (transition.arrived == event.device) {
+            // Arrived and left again within the window, it was never there
+            transport->unrefDevice(transition.arrived);
+            transport->unrefDevice(event.device);
+            transition.arrived = nullptr;
+            suppressedTransitions += 2;
+        } else if (transition.left == nullptr) {
+            transition.left = event.device;
+        } else {
+            // Repeated
+            transport->unrefDevice(event.device);
+            suppressedTransitions++;
+        }
+    } else {
+        if (transition.left == event.device) {
+            // Left and came back as the very same device, nothing changed
+            transport->unrefDevice(transition.left);
+            transport->unrefDevice(event.device);
+            transition.left = nullptr;
+            suppressedTransitions += 2;
+        } else if (transition.arrived == nullptr) {
+            transition.arrived = event.device;
+        } else {
+            // Repeated, or a later arrival taking the place of one nobody saw
+            transport->unrefDevice(transition.arrived);
+            transition.arrived = event.device;
+            suppressedTransitions++;
+        }
+    }
+
+    if (transition.left == nullptr && transition.arrived == nullptr) {
+        pendingTransitions.erase(pending);
+        return;
+    }
+
+    // Wait for the device to settle from here
+    transition.timerId = eventLoop->addTimer(windowMs, [this, identity]() {
+        deliver(identity);
+    });
+}
+
+std::string hotplug_debouncer::identify(libusb_device* device) {
+    struct libusb_device_descriptor descriptor;
+    std::string identity;
+    if (transport->getDeviceDescriptor(device, &descriptor) == LIBUSB_SUCCESS) {
+        identity = std::to_string(descriptor.idVendor) + ":" + std::to_string(descriptor.idProduct);
+    }
+
+    identity += "@" + std::to_string(transport->getBusNumber(device));
+    uint8_t portNumbers[8];
+    int portCount = transport->getPortNumbers(device, portNumbers, sizeof(portNumbers));
+    for (int index = 0; index < portCount; ++index) {
+        identity += "." + std::to_string(portNumbers[index]);
+    }
+
+    return identity;
+}
+
+void hotplug_debouncer::deliver(const std::string& identity) {
+    auto pending = pendingTransitions.find(identity);
+    if (pending == pendingTransitions.end()) {
+        return;
+    }
+
+    pending_transition transition = pending->second;
+    pendingTransitions.erase(pending);
+
+    if (transition.left != nullptr) {
+        deliveredTransitions++;
+        callback({LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, transition.left});
+        transport->unrefDevice(transition.left);
+    }
+
+    if (transition.arrived != nullptr) {
+        deliveredTransitions++;
+        callback({LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, transition.arrived});
+        transport->unrefDevice(transition.arrived);
+    }
+}
+
+unsigned long hotplug_debouncer::getReceivedTransitions() const {
+    return receivedTransitions;
+}
+
+unsigned long hotplug_debouncer::getDeliveredTransitions() const {
+    return deliveredTransitions;
+}
+
+unsigned long hotplug_debouncer::getSuppressedTransitions() const {
+    return suppressedTransitions;
+}
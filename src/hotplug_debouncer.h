@@ -0,0 +1,75 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_HOTPLUG_DEBOUNCER_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_HOTPLUG_DEBOUNCER_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include "hotplug_event.h"
+#include "event_loop.h"
+#include "usb_transport.h"
+
+// Holds hotplug events back until their device has been quiet for a while. A device that arrives and leaves again
+// within that window, as with a bouncing connector, is never claimed at all, and repeated events collapse into one.
+// Devices are told apart by model and where they are plugged in, since one that re-enumerates comes back as a new
+// libusb device. It leaving and coming back within the window is handed on as the old one leaving and the last new one
+// arriving, right after each other once it settled. Lives on the thread of the loop it is given.
+class hotplug_debouncer {
+public:
+    typedef std::function<void(const hotplug_event& event)> event_callback;
+
+    hotplug_debouncer(event_loop* loop, usb_transport* transport, event_callback callback);
+    ~hotplug_debouncer();
+
+    // 0 hands every event on as it comes
+    void setWindow(long ms);
+    // Takes over a reference on the device the caller took while it was still valid
+    void push(const hotplug_event& event);
+
+    unsigned long getReceivedTransitions() const;
+    unsigned long getDeliveredTransitions() const;
+    // Transitions cancelled out by the opposite one or repeated within the window
+    unsigned long getSuppressedTransitions() const;
+private:
+    // What happened to one device during the window. Both hold a reference on their device.
+    struct pending_transition {
+        // The device from before the window, when it left
+        libusb_device* left;
+        // The device it is now, when one arrived
+        libusb_device* arrived;
+        int timerId;
+    };
+
+    // Vendor, product, bus and port path
+    std::string identify(libusb_device* device);
+    void deliver(const std::string& identity);
+
+    event_loop* eventLoop;
+    usb_transport* transport;
+    event_callback callback;
+    long windowMs = 0;
+
+    std::map<std::string, pending_transition> pendingTransitions;
+    unsigned long receivedTransitions = 0;
+    unsigned long deliveredTransitions = 0;
+    unsigned long suppressedTransitions = 0;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_HOTPLUG_DEBOUNCER_H
@@ -17,7 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <iostream>
-#include <thread>
+#include <algorithm>
 #include "huion_handler.h"
 #include "device_interface_pair.h"
 #include "huion_tablet.h"
@@ -89,31 +89,9 @@ std::set<short> huion_handler::getConnectedDevices() {
 }
 
 bool huion_handler::handleProductAttach(libusb_device* device, const libusb_device_descriptor descriptor) {
-    libusb_device_handle* handle = NULL;
-    device_interface_pair* interfacePair = nullptr;
-    const int maxRetries = 5;
-    int currentAttept = 0;
-
     if (std::find(handledProducts.begin(), handledProducts.end(), descriptor.idProduct) != handledProducts.end()) {
         std::cout << "Handling " << productHandlers[descriptor.idProduct]->getProductName(descriptor.idProduct) << std::endl;
-        while (interfacePair == nullptr  && currentAttept < maxRetries) {
-            interfacePair = claimDevice(device, handle, descriptor);
-            if (interfacePair == nullptr) {
-                std::cout << "Could not claim device on attempt " << currentAttept << ". Detaching and then waiting" << std::endl;
-                handleProductDetach(device, descriptor);
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-                ++currentAttept;
-            }
-        }
-
-        if (interfacePair != nullptr) {
-            deviceInterfaces.push_back(interfacePair);
-            deviceInterfaceMap[device] = interfacePair;
-            return true;
-        }
-
-        std::cout << "Giving up" << std::endl;
-        return false;
+        return attachProduct(device, descriptor);
     }
 
     std::cout << "Unknown product " << descriptor.idProduct << std::endl;
@@ -122,16 +100,38 @@ bool huion_handler::handleProductAttach(libusb_device* device, const libusb_devi
 }
 
 void huion_handler::handleProductDetach(libusb_device *device, struct libusb_device_descriptor descriptor) {
+    // It may still be waiting for another try at claiming it, or for its cached capabilities to be checked
+    cancelAttach(device);
+    cancelRevalidation(device);
+
     for (auto deviceObj : deviceInterfaceMap) {
         if (deviceObj.first == device) {
             std::cout << "Handling device detach" << std::endl;
 
-            if (productHandlers.find(descriptor.idProduct) != productHandlers.end()) {
-                productHandlers[descriptor.idProduct]->detachDevice(deviceObj.second->deviceHandle);
+            // Nothing may complete into the device context once it is deleted
+            runOnDataPlane([this, &deviceObj]() {
+                stopTransfers(deviceObj.second->deviceHandle);
+            });
+
+            // Aliased devices are attached to the handler of the product they were aliased to
+            auto handler = productHandlers.find(deviceObj.second->productId);
+            if (handler != productHandlers.end()) {
+                runOnDataPlane([&handler, &deviceObj]() {
+                    handler->second->detachDevice(deviceObj.second->deviceHandle);
+                });
+                scheduleParkedExpiry();
             }
 
+            // Don't set up transfers on this handle again once it is closed
+            auto setupIterator = std::remove_if(transfersSetUp.begin(), transfersSetUp.end(),
+                                                [&deviceObj](const transfer_setup_data& setupData) {
+                return setupData.handle == deviceObj.second->deviceHandle;
+            });
+            transfersSetUp.erase(setupIterator, transfersSetUp.end());
+
             cleanupDevice(deviceObj.second);
-            libusb_close(deviceObj.second->deviceHandle);
+            forgetCapabilities(deviceObj.second->deviceHandle);
+            transport->close(deviceObj.second->deviceHandle);
 
             auto deviceInterfacesIterator = std::find(deviceInterfaces.begin(), deviceInterfaces.end(), deviceObj.second);
             if (deviceInterfacesIterator != deviceInterfaces.end()) {
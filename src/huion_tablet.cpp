@@ -30,6 +30,9 @@ huion_tablet::huion_tablet(int productId) {
     for (int currentAssignedButton = BTN_A; currentAssignedButton <= BTN_SELECT; ++currentAssignedButton) {
         padButtonAliases.push_back(currentAssignedButton);
     }
+
+    // Only the length of the pen and pad reports of the newer models is known for sure
+    setReportLength(0x08, 12);
 }
 
 huion_tablet::~huion_tablet() noexcept {
@@ -111,6 +114,11 @@ int huion_tablet::getAliasedDeviceIdFromFirmware(std::wstring firmwareName) {
 }
 
 int huion_tablet::getAliasedProductId(libusb_device_handle *handle, int originalId) {
+    device_capabilities capabilities;
+    if (capabilityCache != nullptr && capabilityCache->lookup(handle, capabilities)) {
+        return capabilities.aliasedProductId != 0x0000 ? capabilities.aliasedProductId : originalId;
+    }
+
     auto firmware = getDeviceFirmwareName(handle);
     auto productId = getAliasedDeviceIdFromFirmware(firmware);
     if (productId == 0x0000) {
@@ -135,7 +143,7 @@ std::wstring huion_tablet::getDeviceFirmwareName(libusb_device_handle *handle) {
     memset(buffer, 0, 200);
 
     // Extract the firmware name
-    int descriptorLength = libusb_get_string_descriptor(handle, 0xc9, 0x0409, buffer, 130);
+    int descriptorLength = transport->getStringDescriptor(handle, 0xc9, 0x0409, buffer, 130);
     if (descriptorLength < 36) {
         std::cout << "Could not get firmware descriptor. Returned descriptor length was " << descriptorLength
                   << std::endl;
@@ -160,41 +168,68 @@ std::wstring huion_tablet::getDeviceFirmwareName(libusb_device_handle *handle) {
     return firmware;
 }
 
+bool huion_tablet::readCapabilities(libusb_device_handle* handle, device_capabilities& capabilities) {
+    // Tablets without a firmware name still report their ranges
+    auto firmware = getDeviceFirmwareName(handle);
+    capabilities.firmware = std::string(firmware.begin(), firmware.end());
+    capabilities.aliasedProductId = getAliasedDeviceIdFromFirmware(firmware);
+
+    unsigned char buffer[32];
+    memset(buffer, 0, sizeof(buffer));
+    if (transport->getStringDescriptor(handle, 200, 0x0409, buffer, sizeof(buffer)) < 18) {
+        return false;
+    }
+
+    capabilities.maxWidth = (buffer[4] << 16) + (buffer[3] << 8) + buffer[2];
+    capabilities.maxHeight = (buffer[7] << 16) + (buffer[6] << 8) + buffer[5];
+    capabilities.maxPressure = (buffer[9] << 8) + buffer[8];
+
+    return true;
+}
+
+bool huion_tablet::prepareAttach(libusb_device_handle* handle, device_capabilities& capabilities) {
+    if (transfer_handler::prepareAttach(handle, capabilities)) {
+        return true;
+    }
+
+    // Let's see which descriptors are actually available. Done here rather than when attaching since it takes a
+    // request per descriptor.
+    unsigned char buffer[12];
+    for (int i = 1; i < 0xff; ++i) {
+        memset(buffer, 0, sizeof(buffer));
+        int stringLength = transport->getStringDescriptor(handle, i, 0x0409, buffer, sizeof(buffer));
+        if (stringLength < 0) {
+            std::cout << "Could not get descriptor on index " << i << std::endl;
+        } else {
+            std::cout << "Descriptor " << i << " has length " << stringLength << std::endl;
+        }
+    }
+
+    return false;
+}
+
 bool huion_tablet::attachDevice(libusb_device_handle *handle, int interfaceId) {
     // We only attach once so that we don't create multiple virtual devices
     if (interfaceId == 0) {
-        unsigned char *buffer = new unsigned char[200];
-        memset(buffer, 0, 200);
-        auto firmware = getDeviceFirmwareName(handle);
+        // We need to get a few more bits of information
+        device_capabilities capabilities;
+        if (!getCapabilities(handle, capabilities)) {
+            std::cout << "Could not get descriptor" << std::endl;
+            return false;
+        }
+
+        std::wstring firmware(capabilities.firmware.begin(), capabilities.firmware.end());
         std::wcout << "Got firmware " << firmware << std::endl;
 
         std::string deviceName = getDeviceNameFromFirmware(firmware);
         std::cout << "Resolved device name to " << deviceName << std::endl;
         // Store the device name relationship to the handle
         handleToDeviceName[handle] = deviceName;
-        handleToAliasedDeviceId[handle] = getAliasedDeviceIdFromFirmware(firmware);
+        handleToAliasedDeviceId[handle] = capabilities.aliasedProductId;
 
-        // We need to get a few more bits of information
-        if (libusb_get_string_descriptor(handle, 200, 0x0409, buffer, 32) < 18) {
-            std::cout << "Could not get descriptor" << std::endl;
-            // Let's see which descriptors are actually available
-            for (int i = 1; i < 0xff; ++i) {
-                memset(buffer, 0, 12);
-                int stringLength = libusb_get_string_descriptor(handle, i, 0x0409, buffer, 12);
-                if (stringLength < 0) {
-                    std::cout << "Could not get descriptor on index " << i << std::endl;
-                } else {
-                    std::cout << "Descriptor " << i << " has length " << stringLength << std::endl;
-                }
-            }
-
-            delete[] buffer;
-            return false;
-        }
-
-        int maxWidth = (buffer[4] << 16) + (buffer[3] << 8) + buffer[2];
-        int maxHeight = (buffer[7] << 16) + (buffer[6] << 8) + buffer[5];
-        int maxPressure = (buffer[9] << 8) + buffer[8];
+        int maxWidth = capabilities.maxWidth;
+        int maxHeight = capabilities.maxHeight;
+        int maxPressure = capabilities.maxPressure;
 
         std::cout << deviceName << " configured with max-width: " << maxWidth << " max-height: " << maxHeight
                   << " max-pressure: " << maxPressure << std::endl;
@@ -236,16 +271,14 @@ bool huion_tablet::attachDevice(libusb_device_handle *handle, int interfaceId) {
         memset(padArgs.productName, 0, UINPUT_MAX_NAME_SIZE);
         memcpy(padArgs.productName, padNameString.c_str(), padNameString.length());
 
-        uinputPens[handle] = create_pen(penArgs);
-        uinputPads[handle] = create_pad(padArgs);
-
-        delete[] buffer;
+        getDeviceContext(handle)->penEvents.setDevice(create_pen(penArgs));
+        getDeviceContext(handle)->padEvents.setDevice(create_pad(padArgs));
     }
 
     return true;
 }
 
-bool huion_tablet::handleTransferData(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+bool huion_tablet::handleTransferData(device_context* context, unsigned char *data, size_t dataLen) {
 //    std::cout << std::dec << "Got transfer of data length: " << (int)dataLen << " data: ";
 //    for (int i = 0; i < dataLen; ++i) {
 //        std::cout << std::hex << std::setfill('0')  << std::setw(2) << (int)data[i] << ":";
@@ -254,8 +287,8 @@ bool huion_tablet::handleTransferData(libusb_device_handle *handle, unsigned cha
 
     switch (data[0]) {
         case 0x07:
-            handleDigitizerEventV3(handle, data, dataLen);
-            handlePadEventV1(handle, data, dataLen);
+            handleDigitizerEventV3(context, data, dataLen);
+            handlePadEventV1(context, data, dataLen);
             return true;
 
         case 0x08:
@@ -272,18 +305,18 @@ bool huion_tablet::handleTransferData(libusb_device_handle *handle, unsigned cha
         case 0x81:
         case 0x82:
         case 0x84:
-            handleDigitizerEventV2(handle, data, dataLen);
+            handleDigitizerEventV2(context, data, dataLen);
             break;
 
         case 0xc0:
         case 0xc1:
         case 0xc2:
         case 0xc4:
-            handleDigitizerEventV1(handle, data, dataLen);
+            handleDigitizerEventV1(context, data, dataLen);
             break;
 
         case 0xe0:
-            handlePadEventV1(handle, data, dataLen);
+            handlePadEventV1(context, data, dataLen);
 
             break;
         default:
@@ -293,7 +326,7 @@ bool huion_tablet::handleTransferData(libusb_device_handle *handle, unsigned cha
     return true;
 }
 
-void huion_tablet::handleDigitizerEventV1(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void huion_tablet::handleDigitizerEventV1(device_context* context, unsigned char *data, size_t dataLen) {
     int penX = (data[3] << 8) + data[2];
     int penY = (data[5] << 8) + data[4];
 
@@ -303,31 +336,31 @@ void huion_tablet::handleDigitizerEventV1(libusb_device_handle *handle, unsigned
         // Grab the pressure amount
         pressure = (data[7] << 8) + data[6];
 
-        uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 1);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_PRESSURE, pressure);
+        uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 1);
+        uinput_send(context->penEvents, EV_ABS, ABS_PRESSURE, pressure);
     } else {
-        uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 0);
     }
 
     // Check to see if the stylus buttons are being pressed
     if (0x02 & data[1]) {
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 1);
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 1);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
     } else if (0x04 & data[1]) {
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 1);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 1);
     } else {
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
     }
 
-    uinput_send(uinputPens[handle], EV_ABS, ABS_X, penX);
-    uinput_send(uinputPens[handle], EV_ABS, ABS_Y, penY);
+    uinput_send(context->penEvents, EV_ABS, ABS_X, penX);
+    uinput_send(context->penEvents, EV_ABS, ABS_Y, penY);
 
-    uinput_send(uinputPens[handle], EV_SYN, SYN_REPORT, 1);
+    uinput_send(context->penEvents, EV_SYN, SYN_REPORT, 1);
 }
 
-void huion_tablet::handleDigitizerEventV2(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void huion_tablet::handleDigitizerEventV2(device_context* context, unsigned char *data, size_t dataLen) {
     // Extract the X and Y position
     int penX = (data[8] << 16) + (data[3] << 8) + data[2];
     int penY = (data[5] << 8) + data[4];
@@ -338,10 +371,10 @@ void huion_tablet::handleDigitizerEventV2(libusb_device_handle *handle, unsigned
         // Grab the pressure amount
         pressure = (data[7] << 8) + data[6];
 
-        uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 1);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_PRESSURE, pressure);
+        uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 1);
+        uinput_send(context->penEvents, EV_ABS, ABS_PRESSURE, pressure);
     } else {
-        uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 0);
     }
 
     // Grab the tilt values
@@ -350,25 +383,25 @@ void huion_tablet::handleDigitizerEventV2(libusb_device_handle *handle, unsigned
 
     // Check to see if the stylus buttons are being pressed
     if (0x02 & data[1]) {
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 1);
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 1);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
     } else if (0x04 & data[1]) {
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 1);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 1);
     } else {
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-        uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
     }
 
-    uinput_send(uinputPens[handle], EV_ABS, ABS_X, penX);
-    uinput_send(uinputPens[handle], EV_ABS, ABS_Y, penY);
-    uinput_send(uinputPens[handle], EV_ABS, ABS_TILT_X, tiltx);
-    uinput_send(uinputPens[handle], EV_ABS, ABS_TILT_Y, tilty);
+    uinput_send(context->penEvents, EV_ABS, ABS_X, penX);
+    uinput_send(context->penEvents, EV_ABS, ABS_Y, penY);
+    uinput_send(context->penEvents, EV_ABS, ABS_TILT_X, tiltx);
+    uinput_send(context->penEvents, EV_ABS, ABS_TILT_Y, tilty);
 
-    uinput_send(uinputPens[handle], EV_SYN, SYN_REPORT, 1);
+    uinput_send(context->penEvents, EV_SYN, SYN_REPORT, 1);
 }
 
-void huion_tablet::handleDigitizerEventV3(libusb_device_handle *handle, unsigned char *data, size_t dataLen) {
+void huion_tablet::handleDigitizerEventV3(device_context* context, unsigned char *data, size_t dataLen) {
     if (data[1] < 0xa0) {
         // Extract the X and Y position
         int penX = (data[3] << 8) + data[2];
@@ -380,32 +413,32 @@ void huion_tablet::handleDigitizerEventV3(libusb_device_handle *handle, unsigned
             // Grab the pressure amount
             pressure = (data[7] << 8) + data[6];
 
-            uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 1);
-            uinput_send(uinputPens[handle], EV_ABS, ABS_PRESSURE, pressure);
+            uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 1);
+            uinput_send(context->penEvents, EV_ABS, ABS_PRESSURE, pressure);
         } else {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_TOOL_PEN, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 0);
         }
 
         // Check to see if the stylus buttons are being pressed
         if (0x02 & data[1]) {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 1);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 1);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
         } else if (0x04 & data[1]) {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 1);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 1);
         } else {
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS, 0);
-            uinput_send(uinputPens[handle], EV_KEY, BTN_STYLUS2, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+            uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
         }
 
-        uinput_send(uinputPens[handle], EV_ABS, ABS_X, penX);
-        uinput_send(uinputPens[handle], EV_ABS, ABS_Y, penY);
+        uinput_send(context->penEvents, EV_ABS, ABS_X, penX);
+        uinput_send(context->penEvents, EV_ABS, ABS_Y, penY);
 
-        uinput_send(uinputPens[handle], EV_SYN, SYN_REPORT, 1);
+        uinput_send(context->penEvents, EV_SYN, SYN_REPORT, 1);
     }
 }
 
-void huion_tablet::handlePadEventV1(libusb_device_handle* handle, unsigned char* data, size_t dataLen) {
+void huion_tablet::handlePadEventV1(device_context* context, unsigned char* data, size_t dataLen) {
     if (data[1] == 0xe0) {
         // Extract the button being pressed (If there is one)
         long button = (data[5] << 8) + data[4];
@@ -418,23 +451,23 @@ void huion_tablet::handlePadEventV1(libusb_device_handle* handle, unsigned char*
         if (button != 0) {
             auto padMap = padMapping.getPadMap(padButtonAliases[position - 1]);
             for (auto pmap: padMap) {
-                uinput_send(uinputPads[handle], pmap.event_type, pmap.event_value, 1);
+                uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 1);
             }
-            lastPressedButton[handle] = position;
+            context->lastPressedButton = position;
         } else if (!dialEvent) {
-            if (lastPressedButton.find(handle) != lastPressedButton.end() && lastPressedButton[handle] > 0) {
-                auto padMap = padMapping.getPadMap(padButtonAliases[lastPressedButton[handle] - 1]);
+            if (context->lastPressedButton > 0) {
+                auto padMap = padMapping.getPadMap(padButtonAliases[context->lastPressedButton - 1]);
                 for (auto pmap: padMap) {
-                    uinput_send(uinputPads[handle], pmap.event_type, pmap.event_value, 0);
+                    uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 0);
                 }
-                lastPressedButton[handle] = -1;
+                context->lastPressedButton = -1;
             } else {
                 std::cout << "Got a phantom button up event" << std::endl;
             }
         }
 
         if (shouldSyn) {
-            uinput_send(uinputPads[handle], EV_SYN, SYN_REPORT, 1);
+            uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 1);
         }
     }
 }
@@ -33,16 +33,18 @@ public:
     int sendInitKeyOnInterface();
     bool attachToInterfaceId(int interfaceId);
     bool attachDevice(libusb_device_handle* handle, int interfaceId);
-    bool handleTransferData(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
+    bool handleTransferData(device_context* context, unsigned char* data, size_t dataLen);
     std::set<int> getConnectedAliasedDevices();
     std::wstring getDeviceFirmwareName(libusb_device_handle* device);
     int getAliasedDeviceIdFromFirmware(std::wstring firmwareName);
     int getAliasedProductId(libusb_device_handle* handle, int originalId);
+    bool readCapabilities(libusb_device_handle* handle, device_capabilities& capabilities);
+    bool prepareAttach(libusb_device_handle* handle, device_capabilities& capabilities);
 private:
-    void handleDigitizerEventV1(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
-    void handleDigitizerEventV2(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
-    void handleDigitizerEventV3(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
-    void handlePadEventV1(libusb_device_handle* handle, unsigned char* data, size_t dataLen);
+    void handleDigitizerEventV1(device_context* context, unsigned char* data, size_t dataLen);
+    void handleDigitizerEventV2(device_context* context, unsigned char* data, size_t dataLen);
+    void handleDigitizerEventV3(device_context* context, unsigned char* data, size_t dataLen);
+    void handlePadEventV1(device_context* context, unsigned char* data, size_t dataLen);
 
     std::string getDeviceNameFromFirmware(std::wstring firmwareName);
 
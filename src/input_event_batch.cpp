@@ -0,0 +1,84 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "input_event_batch.h"
+#include "output_sink.h"
+
+input_event_batch::input_event_batch()
+: sink(nullptr), device(-1), timestamp({0, 0}), count(0) {
+
+}
+
+void input_event_batch::setSink(output_sink* newSink) {
+    sink = newSink;
+}
+
+output_sink* input_event_batch::getSink() const {
+    return sink;
+}
+
+void input_event_batch::setDevice(int newDevice) {
+    device = newDevice;
+}
+
+int input_event_batch::getDevice() const {
+    return device;
+}
+
+void input_event_batch::setTimestamp(const struct timeval& newTimestamp) {
+    timestamp = newTimestamp;
+}
+
+void input_event_batch::add(uint16_t type, uint16_t code, int32_t value) {
+    // Reports never get close to this but a huge key mapping could, in which case we send what we have so far
+    if (count == maxEvents) {
+        flush();
+    }
+
+    struct input_event& event = events[count++];
+    event.time = timestamp;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+}
+
+bool input_event_batch::flush() {
+    if (count == 0) {
+        return true;
+    }
+
+    // Interfaces without a virtual device of this kind still go through the same decoders
+    if (sink == nullptr || device < 0) {
+        count = 0;
+        return false;
+    }
+
+    size_t written = count;
+    count = 0;
+
+    return sink->write(device, events, written);
+}
+
+size_t input_event_batch::size() const {
+    return count;
+}
+
+bool input_event_batch::empty() const {
+    return count == 0;
+}
@@ -0,0 +1,57 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_INPUT_EVENT_BATCH_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_INPUT_EVENT_BATCH_H
+
+#include <linux/input.h>
+#include <cstdint>
+#include <cstddef>
+
+class output_sink;
+
+// Collects every event of a single USB report for one virtual device so that the whole frame, SYN_REPORT included,
+// reaches the output sink in one call and with that the kernel in a single write()
+class input_event_batch {
+public:
+    static const size_t maxEvents = 64;
+
+    input_event_batch();
+
+    void setSink(output_sink* sink);
+    output_sink* getSink() const;
+    void setDevice(int device);
+    int getDevice() const;
+    void setTimestamp(const struct timeval& timestamp);
+
+    void add(uint16_t type, uint16_t code, int32_t value);
+    bool flush();
+
+    size_t size() const;
+    bool empty() const;
+private:
+    output_sink* sink;
+    int device;
+    struct timeval timestamp;
+    struct input_event events[maxEvents];
+    size_t count;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_INPUT_EVENT_BATCH_H
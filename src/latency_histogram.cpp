@@ -0,0 +1,112 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "latency_histogram.h"
+
+latency_histogram::latency_histogram()
+: count(0), max(0) {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void latency_histogram::record(uint64_t value) {
+    std::atomic<uint64_t>& bucket = buckets[bucketIndex(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (value > max.load(std::memory_order_relaxed)) {
+        max.store(value, std::memory_order_relaxed);
+    }
+}
+
+void latency_histogram::add(const latency_histogram& other) {
+    for (size_t index = 0; index < bucketCount; ++index) {
+        buckets[index].store(buckets[index].load(std::memory_order_relaxed) +
+                             other.buckets[index].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    count.store(count.load(std::memory_order_relaxed) + other.getCount(), std::memory_order_relaxed);
+    if (other.getMax() > max.load(std::memory_order_relaxed)) {
+        max.store(other.getMax(), std::memory_order_relaxed);
+    }
+}
+
+uint64_t latency_histogram::getCount() const {
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t latency_histogram::getMax() const {
+    return max.load(std::memory_order_relaxed);
+}
+
+uint64_t latency_histogram::getPercentile(double percentile) const {
+    // Sum the buckets themselves since the total may be ahead of them while a value is being recorded
+    uint64_t total = 0;
+    for (auto& bucket : buckets) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(percentile / 100.0 * total);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t index = 0; index < bucketCount; ++index) {
+        seen += buckets[index].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            uint64_t upperBound = bucketUpperBound(index);
+            uint64_t maxValue = getMax();
+            return upperBound < maxValue ? upperBound : maxValue;
+        }
+    }
+
+    return getMax();
+}
+
+size_t latency_histogram::bucketIndex(uint64_t value) {
+    if (value < subBucketCount) {
+        return value;
+    }
+
+    int magnitude = 63 - __builtin_clzll(value);
+    if (magnitude >= maxMagnitude) {
+        return bucketCount - 1;
+    }
+
+    // The bits right below the most significant one pick the linear bucket within this power of two
+    uint64_t subBucket = (value >> (magnitude - subBucketBits)) & (subBucketCount - 1);
+    return subBucketCount + (magnitude - subBucketBits) * subBucketCount + subBucket;
+}
+
+uint64_t latency_histogram::bucketUpperBound(size_t index) {
+    if (index < subBucketCount) {
+        return index;
+    }
+
+    int magnitude = (index - subBucketCount) / subBucketCount + subBucketBits;
+    uint64_t subBucket = (index - subBucketCount) % subBucketCount;
+    uint64_t width = (uint64_t)1 << (magnitude - subBucketBits);
+
+    return (subBucketCount + subBucket) * width + width - 1;
+}
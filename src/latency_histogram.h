@@ -0,0 +1,60 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_LATENCY_HISTOGRAM_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Log-linear histogram of nanosecond durations in the style of HdrHistogram. Every power of two is split into
+// subBucketCount linear buckets, which keeps the error of any reported value below 1/subBucketCount.
+//
+// Only the thread handling the device records into it, so recording is a relaxed load and store per counter
+// without any locked instruction. Any other thread may read it at any time and sees a slightly stale view.
+class latency_histogram {
+public:
+    static const int subBucketBits = 4;
+    static const uint64_t subBucketCount = 1 << subBucketBits;
+    // Anything slower than 2^maxMagnitude ns (about 18 minutes) is counted in the last bucket
+    static const int maxMagnitude = 40;
+    static const size_t bucketCount = subBucketCount + (maxMagnitude - subBucketBits) * subBucketCount;
+
+    latency_histogram();
+
+    void record(uint64_t value);
+    // Adds everything recorded into another histogram to this one, same single writer rules as record
+    void add(const latency_histogram& other);
+
+    uint64_t getCount() const;
+    uint64_t getMax() const;
+    // Upper bound of the bucket holding the given percentile, 0 when nothing was recorded
+    uint64_t getPercentile(double percentile) const;
+private:
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(size_t index);
+
+    std::atomic<uint64_t> buckets[bucketCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> max;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_LATENCY_HISTOGRAM_H
@@ -0,0 +1,219 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sys/epoll.h>
+#include <poll.h>
+#include "libusb_transport.h"
+
+libusb_transport::libusb_transport() {
+    libusb_init(&context);
+//    libusb_set_option(context, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_DEBUG);
+}
+
+libusb_transport::~libusb_transport() {
+    libusb_exit(context);
+}
+
+libusb_context* libusb_transport::getContext() {
+    return context;
+}
+
+void libusb_transport::registerEventSources(event_loop* loop) {
+    eventLoop = loop;
+
+    const struct libusb_pollfd** pollFds = libusb_get_pollfds(context);
+    if (pollFds != NULL) {
+        for (int index = 0; pollFds[index] != NULL; ++index) {
+            addPollFd(pollFds[index]->fd, pollFds[index]->events);
+        }
+
+        libusb_free_pollfds(pollFds);
+    }
+
+    libusb_set_pollfd_notifiers(context, pollfdAdded, pollfdRemoved, this);
+}
+
+void libusb_transport::handleEvents() {
+    // Only called once one of the libusb fds is ready so we never want to block in here
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+    libusb_handle_events_timeout_completed(context, &tv, NULL);
+}
+
+int libusb_transport::getNextTimeout() {
+    // Linux builds of libusb use a timerfd for transfer timeouts which is already part of the pollfds
+    if (libusb_pollfds_handle_timeouts(context)) {
+        return -1;
+    }
+
+    struct timeval tv;
+    int result = libusb_get_next_timeout(context, &tv);
+    if (result == 0) {
+        return -1;
+    } else if (result < 0) {
+        return 0;
+    }
+
+    // Round up so that we don't wake up just before the timeout expires
+    return tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+}
+
+void libusb_transport::pollfdAdded(int fd, short events, void* user_data) {
+    libusb_transport* transport = (libusb_transport*)user_data;
+    transport->addPollFd(fd, events);
+}
+
+void libusb_transport::pollfdRemoved(int fd, void* user_data) {
+    libusb_transport* transport = (libusb_transport*)user_data;
+    if (transport->eventLoop != nullptr) {
+        // Devices are opened and closed from other threads than the one running the loop
+        event_loop* loop = transport->eventLoop;
+        loop->post([loop, fd]() {
+            loop->removeFd(fd);
+        });
+    }
+}
+
+void libusb_transport::addPollFd(int fd, short events) {
+    if (eventLoop == nullptr) {
+        return;
+    }
+
+    uint32_t epollEvents = 0;
+    if (events & POLLIN) {
+        epollEvents |= EPOLLIN;
+    }
+
+    if (events & POLLOUT) {
+        epollEvents |= EPOLLOUT;
+    }
+
+    eventLoop->post([this, fd, epollEvents]() {
+        eventLoop->addFd(fd, epollEvents, [this](uint32_t readyEvents) {
+            handleEvents();
+        });
+    });
+}
+
+ssize_t libusb_transport::getDeviceList(libusb_device*** list) {
+    return libusb_get_device_list(context, list);
+}
+
+int libusb_transport::getDeviceDescriptor(libusb_device* device, struct libusb_device_descriptor* descriptor) {
+    return libusb_get_device_descriptor(device, descriptor);
+}
+
+void libusb_transport::refDevice(libusb_device* device) {
+    libusb_ref_device(device);
+}
+
+void libusb_transport::unrefDevice(libusb_device* device) {
+    libusb_unref_device(device);
+}
+
+uint8_t libusb_transport::getBusNumber(libusb_device* device) {
+    return libusb_get_bus_number(device);
+}
+
+int libusb_transport::getPortNumbers(libusb_device* device, uint8_t* portNumbers, int length) {
+    return libusb_get_port_numbers(device, portNumbers, length);
+}
+
+int libusb_transport::getConfigDescriptor(libusb_device* device, uint8_t index,
+                                          struct libusb_config_descriptor** config) {
+    return libusb_get_config_descriptor(device, index, config);
+}
+
+void libusb_transport::freeConfigDescriptor(struct libusb_config_descriptor* config) {
+    libusb_free_config_descriptor(config);
+}
+
+int libusb_transport::registerHotplugCallback(int vendorId, int productId, libusb_hotplug_callback_fn callback,
+                                              void* userData, libusb_hotplug_callback_handle* callbackHandle) {
+    return libusb_hotplug_register_callback(context,
+                                            static_cast<libusb_hotplug_event>(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                                                                              LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+                                            static_cast<libusb_hotplug_flag>(0), vendorId, productId,
+                                            LIBUSB_HOTPLUG_MATCH_ANY, callback, userData, callbackHandle);
+}
+
+void libusb_transport::deregisterHotplugCallback(libusb_hotplug_callback_handle callbackHandle) {
+    libusb_hotplug_deregister_callback(context, callbackHandle);
+}
+
+int libusb_transport::open(libusb_device* device, libusb_device_handle** handle) {
+    return libusb_open(device, handle);
+}
+
+void libusb_transport::close(libusb_device_handle* handle) {
+    libusb_close(handle);
+}
+
+int libusb_transport::kernelDriverActive(libusb_device_handle* handle, int interfaceNumber) {
+    return libusb_kernel_driver_active(handle, interfaceNumber);
+}
+
+int libusb_transport::detachKernelDriver(libusb_device_handle* handle, int interfaceNumber) {
+    return libusb_detach_kernel_driver(handle, interfaceNumber);
+}
+
+int libusb_transport::attachKernelDriver(libusb_device_handle* handle, int interfaceNumber) {
+    return libusb_attach_kernel_driver(handle, interfaceNumber);
+}
+
+int libusb_transport::claimInterface(libusb_device_handle* handle, int interfaceNumber) {
+    return libusb_claim_interface(handle, interfaceNumber);
+}
+
+int libusb_transport::releaseInterface(libusb_device_handle* handle, int interfaceNumber) {
+    return libusb_release_interface(handle, interfaceNumber);
+}
+
+int libusb_transport::getStringDescriptor(libusb_device_handle* handle, uint8_t index, uint16_t langId,
+                                          unsigned char* data, int length) {
+    return libusb_get_string_descriptor(handle, index, langId, data, length);
+}
+
+int libusb_transport::controlTransfer(libusb_device_handle* handle, uint8_t requestType, uint8_t request,
+                                      uint16_t value, uint16_t index, unsigned char* data, uint16_t length,
+                                      unsigned int timeout) {
+    return libusb_control_transfer(handle, requestType, request, value, index, data, length, timeout);
+}
+
+int libusb_transport::interruptTransfer(libusb_device_handle* handle, unsigned char endpoint, unsigned char* data,
+                                        int length, int* transferred, unsigned int timeout) {
+    return libusb_interrupt_transfer(handle, endpoint, data, length, transferred, timeout);
+}
+
+struct libusb_transfer* libusb_transport::allocTransfer() {
+    return libusb_alloc_transfer(0);
+}
+
+void libusb_transport::freeTransfer(struct libusb_transfer* transfer) {
+    libusb_free_transfer(transfer);
+}
+
+int libusb_transport::submitTransfer(struct libusb_transfer* transfer) {
+    return libusb_submit_transfer(transfer);
+}
+
+int libusb_transport::cancelTransfer(struct libusb_transfer* transfer) {
+    return libusb_cancel_transfer(transfer);
+}
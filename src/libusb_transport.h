@@ -0,0 +1,79 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_LIBUSB_TRANSPORT_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_LIBUSB_TRANSPORT_H
+
+#include "usb_transport.h"
+
+// Talks to real hardware through libusb
+class libusb_transport : public usb_transport {
+public:
+    libusb_transport();
+    ~libusb_transport();
+
+    libusb_context* getContext();
+
+    void registerEventSources(event_loop* loop) override;
+    void handleEvents() override;
+    int getNextTimeout() override;
+
+    ssize_t getDeviceList(libusb_device*** list) override;
+    int getDeviceDescriptor(libusb_device* device, struct libusb_device_descriptor* descriptor) override;
+    void refDevice(libusb_device* device) override;
+    void unrefDevice(libusb_device* device) override;
+    uint8_t getBusNumber(libusb_device* device) override;
+    int getPortNumbers(libusb_device* device, uint8_t* portNumbers, int length) override;
+    int getConfigDescriptor(libusb_device* device, uint8_t index, struct libusb_config_descriptor** config) override;
+    void freeConfigDescriptor(struct libusb_config_descriptor* config) override;
+    int registerHotplugCallback(int vendorId, int productId, libusb_hotplug_callback_fn callback, void* userData,
+                                libusb_hotplug_callback_handle* callbackHandle) override;
+    void deregisterHotplugCallback(libusb_hotplug_callback_handle callbackHandle) override;
+
+    int open(libusb_device* device, libusb_device_handle** handle) override;
+    void close(libusb_device_handle* handle) override;
+    int kernelDriverActive(libusb_device_handle* handle, int interfaceNumber) override;
+    int detachKernelDriver(libusb_device_handle* handle, int interfaceNumber) override;
+    int attachKernelDriver(libusb_device_handle* handle, int interfaceNumber) override;
+    int claimInterface(libusb_device_handle* handle, int interfaceNumber) override;
+    int releaseInterface(libusb_device_handle* handle, int interfaceNumber) override;
+
+    int getStringDescriptor(libusb_device_handle* handle, uint8_t index, uint16_t langId, unsigned char* data,
+                            int length) override;
+    int controlTransfer(libusb_device_handle* handle, uint8_t requestType, uint8_t request, uint16_t value,
+                        uint16_t index, unsigned char* data, uint16_t length, unsigned int timeout) override;
+    int interruptTransfer(libusb_device_handle* handle, unsigned char endpoint, unsigned char* data, int length,
+                          int* transferred, unsigned int timeout) override;
+
+    struct libusb_transfer* allocTransfer() override;
+    void freeTransfer(struct libusb_transfer* transfer) override;
+    int submitTransfer(struct libusb_transfer* transfer) override;
+    int cancelTransfer(struct libusb_transfer* transfer) override;
+private:
+    static void LIBUSB_CALL pollfdAdded(int fd, short events, void* user_data);
+    static void LIBUSB_CALL pollfdRemoved(int fd, void* user_data);
+
+    void addPollFd(int fd, short events);
+
+    libusb_context* context = NULL;
+    event_loop* eventLoop = nullptr;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_LIBUSB_TRANSPORT_H
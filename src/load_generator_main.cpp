@@ -0,0 +1,213 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sys/resource.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "event_loop.h"
+#include "usb_devices.h"
+#include "simulated_usb_transport.h"
+#include "xp_pen_handler.h"
+#include "huion_handler.h"
+#include "null_output_sink.h"
+
+// Attaches a growing number of simulated XP-Pen and Huion tablets through the regular vendor and transfer handlers
+// and reports how the daemon keeps up with all of them streaming at once.
+namespace {
+    struct load_result {
+        int tablets;
+        double seconds;
+        unsigned long reports;
+        unsigned long dropped;
+        double cpuSeconds;
+        latency_histogram deliveryLag;
+        latency_histogram pipeline;
+    };
+
+    void printUsage() {
+        std::cout << "Usage: userspace_tablet_driver_loadgen [--tablets <n,n,...>] [--rate <hz>] [--duration <ms>]"
+                     " [--sink null|uinput]" << std::endl;
+        std::cout << "  --tablets   numbers of tablets to run one after the other (default 1,2,4,8,16)" << std::endl;
+        std::cout << "  --rate      reports per second sent by each tablet, at most 1000 (default 1000)" << std::endl;
+        std::cout << "  --duration  how long each run streams for in milliseconds (default 5000)" << std::endl;
+        std::cout << "  --sink      null drops the decoded events, uinput creates real virtual devices"
+                     " (default null)" << std::endl;
+    }
+
+    double cpuSeconds() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+               (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    void runLoad(load_result& result, int rate, long durationMs, bool nullSink) {
+        // The transport unhooks itself from the loop when it goes away, so the loop has to outlive it
+        event_loop loop;
+        simulated_usb_transport transport;
+        null_output_sink sink;
+        usb_devices devices(&transport);
+
+        std::map<short, vendor_handler*> vendorHandlers;
+        for (vendor_handler* handler : std::initializer_list<vendor_handler*>{new xp_pen_handler(),
+                                                                              new huion_handler()}) {
+            handler->setConfig(nlohmann::json({}));
+            handler->setTransport(&transport);
+            handler->setEventLoop(&loop);
+            if (nullSink) {
+                for (auto productId : handler->getProductIds()) {
+                    handler->getProductHandler(productId)->setOutputSink(&sink);
+                }
+            }
+
+            vendorHandlers[handler->getVendorId()] = handler;
+        }
+
+        // Every tablet draws its own strokes so that they don't all hit the same code paths in lockstep
+        uint64_t reportInterval = 1000000000 / rate;
+        std::vector<libusb_device*> plugged;
+        for (int index = 0; index < result.tablets; ++index) {
+            if (index % 2 == 0) {
+                plugged.push_back(transport.plug(simulated_usb_transport::artist22RPro(reportInterval, index)));
+            } else {
+                plugged.push_back(transport.plug(simulated_usb_transport::huionH1161(reportInterval, index)));
+            }
+        }
+
+        devices.getCandidateDevices(vendorHandlers);
+
+        devices.registerEventSources(&loop);
+
+        bool running = true;
+        loop.addTimer(durationMs, [&running]() {
+            running = false;
+        });
+
+        uint64_t start = event_loop::monotonicNow();
+        double cpuStart = cpuSeconds();
+        while (running) {
+            loop.runOnce(devices.getNextTimeout());
+        }
+        result.cpuSeconds = cpuSeconds() - cpuStart;
+        result.seconds = (event_loop::monotonicNow() - start) / 1e9;
+        result.reports = transport.getReportsDelivered();
+        result.dropped = transport.getReportsDropped();
+        result.deliveryLag.add(transport.getDeliveryLag());
+
+        for (auto handler : vendorHandlers) {
+            for (auto context : handler.second->getDeviceContexts()) {
+                result.pipeline.add(context->latency[totalLatency]);
+            }
+        }
+
+        // Tear everything down the way it goes when the tablets get unplugged
+        for (auto device : plugged) {
+            transport.unplug(device);
+        }
+        loop.runOnce(0);
+        for (auto device : plugged) {
+            devices.handleDeviceDetach(vendorHandlers, device);
+        }
+
+        for (auto handler : vendorHandlers) {
+            delete handler.second;
+        }
+    }
+
+    std::string microseconds(uint64_t nanoseconds) {
+        std::stringstream value;
+        value << std::fixed << std::setprecision(1) << nanoseconds / 1000.0;
+
+        return value.str();
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> tabletCounts = {1, 2, 4, 8, 16};
+    int rate = 1000;
+    long durationMs = 5000;
+    std::string sinkName = "null";
+
+    for (int index = 1; index < argc; ++index) {
+        std::string arg = argv[index];
+        if (arg == "--tablets" && index + 1 < argc) {
+            tabletCounts.clear();
+            std::stringstream counts(argv[++index]);
+            std::string count;
+            while (std::getline(counts, count, ',')) {
+                tabletCounts.push_back(std::stoi(count));
+            }
+        } else if (arg == "--rate" && index + 1 < argc) {
+            rate = std::stoi(argv[++index]);
+        } else if (arg == "--duration" && index + 1 < argc) {
+            durationMs = std::stol(argv[++index]);
+        } else if (arg == "--sink" && index + 1 < argc) {
+            sinkName = argv[++index];
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (tabletCounts.empty() || rate < 1 || rate > 1000 || durationMs <= 0 ||
+        (sinkName != "null" && sinkName != "uinput")) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<load_result*> results;
+    for (int tablets : tabletCounts) {
+        if (tablets < 1) {
+            continue;
+        }
+
+        load_result* result = new load_result();
+        result->tablets = tablets;
+        runLoad(*result, rate, durationMs, sinkName == "null");
+        results.push_back(result);
+    }
+
+    // Lag is how late the tablet's reports reached the daemon, pipeline from there until the events were written
+    std::cout << std::endl << std::left
+              << std::setw(9) << "tablets" << std::setw(14) << "reports/sec" << std::setw(10) << "dropped"
+              << std::setw(14) << "cpu%/tablet" << std::setw(12) << "lag p50us" << std::setw(12) << "lag p99us"
+              << std::setw(14) << "pipe p50us" << std::setw(14) << "pipe p99us" << std::setw(14) << "pipe p99.9us"
+              << "pipe max us" << std::endl;
+    for (auto result : results) {
+        std::cout << std::left << std::setw(9) << result->tablets
+                  << std::setw(14) << std::fixed << std::setprecision(0) << result->reports / result->seconds
+                  << std::setw(10) << result->dropped
+                  << std::setw(14) << std::setprecision(2)
+                  << 100.0 * result->cpuSeconds / result->seconds / result->tablets
+                  << std::setw(12) << microseconds(result->deliveryLag.getPercentile(50))
+                  << std::setw(12) << microseconds(result->deliveryLag.getPercentile(99))
+                  << std::setw(14) << microseconds(result->pipeline.getPercentile(50))
+                  << std::setw(14) << microseconds(result->pipeline.getPercentile(99))
+                  << std::setw(14) << microseconds(result->pipeline.getPercentile(99.9))
+                  << microseconds(result->pipeline.getMax()) << std::endl;
+        delete result;
+    }
+
+    return 0;
+}
@@ -16,10 +16,21 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string>
 #include "event_handler.h"
+#include "daemon_handoff.h"
 
-int main() {
-    event_handler* eventHandler = new event_handler();
+int main(int argc, char** argv) {
+    std::vector<handed_off_device> handedOff;
+    for (int index = 1; index < argc; ++index) {
+        std::string arg = argv[index];
+        // Take over the virtual devices of a daemon that is already running, which then exits
+        if (arg == "--takeover") {
+            handedOff = daemon_handoff::requestHandOff();
+        }
+    }
+
+    event_handler* eventHandler = new event_handler(handedOff);
     eventHandler->run();
     delete eventHandler;
 }
@@ -0,0 +1,104 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include "memory_output_sink.h"
+
+memory_output_sink::memory_output_sink(size_t requestedCapacity)
+: fd(-1), ring(nullptr), capacity(1), head(0), nextDevice(0) {
+    while (capacity < requestedCapacity) {
+        capacity <<= 1;
+    }
+
+    fd = memfd_create("userspace_tablet_driver_events", MFD_CLOEXEC);
+    if (fd < 0) {
+        std::cout << "Could not create event recording memfd errno: " << errno << std::endl;
+        throw std::bad_alloc();
+    }
+
+    size_t length = capacity * sizeof(recorded_input_event);
+    if (ftruncate(fd, length) < 0) {
+        std::cout << "Could not size event recording memfd errno: " << errno << std::endl;
+        close(fd);
+        throw std::bad_alloc();
+    }
+
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        std::cout << "Could not map event recording memfd errno: " << errno << std::endl;
+        close(fd);
+        throw std::bad_alloc();
+    }
+
+    ring = (recorded_input_event*)mapping;
+}
+
+memory_output_sink::~memory_output_sink() {
+    munmap(ring, capacity * sizeof(recorded_input_event));
+    close(fd);
+}
+
+int memory_output_sink::createPen(const uinput_pen_args& penArgs) {
+    return nextDevice++;
+}
+
+int memory_output_sink::createPad(const uinput_pad_args& padArgs) {
+    return nextDevice++;
+}
+
+int memory_output_sink::createPointer(const uinput_pointer_args& pointerArgs) {
+    return nextDevice++;
+}
+
+bool memory_output_sink::write(int device, const struct input_event* events, size_t count) {
+    for (size_t index = 0; index < count; ++index) {
+        recorded_input_event& recorded = ring[head++ & (capacity - 1)];
+        recorded.device = device;
+        recorded.event = events[index];
+    }
+
+    return true;
+}
+
+void memory_output_sink::destroyDevice(int device) {
+
+}
+
+int memory_output_sink::getFd() const {
+    return fd;
+}
+
+size_t memory_output_sink::getCapacity() const {
+    return capacity;
+}
+
+uint64_t memory_output_sink::getEventsWritten() const {
+    return head;
+}
+
+uint64_t memory_output_sink::getOldestEvent() const {
+    return head > capacity ? head - capacity : 0;
+}
+
+const recorded_input_event& memory_output_sink::getEvent(uint64_t index) const {
+    return ring[index & (capacity - 1)];
+}
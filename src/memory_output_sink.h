@@ -0,0 +1,63 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_MEMORY_OUTPUT_SINK_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_MEMORY_OUTPUT_SINK_H
+
+#include <cstdint>
+#include "output_sink.h"
+
+struct recorded_input_event {
+    int32_t device;
+    struct input_event event;
+};
+
+// Records events into a ring buffer living in a memfd. The buffer is mapped once up front so recording an event is
+// a plain copy without any syscall. Once the ring is full the oldest events get overwritten.
+class memory_output_sink : public output_sink {
+public:
+    // The capacity is rounded up to a power of two
+    explicit memory_output_sink(size_t capacity = 1 << 20);
+    ~memory_output_sink();
+
+    int createPen(const uinput_pen_args& penArgs) override;
+    int createPad(const uinput_pad_args& padArgs) override;
+    int createPointer(const uinput_pointer_args& pointerArgs) override;
+
+    bool write(int device, const struct input_event* events, size_t count) override;
+    void destroyDevice(int device) override;
+
+    // The memfd holding the ring, which can be handed to another process to read the recording
+    int getFd() const;
+    size_t getCapacity() const;
+    // Total events written since creation, including any that were overwritten since
+    uint64_t getEventsWritten() const;
+    // Index of the oldest event still held, events are readable from here up to getEventsWritten()
+    uint64_t getOldestEvent() const;
+    const recorded_input_event& getEvent(uint64_t index) const;
+private:
+    int fd;
+    recorded_input_event* ring;
+    size_t capacity;
+    uint64_t head;
+    int nextDevice;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_MEMORY_OUTPUT_SINK_H
@@ -0,0 +1,121 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "message_pool.h"
+
+void message_releaser::operator()(unix_socket_message* message) const {
+    pool->release(message);
+}
+
+message_pool::message_pool() : acquired(0), released(0), allocations(0) {
+    // Releasing must not allocate either
+    for (int index = 0; index < sizeCount; ++index) {
+        freeSlots[index].reserve(maxFreeSlots(index));
+    }
+}
+
+message_pool::~message_pool() {
+    for (auto& slots : freeSlots) {
+        for (auto slot : slots) {
+            delete[] slot->message.data;
+            delete slot;
+        }
+    }
+}
+
+pooled_message message_pool::acquire(size_t dataLength) {
+    int index = sizeIndex(dataLength);
+    pooled_slot* slot = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        acquired++;
+        if (index >= 0 && !freeSlots[index].empty()) {
+            slot = freeSlots[index].back();
+            freeSlots[index].pop_back();
+        } else {
+            allocations += 2;
+        }
+    }
+
+    if (slot == nullptr) {
+        slot = new pooled_slot();
+        slot->capacity = index >= 0 ? smallestBuffer << index : dataLength;
+        slot->message.data = new unsigned char[slot->capacity];
+    }
+
+    unsigned char* data = slot->message.data;
+    slot->message = unix_socket_message();
+    slot->message.data = data;
+    slot->message.length = dataLength;
+
+    return adopt(&slot->message);
+}
+
+pooled_message message_pool::adopt(unix_socket_message* message) {
+    return pooled_message(message, message_releaser{this});
+}
+
+void message_pool::release(unix_socket_message* message) {
+    pooled_slot* slot = reinterpret_cast<pooled_slot*>(message);
+    int index = sizeIndex(slot->capacity);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        released++;
+        if (index >= 0 && freeSlots[index].size() < maxFreeSlots(index)) {
+            freeSlots[index].push_back(slot);
+            return;
+        }
+    }
+
+    delete[] slot->message.data;
+    delete slot;
+}
+
+unsigned long message_pool::getAcquired() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return acquired;
+}
+
+unsigned long message_pool::getAllocations() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocations;
+}
+
+unsigned long message_pool::getOutstanding() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return acquired - released;
+}
+
+int message_pool::sizeIndex(size_t length) {
+    if (length > largestBuffer) {
+        return -1;
+    }
+
+    int index = 0;
+    while ((smallestBuffer << index) < length) {
+        index++;
+    }
+
+    return index;
+}
+
+size_t message_pool::maxFreeSlots(int index) {
+    return maxFreeBytesPerSize / (smallestBuffer << index);
+}
@@ -0,0 +1,82 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_MESSAGE_POOL_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_MESSAGE_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "unix_socket_message.h"
+
+class message_pool;
+
+// Hands a message back to the pool it came from instead of freeing it
+struct message_releaser {
+    message_pool* pool = nullptr;
+
+    void operator()(unix_socket_message* message) const;
+};
+
+typedef std::unique_ptr<unix_socket_message, message_releaser> pooled_message;
+
+// Keeps messages along with their data buffers for reuse, so that once it has warmed up passing messages around
+// doesn't touch the heap. Buffers come in powers of two from smallestBuffer to largestBuffer, anything bigger is
+// allocated for the one message. Can be used from any thread.
+class message_pool {
+public:
+    message_pool();
+    ~message_pool();
+
+    // A cleared message with room for dataLength bytes of data and its length set to that
+    pooled_message acquire(size_t dataLength);
+    // Takes ownership of a message of this pool again after it went through somewhere as a plain pointer
+    pooled_message adopt(unix_socket_message* message);
+    void release(unix_socket_message* message);
+
+    unsigned long getAcquired();
+    // Messages and buffers that had to be allocated since nothing fitting was free
+    unsigned long getAllocations();
+    unsigned long getOutstanding();
+
+    static const size_t smallestBuffer = 64;
+    static const size_t largestBuffer = 65536;
+    // Memory kept in free messages of each buffer size, the rest of a burst goes back to the heap
+    static const size_t maxFreeBytesPerSize = 262144;
+private:
+    // The message comes first so that the slot can be found from the message handed out
+    struct pooled_slot {
+        unix_socket_message message;
+        size_t capacity;
+    };
+
+    static const int sizeCount = 11;
+    // The size a buffer of the given length is taken from, -1 when it is too big to be pooled
+    static int sizeIndex(size_t length);
+    static size_t maxFreeSlots(int index);
+
+    std::mutex mutex;
+    std::vector<pooled_slot*> freeSlots[sizeCount];
+    unsigned long acquired;
+    unsigned long released;
+    unsigned long allocations;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_MESSAGE_POOL_H
@@ -0,0 +1,101 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_MPSC_QUEUE_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue that any number of threads may push to while a single thread pops. Every slot carries a
+// sequence number telling whose turn it is: producers claim a slot by advancing the tail and publish it by bumping its
+// sequence, and the consumer hands it back for the next lap the same way.
+template <typename T, size_t Capacity>
+class mpsc_queue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+public:
+    mpsc_queue() : head(0), tail(0) {
+        for (size_t index = 0; index < Capacity; ++index) {
+            slots[index].sequence.store(index, std::memory_order_relaxed);
+        }
+    }
+
+    // Producer side, safe from any thread. False when the queue is full.
+    bool push(const T& value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        slot* claimed;
+        while (true) {
+            claimed = &slots[position & (Capacity - 1)];
+            size_t sequence = claimed->sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (sequence < position) {
+                // The consumer hasn't handed this slot back from the previous lap yet
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        claimed->value = value;
+        claimed->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, false when the queue is empty or the next value is still being written by its producer
+    bool pop(T& value) {
+        size_t position = head.load(std::memory_order_relaxed);
+        slot& next = slots[position & (Capacity - 1)];
+        if (next.sequence.load(std::memory_order_acquire) != position + 1) {
+            return false;
+        }
+
+        value = next.value;
+        next.sequence.store(position + Capacity, std::memory_order_release);
+        head.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer side, appends everything published so far in one go and returns how many that were
+    size_t popAll(std::vector<T>& values) {
+        size_t popped = 0;
+        T value;
+        while (pop(value)) {
+            values.push_back(value);
+            popped++;
+        }
+
+        return popped;
+    }
+private:
+    struct slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Keep the two indexes on their own cache lines so the threads don't keep stealing them from each other
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) slot slots[Capacity];
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_MPSC_QUEUE_H
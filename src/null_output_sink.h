@@ -0,0 +1,53 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_NULL_OUTPUT_SINK_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_NULL_OUTPUT_SINK_H
+
+#include "output_sink.h"
+
+// Throws every event away, only counting them, so that decoding can be measured on its own
+class null_output_sink : public output_sink {
+public:
+    int createPen(const uinput_pen_args& penArgs) override { return createDevice(); }
+    int createPad(const uinput_pad_args& padArgs) override { return createDevice(); }
+    int createPointer(const uinput_pointer_args& pointerArgs) override { return createDevice(); }
+
+    bool write(int device, const struct input_event* events, size_t count) override {
+        eventsWritten += count;
+        return true;
+    }
+
+    void destroyDevice(int device) override { liveDevices--; }
+
+    unsigned long getEventsWritten() const { return eventsWritten; }
+    int getDevicesCreated() const { return nextDevice; }
+    int getLiveDevices() const { return liveDevices; }
+private:
+    int createDevice() {
+        liveDevices++;
+        return nextDevice++;
+    }
+
+    int nextDevice = 0;
+    int liveDevices = 0;
+    unsigned long eventsWritten = 0;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_NULL_OUTPUT_SINK_H
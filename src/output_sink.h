@@ -0,0 +1,51 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_OUTPUT_SINK_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_OUTPUT_SINK_H
+
+#include <linux/input.h>
+#include <cstddef>
+#include "uinput_pen_args.h"
+#include "uinput_pad_args.h"
+#include "uinput_pointer_args.h"
+
+// Creates the virtual devices of attached tablets and receives the events decoded for them. Devices are identified
+// by whatever non-negative number the sink hands out, -1 means the device could not be created.
+class output_sink {
+public:
+    virtual ~output_sink() = default;
+
+    virtual int createPen(const uinput_pen_args& penArgs) = 0;
+    virtual int createPad(const uinput_pad_args& padArgs) = 0;
+    virtual int createPointer(const uinput_pointer_args& pointerArgs) = 0;
+
+    // Receives every event of one report for one device at once
+    virtual bool write(int device, const struct input_event* events, size_t count) = 0;
+    virtual void destroyDevice(int device) = 0;
+
+    // Devices that can outlive the process are handed to another one as an fd, -1 when this sink can't do that
+    virtual int exportDevice(int device) { return -1; }
+    // Takes over a device exported by another process
+    virtual int adoptDevice(int fd) { return -1; }
+    // Lets go of a device without destroying it, once it is exported
+    virtual void releaseDevice(int device) { destroyDevice(device); }
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_OUTPUT_SINK_H
@@ -17,27 +17,60 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <linux/input.h>
+#include <algorithm>
 #include "pad_mapping.h"
 
-pad_mapping::pad_mapping() {
+pad_mapping::pad_mapping()
+: firstCompiledCode(0) {
 
 }
 
-std::vector<aliased_input_event> pad_mapping::getPadMap(int eventCode) {
-    auto record = eventPadMap.find(eventCode);
-    if (record != eventPadMap.end()) {
-        return eventPadMap.at(eventCode);
+aliased_input_event_span pad_mapping::getPadMap(int eventCode) const {
+    unsigned int index = eventCode - firstCompiledCode;
+    if (index >= compiledSpans.size()) {
+        return aliased_input_event_span { nullptr, nullptr };
     }
 
-    std::vector<aliased_input_event> temp;
-    aliased_input_event tempEvent {
-        EV_KEY, eventCode
+    const span_offsets& offsets = compiledSpans[index];
+    return aliased_input_event_span {
+        compiledEvents.data() + offsets.first,
+        compiledEvents.data() + offsets.last
     };
-    temp.push_back(tempEvent);
-
-    return temp;
 }
 
 void pad_mapping::setPadMap(int eventCode, const std::vector<aliased_input_event> &events) {
     eventPadMap[eventCode] = events;
 }
+
+void pad_mapping::compile(const std::vector<int>& buttonCodes) {
+    compiledEvents.clear();
+    compiledSpans.clear();
+
+    if (buttonCodes.empty() && eventPadMap.empty()) {
+        return;
+    }
+
+    int lowestCode = eventPadMap.empty() ? buttonCodes.front() : eventPadMap.begin()->first;
+    int highestCode = eventPadMap.empty() ? buttonCodes.front() : eventPadMap.rbegin()->first;
+    for (auto code : buttonCodes) {
+        lowestCode = std::min(lowestCode, code);
+        highestCode = std::max(highestCode, code);
+    }
+
+    firstCompiledCode = lowestCode;
+    compiledSpans.resize(highestCode - lowestCode + 1);
+
+    for (int code = lowestCode; code <= highestCode; ++code) {
+        span_offsets& offsets = compiledSpans[code - lowestCode];
+        offsets.first = compiledEvents.size();
+
+        auto record = eventPadMap.find(code);
+        if (record != eventPadMap.end()) {
+            compiledEvents.insert(compiledEvents.end(), record->second.begin(), record->second.end());
+        } else {
+            compiledEvents.push_back(aliased_input_event { EV_KEY, code });
+        }
+
+        offsets.last = compiledEvents.size();
+    }
+}
@@ -28,10 +28,22 @@ class pad_mapping {
 public:
     pad_mapping();
 
-    std::vector<aliased_input_event> getPadMap(int eventCode);
+    aliased_input_event_span getPadMap(int eventCode) const;
     void setPadMap(int eventCode, const std::vector<aliased_input_event>& events);
+
+    // Flattens the mappings into a table indexed by button code. Buttons without a mapping send their own code.
+    void compile(const std::vector<int>& buttonCodes);
 private:
+    struct span_offsets {
+        unsigned int first;
+        unsigned int last;
+    };
+
     std::map<int, std::vector<aliased_input_event> > eventPadMap;
+
+    std::vector<aliased_input_event> compiledEvents;
+    std::vector<span_offsets> compiledSpans;
+    int firstCompiledCode;
 };
 
 
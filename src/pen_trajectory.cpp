@@ -0,0 +1,115 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include "pen_trajectory.h"
+
+namespace {
+    pen_sample penSample(double x, double y, int maxX, int maxY) {
+        pen_sample sample = pen_sample();
+        sample.x = std::min(std::max((int)x, 0), maxX);
+        sample.y = std::min(std::max((int)y, 0), maxY);
+
+        return sample;
+    }
+
+    pen_sample frameSample(unsigned int padButtons, int dial) {
+        pen_sample sample = pen_sample();
+        sample.frame = true;
+        sample.padButtons = padButtons;
+        sample.dial = dial;
+
+        return sample;
+    }
+}
+
+std::vector<pen_sample> pen_trajectory::session(unsigned int seed, int reportRate, int maxX, int maxY,
+                                                int maxPressure) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::normal_distribution<double> jitter(0.0, 1.0);
+    std::vector<pen_sample> samples;
+    int rate = std::max(reportRate, 1);
+
+    for (int stroke = 0; stroke < 4; ++stroke) {
+        double startX = maxX * (0.1 + 0.6 * unit(random));
+        double startY = maxY * (0.1 + 0.6 * unit(random));
+        double lengthX = maxX * (0.05 + 0.2 * unit(random));
+        double amplitudeY = maxY * (0.02 + 0.08 * unit(random));
+        double waves = 0.5 + 2.0 * unit(random);
+
+        // Hover in towards where the stroke starts
+        int hoverLength = std::max(rate / 10, 2);
+        for (int index = 0; index < hoverLength; ++index) {
+            double distance = 1.0 - (double)index / hoverLength;
+            pen_sample sample = penSample(startX - distance * maxX * 0.02, startY - distance * maxY * 0.02, maxX, maxY);
+            sample.tiltX = -20;
+            sample.tiltY = 10;
+            samples.push_back(sample);
+        }
+
+        // Draw, with the pressure ramping up after touch down and back off before lifting
+        int strokeLength = std::max((int)(rate * (0.3 + 0.4 * unit(random))), 4);
+        for (int index = 0; index < strokeLength; ++index) {
+            double progress = (double)index / (strokeLength - 1);
+            double envelope = std::min(1.0, std::min(progress / 0.1, (1.0 - progress) / 0.15));
+            double pressure = envelope * (0.6 + 0.3 * std::sin(3 * M_PI * progress)) * maxPressure;
+
+            pen_sample sample = penSample(startX + lengthX * progress + jitter(random) * 2,
+                                          startY + amplitudeY * std::sin(2 * M_PI * waves * progress) +
+                                          jitter(random) * 2, maxX, maxY);
+            sample.touching = true;
+            sample.pressure = std::min(std::max((int)(pressure + jitter(random) * 8), 1), maxPressure);
+            sample.tiltX = (int)(-20 + 40 * progress);
+            sample.tiltY = (int)(10 * std::cos(2 * M_PI * progress));
+            samples.push_back(sample);
+        }
+
+        // Lift off and hover away, panning with the lower stylus button held after the last stroke
+        pen_sample last = samples.back();
+        int liftLength = stroke == 3 ? std::max(rate / 4, 2) : std::max(rate / 20, 2);
+        for (int index = 0; index < liftLength; ++index) {
+            double progress = (double)index / liftLength;
+            pen_sample sample = penSample(last.x - progress * maxX * 0.05, last.y + progress * maxY * 0.05,
+                                          maxX, maxY);
+            sample.tiltX = last.tiltX;
+            sample.tiltY = last.tiltY;
+            sample.stylusButton = stroke == 3 ? 1 : 0;
+            samples.push_back(sample);
+        }
+    }
+
+    // A chord of the first two pad buttons, then let go
+    samples.push_back(frameSample(0x03, 0));
+    samples.push_back(frameSample(0x00, 0));
+
+    // Spin each dial a dozen steps one way and back again
+    for (int dial = 1; dial <= 2; ++dial) {
+        for (int direction : {1, -1}) {
+            for (int step = 0; step < 12; ++step) {
+                samples.push_back(frameSample(0x00, dial * direction));
+            }
+        }
+    }
+    samples.push_back(frameSample(0x00, 0));
+
+    return samples;
+}
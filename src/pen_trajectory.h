@@ -0,0 +1,52 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_PEN_TRAJECTORY_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_PEN_TRAJECTORY_H
+
+#include <vector>
+
+// The state of the tablet carried by a single report
+struct pen_sample {
+    // Frame samples carry the pad buttons and dials, all others the pen
+    bool frame;
+    bool touching;
+    int x;
+    int y;
+    int pressure;
+    int tiltX;
+    int tiltY;
+    // 0 for none, 1 for the lower and 2 for the upper stylus button
+    int stylusButton;
+    unsigned int padButtons;
+    // 1 or -1 for a step of the first dial, 2 or -2 for a step of the second one, 0 for none
+    int dial;
+};
+
+// Generates what someone working on a tablet sends, sampled at the report rate of the device
+class pen_trajectory {
+public:
+    // A couple of seconds of hovering in, drawing strokes with varying pressure and tilt, panning with a stylus button
+    // held, pressing a pad button chord and spinning both dials back and forth. The seed varies where the strokes go
+    // and what they look like.
+    static std::vector<pen_sample> session(unsigned int seed, int reportRate, int maxX, int maxY, int maxPressure);
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_PEN_TRAJECTORY_H
@@ -0,0 +1,188 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <alloca.h>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <iostream>
+#include "realtime_settings.h"
+
+namespace {
+    const int maxPrefaultStackKb = 4096;
+
+    // Touches every page of the next kb kilobytes of the stack. Kept out of line so that the frame goes away again
+    // once it returns, the pages stay mapped.
+    __attribute__((noinline)) void prefaultStack(int kb) {
+        size_t size = (size_t)kb * 1024;
+        volatile unsigned char* stack = (volatile unsigned char*)alloca(size);
+        for (size_t offset = 0; offset < size; offset += 4096) {
+            stack[offset] = 0;
+        }
+    }
+}
+
+realtime_settings realtime_settings::fromJson(const nlohmann::json& config) {
+    realtime_settings settings;
+    if (!config.is_object()) {
+        return settings;
+    }
+
+    if (config.contains("cpus") && config["cpus"].is_array()) {
+        for (auto& cpu : config["cpus"]) {
+            if (cpu.is_number_integer()) {
+                settings.cpus.push_back(cpu);
+            }
+        }
+    }
+
+    if (config.contains("policy") && config["policy"].is_string()) {
+        settings.policy = config["policy"];
+    }
+
+    if (config.contains("priority") && config["priority"].is_number_integer()) {
+        settings.priority = config["priority"];
+    }
+
+    if (config.contains("lockMemory") && config["lockMemory"].is_boolean()) {
+        settings.lockMemory = config["lockMemory"];
+    }
+
+    if (config.contains("prefaultStackKb") && config["prefaultStackKb"].is_number_integer()) {
+        settings.prefaultStackKb = config["prefaultStackKb"];
+    }
+
+    return settings;
+}
+
+nlohmann::json realtime_settings::defaultJson() {
+    return {
+            {"cpus", nlohmann::json::array()},
+            {"policy", "other"},
+            {"priority", 0},
+            {"lockMemory", false},
+            {"prefaultStackKb", 0}
+    };
+}
+
+realtime_status realtime_settings::apply(const realtime_status& previous) const {
+    realtime_status status;
+
+    // CPU affinity, an empty set lets the thread run anywhere again
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (cpus.empty()) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &cpuSet);
+        }
+    } else {
+        status.requested |= realtime_status::cpuAffinity;
+        for (auto cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &cpuSet);
+            }
+        }
+    }
+
+    // Leave the affinity the daemon was started with alone unless we changed it before
+    int err = 0;
+    if (!cpus.empty() || (previous.applied & realtime_status::cpuAffinity)) {
+        err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    }
+
+    if (err == 0) {
+        if (!cpus.empty()) {
+            status.applied |= realtime_status::cpuAffinity;
+        }
+    } else {
+        std::cout << "Could not change the CPUs of the data plane errno: " << err << std::endl;
+    }
+
+    // Scheduling policy
+    int requestedPolicy = SCHED_OTHER;
+    if (policy == "fifo") {
+        requestedPolicy = SCHED_FIFO;
+    } else if (policy == "rr") {
+        requestedPolicy = SCHED_RR;
+    } else if (policy != "other") {
+        std::cout << "Unknown scheduling policy " << policy << ", using other" << std::endl;
+    }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    if (requestedPolicy != SCHED_OTHER) {
+        status.requested |= realtime_status::scheduling;
+        param.sched_priority = std::min(std::max(priority, sched_get_priority_min(requestedPolicy)),
+                                        sched_get_priority_max(requestedPolicy));
+    }
+
+    err = pthread_setschedparam(pthread_self(), requestedPolicy, &param);
+    if (err == 0) {
+        if (requestedPolicy != SCHED_OTHER) {
+            status.applied |= realtime_status::scheduling;
+        }
+    } else {
+        std::cout << "Could not switch the data plane to the " << policy << " scheduling policy errno: " << err
+                  << ". Is CAP_SYS_NICE or an rtprio limit set up?" << std::endl;
+    }
+
+    int currentPolicy;
+    if (pthread_getschedparam(pthread_self(), &currentPolicy, &param) == 0) {
+        status.policy = currentPolicy;
+        status.priority = param.sched_priority;
+    }
+
+    // Memory locking covers the whole process, so only touch it when the setting changes
+    if (lockMemory) {
+        status.requested |= realtime_status::memoryLock;
+        if (previous.applied & realtime_status::memoryLock) {
+            status.applied |= realtime_status::memoryLock;
+        } else if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+            status.applied |= realtime_status::memoryLock;
+        } else {
+            std::cout << "Could not lock the daemon's memory errno: " << errno
+                      << ". Is CAP_IPC_LOCK or a memlock limit set up?" << std::endl;
+        }
+    } else if (previous.applied & realtime_status::memoryLock) {
+        munlockall();
+    }
+
+    // Locked or not, faulting the stack in now keeps page faults off the report path
+    if (prefaultStackKb > 0) {
+        // Stay well inside the default 8MB thread stack
+        int kb = std::min(prefaultStackKb, maxPrefaultStackKb);
+        status.requested |= realtime_status::stackPrefault;
+        prefaultStack(kb);
+        status.applied |= realtime_status::stackPrefault;
+        status.prefaultedStackKb = kb;
+    }
+
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &cpuSet)) {
+                status.cpus.push_back(cpu);
+            }
+        }
+    }
+
+    return status;
+}
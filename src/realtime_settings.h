@@ -0,0 +1,65 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_REALTIME_SETTINGS_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_REALTIME_SETTINGS_H
+
+#include <vector>
+#include <string>
+#include "includes/json.hpp"
+
+// What the realtime options of the data plane ended up as. Each option is only marked applied once the kernel accepted
+// it, anything missing privileges stays at its default.
+struct realtime_status {
+    static const unsigned char cpuAffinity = 0x01;
+    static const unsigned char scheduling = 0x02;
+    static const unsigned char memoryLock = 0x04;
+    static const unsigned char stackPrefault = 0x08;
+
+    unsigned char requested = 0;
+    unsigned char applied = 0;
+    // Scheduling policy and priority the thread runs with
+    int policy = 0;
+    int priority = 0;
+    int prefaultedStackKb = 0;
+    // The CPUs the thread may run on
+    std::vector<unsigned short> cpus;
+};
+
+// The realtime section of daemonSettings, applied to the data plane thread
+class realtime_settings {
+public:
+    static realtime_settings fromJson(const nlohmann::json& config);
+    static nlohmann::json defaultJson();
+
+    // Applies everything to the calling thread, falling back to the defaults for whatever isn't permitted
+    realtime_status apply(const realtime_status& previous) const;
+
+    // CPUs to pin the thread to, all of them when empty
+    std::vector<int> cpus;
+    // "other", "fifo" or "rr"
+    std::string policy = "other";
+    int priority = 0;
+    bool lockMemory = false;
+    // How much of the thread's stack to touch up front so that it is never faulted in while handling a report
+    int prefaultStackKb = 0;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_REALTIME_SETTINGS_H
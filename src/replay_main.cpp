@@ -0,0 +1,225 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <ctime>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <string>
+#include "report_capture.h"
+#include "event_loop.h"
+#include "xp_pen_handler.h"
+#include "huion_handler.h"
+#include "null_output_sink.h"
+#include "memory_output_sink.h"
+
+// Feeds a capture recorded by the daemon back through the same decoders, either paced like the original or as fast
+// as possible, optionally writing every emitted input_event to a file so that two runs can be diffed.
+namespace {
+    void printUsage() {
+        std::cout << "Usage: userspace_tablet_driver_replay [--speed <factor>] [--sink null|memory] [--events <file>]"
+                     " [--config <driver.cfg>] <capture>" << std::endl;
+        std::cout << "  --speed    1 replays at the original pace, 2 twice as fast and so on, 0 as fast as possible"
+                     " (default 1)" << std::endl;
+        std::cout << "  --sink     where the decoded events go, null drops them and memory records them (default null)"
+                  << std::endl;
+        std::cout << "  --events   write the recorded input events to this file, implies --sink memory" << std::endl;
+        std::cout << "  --config   apply the device configuration from this driver.cfg" << std::endl;
+    }
+
+    void sleepUntil(uint64_t deadline) {
+        struct timespec wakeup;
+        wakeup.tv_sec = deadline / 1000000000;
+        wakeup.tv_nsec = deadline % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, nullptr) == EINTR) {
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    double speed = 1.0;
+    std::string sinkName = "null";
+    std::string eventsPath;
+    std::string configPath;
+    std::string capturePath;
+
+    for (int index = 1; index < argc; ++index) {
+        std::string arg = argv[index];
+        if (arg == "--speed" && index + 1 < argc) {
+            speed = std::stod(argv[++index]);
+        } else if (arg == "--sink" && index + 1 < argc) {
+            sinkName = argv[++index];
+        } else if (arg == "--events" && index + 1 < argc) {
+            eventsPath = argv[++index];
+            sinkName = "memory";
+        } else if (arg == "--config" && index + 1 < argc) {
+            configPath = argv[++index];
+        } else if (arg[0] != '-' && capturePath.empty()) {
+            capturePath = arg;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (capturePath.empty() || speed < 0 || (sinkName != "null" && sinkName != "memory")) {
+        printUsage();
+        return 1;
+    }
+
+    report_capture_reader reader;
+    if (!reader.open(capturePath)) {
+        return 1;
+    }
+
+    // Replaying never creates real uinput devices since the capture has none of the descriptors they need
+    null_output_sink nullSink;
+    memory_output_sink* memorySink = nullptr;
+    output_sink* sink = &nullSink;
+    if (sinkName == "memory") {
+        memorySink = new memory_output_sink();
+        sink = memorySink;
+    }
+
+    nlohmann::json driverConfigJson;
+    if (!configPath.empty()) {
+        std::ifstream driverConfig(configPath, std::ifstream::in);
+        try {
+            driverConfig >> driverConfigJson;
+        } catch (const nlohmann::detail::parse_error&) {
+            std::cout << "Could not parse " << configPath << ", using the default configuration" << std::endl;
+        }
+    }
+
+    std::map<short, vendor_handler*> vendorHandlers;
+    for (vendor_handler* handler : std::initializer_list<vendor_handler*>{new xp_pen_handler(), new huion_handler()}) {
+        vendorHandlers[handler->getVendorId()] = handler;
+        auto vendorIdString = std::to_string(handler->getVendorId());
+        if (driverConfigJson.contains("deviceConfigurations") &&
+            driverConfigJson["deviceConfigurations"].contains(vendorIdString)) {
+            handler->setConfig(driverConfigJson["deviceConfigurations"][vendorIdString]);
+        }
+    }
+
+    // Every vendor and product pair in the capture gets its own stand-in device
+    std::map<uint32_t, device_context*> contexts;
+    std::map<uint32_t, transfer_handler*> productHandlers;
+    unsigned long replayed = 0;
+    unsigned long undecoded = 0;
+    unsigned long skipped = 0;
+
+    captured_report report;
+    uint64_t firstTimestamp = 0;
+    uint64_t replayStart = event_loop::monotonicNow();
+    while (reader.next(report)) {
+        uint32_t deviceKey = (report.vendorId << 16) | report.productId;
+        auto contextRecord = contexts.find(deviceKey);
+        if (contextRecord == contexts.end()) {
+            transfer_handler* productHandler = nullptr;
+            auto vendorRecord = vendorHandlers.find(report.vendorId);
+            if (vendorRecord != vendorHandlers.end()) {
+                productHandler = vendorRecord->second->getProductHandler(report.productId);
+            }
+
+            device_context* context = nullptr;
+            if (productHandler != nullptr) {
+                auto productString = std::to_string(report.productId);
+                productHandler->setConfig(vendorRecord->second->getConfig()[productString]);
+
+                productHandler->setOutputSink(sink);
+                context = productHandler->getDeviceContext(reinterpret_cast<libusb_device_handle*>(
+                        (uintptr_t)deviceKey));
+                context->productId = report.productId;
+                context->penEvents.setDevice(sink->createPen(uinput_pen_args()));
+                context->padEvents.setDevice(sink->createPad(uinput_pad_args()));
+                context->pointerEvents.setDevice(sink->createPointer(uinput_pointer_args()));
+            } else {
+                std::cout << std::hex << "No handler for " << report.vendorId << ":" << report.productId << std::dec
+                          << ", skipping its reports" << std::endl;
+            }
+
+            productHandlers[deviceKey] = productHandler;
+            contextRecord = contexts.insert({deviceKey, context}).first;
+        }
+
+        if (contextRecord->second == nullptr) {
+            skipped++;
+            continue;
+        }
+
+        if (replayed == 0) {
+            firstTimestamp = report.timestamp;
+        }
+
+        uint64_t completedAt = event_loop::monotonicNow();
+        if (speed > 0) {
+            uint64_t deadline = replayStart + (uint64_t)((report.timestamp - firstTimestamp) / speed);
+            if (deadline > completedAt) {
+                sleepUntil(deadline);
+                completedAt = deadline;
+            }
+        }
+
+        if (!productHandlers[deviceKey]->processTransfer(contextRecord->second, (unsigned char*)report.data,
+                                                         report.length, completedAt)) {
+            undecoded++;
+        }
+        replayed++;
+    }
+    uint64_t elapsed = event_loop::monotonicNow() - replayStart;
+
+    std::cout << "Replayed " << replayed << " reports in " << elapsed / 1000000.0 << " ms" << std::endl;
+    std::cout << "  undecoded reports: " << undecoded << std::endl;
+    std::cout << "  skipped reports: " << skipped << std::endl;
+    if (replayed > 0 && elapsed > 0) {
+        std::cout << "  reports/sec: " << replayed * 1000000000.0 / elapsed << std::endl;
+        std::cout << "  ns/report: " << (double)elapsed / replayed << std::endl;
+    }
+
+    int result = 0;
+    if (memorySink != nullptr) {
+        uint64_t oldest = memorySink->getOldestEvent();
+        uint64_t written = memorySink->getEventsWritten();
+        std::cout << "  events recorded: " << written << std::endl;
+        if (oldest > 0) {
+            std::cout << "  events overwritten: " << oldest << std::endl;
+        }
+
+        if (!eventsPath.empty()) {
+            std::ofstream events(eventsPath, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+            for (uint64_t index = oldest; index < written; ++index) {
+                events.write((const char*)&memorySink->getEvent(index), sizeof(recorded_input_event));
+            }
+
+            if (!events) {
+                std::cout << "Could not write " << eventsPath << std::endl;
+                result = 1;
+            }
+        }
+    }
+
+    // The stand-in devices write to the sinks, so the handlers go first
+    for (auto handler : vendorHandlers) {
+        delete handler.second;
+    }
+    delete memorySink;
+
+    return result;
+}
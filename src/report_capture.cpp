@@ -0,0 +1,292 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include "report_capture.h"
+#include "event_loop.h"
+
+namespace {
+    const size_t initialCapacity = 1024 * 1024;
+    // Two varints of a short, the endpoint, a 64 bit varint and the length varint
+    const size_t maxRecordOverhead = 3 + 3 + 1 + 10 + 10;
+
+    unsigned char* writeVarint(unsigned char* writePointer, uint64_t value) {
+        while (value >= 0x80) {
+            *writePointer++ = (value & 0x7f) | 0x80;
+            value >>= 7;
+        }
+        *writePointer++ = value;
+
+        return writePointer;
+    }
+
+    bool readVarint(const unsigned char*& readPointer, const unsigned char* end, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && readPointer < end; shift += 7) {
+            unsigned char byte = *readPointer++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
+
+const char report_capture::magic[8] = {'U', 'T', 'D', 'C', 'A', 'P', 0x00, 0x01};
+
+report_capture::report_capture()
+: fd(-1), mapping(nullptr), capacity(0), lastTimestamp(0) {
+
+}
+
+report_capture::~report_capture() {
+    close();
+}
+
+bool report_capture::open(const std::string& newPath) {
+    close();
+
+    fd = ::open(newPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cout << "Could not open capture file " << newPath << " errno: " << errno << std::endl;
+        return false;
+    }
+
+    if (ftruncate(fd, initialCapacity) < 0) {
+        std::cout << "Could not size capture file " << newPath << " errno: " << errno << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    void* newMapping = mmap(nullptr, initialCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (newMapping == MAP_FAILED) {
+        std::cout << "Could not map capture file " << newPath << " errno: " << errno << std::endl;
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    path = newPath;
+    mapping = (unsigned char*)newMapping;
+    capacity = initialCapacity;
+    lastTimestamp = event_loop::monotonicNow();
+
+    report_capture_header* header = (report_capture_header*)mapping;
+    memcpy(header->magic, magic, sizeof(magic));
+    header->startTime = lastTimestamp;
+    header->dataLength = 0;
+
+    std::cout << "Capturing reports to " << path << std::endl;
+
+    return true;
+}
+
+void report_capture::close() {
+    if (fd < 0) {
+        return;
+    }
+
+    // Drop the unused tail of the mapping
+    size_t used = sizeof(report_capture_header) + ((report_capture_header*)mapping)->dataLength;
+    munmap(mapping, capacity);
+    if (ftruncate(fd, used) < 0) {
+        std::cout << "Could not trim capture file " << path << " errno: " << errno << std::endl;
+    }
+    ::close(fd);
+
+    fd = -1;
+    mapping = nullptr;
+    capacity = 0;
+    path.clear();
+}
+
+bool report_capture::isOpen() const {
+    return fd >= 0;
+}
+
+std::string report_capture::getPath() const {
+    return path;
+}
+
+bool report_capture::record(unsigned short vendorId, unsigned short productId, unsigned char endpoint,
+                            uint64_t timestamp, const unsigned char* data, size_t length) {
+    if (fd < 0) {
+        return false;
+    }
+
+    report_capture_header* header = (report_capture_header*)mapping;
+    size_t offset = sizeof(report_capture_header) + header->dataLength;
+    if (offset + maxRecordOverhead + length > capacity) {
+        if (!grow(offset + maxRecordOverhead + length)) {
+            return false;
+        }
+        header = (report_capture_header*)mapping;
+    }
+
+    // Reports from different endpoints can complete out of order relative to when we see them
+    uint64_t delta = timestamp > lastTimestamp ? timestamp - lastTimestamp : 0;
+    lastTimestamp += delta;
+
+    unsigned char* writePointer = mapping + offset;
+    writePointer = writeVarint(writePointer, vendorId);
+    writePointer = writeVarint(writePointer, productId);
+    *writePointer++ = endpoint;
+    writePointer = writeVarint(writePointer, delta);
+    writePointer = writeVarint(writePointer, length);
+    memcpy(writePointer, data, length);
+    writePointer += length;
+
+    header->dataLength = writePointer - mapping - sizeof(report_capture_header);
+
+    return true;
+}
+
+bool report_capture::grow(size_t required) {
+    size_t newCapacity = capacity;
+    while (newCapacity < required) {
+        newCapacity *= 2;
+    }
+
+    if (ftruncate(fd, newCapacity) < 0) {
+        std::cout << "Could not grow capture file " << path << " errno: " << errno << std::endl;
+        return false;
+    }
+
+    void* newMapping = mremap(mapping, capacity, newCapacity, MREMAP_MAYMOVE);
+    if (newMapping == MAP_FAILED) {
+        std::cout << "Could not remap capture file " << path << " errno: " << errno << std::endl;
+        return false;
+    }
+
+    mapping = (unsigned char*)newMapping;
+    capacity = newCapacity;
+
+    return true;
+}
+
+report_capture_reader::report_capture_reader()
+: fd(-1), mapping(nullptr), mappingLength(0), readPointer(nullptr), end(nullptr), lastTimestamp(0) {
+
+}
+
+report_capture_reader::~report_capture_reader() {
+    close();
+}
+
+bool report_capture_reader::open(const std::string& path) {
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cout << "Could not open capture file " << path << " errno: " << errno << std::endl;
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0 || (size_t)fileStat.st_size < sizeof(report_capture_header)) {
+        std::cout << "Capture file " << path << " is too short" << std::endl;
+        close();
+        return false;
+    }
+
+    void* newMapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (newMapping == MAP_FAILED) {
+        std::cout << "Could not map capture file " << path << " errno: " << errno << std::endl;
+        close();
+        return false;
+    }
+
+    mapping = (unsigned char*)newMapping;
+    mappingLength = fileStat.st_size;
+
+    report_capture_header* header = (report_capture_header*)mapping;
+    if (memcmp(header->magic, report_capture::magic, sizeof(report_capture::magic)) != 0 ||
+        header->dataLength > mappingLength - sizeof(report_capture_header)) {
+        std::cout << path << " is not a capture file" << std::endl;
+        close();
+        return false;
+    }
+
+    rewind();
+
+    return true;
+}
+
+void report_capture_reader::close() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingLength);
+    }
+
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    fd = -1;
+    mapping = nullptr;
+    mappingLength = 0;
+    readPointer = nullptr;
+    end = nullptr;
+}
+
+bool report_capture_reader::next(captured_report& report) {
+    uint64_t vendorId, productId, delta, length;
+    const unsigned char* recordPointer = readPointer;
+
+    if (!readVarint(recordPointer, end, vendorId) || !readVarint(recordPointer, end, productId) ||
+        recordPointer >= end) {
+        return false;
+    }
+
+    unsigned char endpoint = *recordPointer++;
+    if (!readVarint(recordPointer, end, delta) || !readVarint(recordPointer, end, length) ||
+        length > (size_t)(end - recordPointer)) {
+        return false;
+    }
+
+    lastTimestamp += delta;
+    report.vendorId = vendorId;
+    report.productId = productId;
+    report.endpoint = endpoint;
+    report.timestamp = lastTimestamp;
+    report.data = recordPointer;
+    report.length = length;
+
+    readPointer = recordPointer + length;
+
+    return true;
+}
+
+void report_capture_reader::rewind() {
+    if (mapping == nullptr) {
+        return;
+    }
+
+    report_capture_header* header = (report_capture_header*)mapping;
+    readPointer = mapping + sizeof(report_capture_header);
+    end = readPointer + header->dataLength;
+    lastTimestamp = header->startTime;
+}
@@ -0,0 +1,96 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_REPORT_CAPTURE_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_REPORT_CAPTURE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// A capture file starts with a fixed header followed by one record per report:
+//
+//   varint vendor id, varint product id, endpoint byte, varint nanoseconds since the previous report (or since the
+//   start time in the header for the first one), varint length, report bytes
+//
+// The header holds the number of record bytes written so far, which keeps a capture readable even when the daemon
+// did not get to close it.
+struct report_capture_header {
+    char magic[8];
+    uint64_t startTime;
+    uint64_t dataLength;
+};
+
+struct captured_report {
+    unsigned short vendorId;
+    unsigned short productId;
+    unsigned char endpoint;
+    // CLOCK_MONOTONIC time in nanoseconds at which the transfer completed
+    uint64_t timestamp;
+    const unsigned char* data;
+    size_t length;
+};
+
+// Appends reports to a memory mapped capture file
+class report_capture {
+public:
+    static const char magic[8];
+
+    report_capture();
+    ~report_capture();
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+    std::string getPath() const;
+
+    bool record(unsigned short vendorId, unsigned short productId, unsigned char endpoint, uint64_t timestamp,
+                const unsigned char* data, size_t length);
+private:
+    bool grow(size_t required);
+
+    std::string path;
+    int fd;
+    unsigned char* mapping;
+    size_t capacity;
+    uint64_t lastTimestamp;
+};
+
+// Walks the reports of a capture file in the order they were recorded
+class report_capture_reader {
+public:
+    report_capture_reader();
+    ~report_capture_reader();
+
+    bool open(const std::string& path);
+    void close();
+
+    bool next(captured_report& report);
+    void rewind();
+private:
+    int fd;
+    unsigned char* mapping;
+    size_t mappingLength;
+    const unsigned char* readPointer;
+    const unsigned char* end;
+    uint64_t lastTimestamp;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_REPORT_CAPTURE_H
@@ -0,0 +1,722 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include "simulated_usb_transport.h"
+#include "pen_trajectory.h"
+
+namespace {
+    // Both vendors put the position and pressure in the same place, the rest of the report differs
+    std::vector<unsigned char> penReport(unsigned char reportId, unsigned char status, const pen_sample& sample) {
+        return {reportId, status,
+                (unsigned char)(sample.x & 0xff), (unsigned char)(sample.x >> 8),
+                (unsigned char)(sample.y & 0xff), (unsigned char)(sample.y >> 8),
+                (unsigned char)(sample.pressure & 0xff), (unsigned char)(sample.pressure >> 8),
+                0x00, 0x00, 0x00, 0x00};
+    }
+
+    unsigned char stylusStatus(const pen_sample& sample) {
+        unsigned char status = sample.touching ? 0x01 : 0x00;
+        if (sample.stylusButton == 1) {
+            status |= 0x02;
+        } else if (sample.stylusButton == 2) {
+            status |= 0x04;
+        }
+
+        return status;
+    }
+
+    std::vector<std::vector<unsigned char> > xpPenReports(const std::vector<pen_sample>& samples) {
+        std::vector<std::vector<unsigned char> > reports;
+        for (auto& sample : samples) {
+            if (!sample.frame) {
+                std::vector<unsigned char> report = penReport(0x02, 0xa0 | stylusStatus(sample), sample);
+                report[8] = (unsigned char)sample.tiltX;
+                report[9] = (unsigned char)sample.tiltY;
+                reports.push_back(report);
+                continue;
+            }
+
+            std::vector<unsigned char> report(12, 0x00);
+            report[0] = 0x02;
+            report[1] = 0xf0;
+            report[2] = sample.padButtons & 0xff;
+            report[3] = (sample.padButtons >> 8) & 0xff;
+            report[4] = (sample.padButtons >> 16) & 0xff;
+            switch (sample.dial) {
+                case 1: report[7] = 0x01; break;
+                case -1: report[7] = 0x02; break;
+                case 2: report[7] = 0x10; break;
+                case -2: report[7] = 0x20; break;
+                default: break;
+            }
+            reports.push_back(report);
+        }
+
+        return reports;
+    }
+
+    std::vector<std::vector<unsigned char> > huionReports(const std::vector<pen_sample>& samples) {
+        std::vector<std::vector<unsigned char> > reports;
+        for (auto& sample : samples) {
+            if (!sample.frame) {
+                std::vector<unsigned char> report = penReport(0x08, 0x80 | stylusStatus(sample), sample);
+                report[10] = (unsigned char)sample.tiltX;
+                report[11] = (unsigned char)sample.tiltY;
+                reports.push_back(report);
+                continue;
+            }
+
+            // The H1161 has no dials
+            if (sample.dial != 0) {
+                continue;
+            }
+
+            std::vector<unsigned char> report(12, 0x00);
+            report[0] = 0x08;
+            report[1] = 0xe0;
+            report[2] = 0x01;
+            report[3] = 0x01;
+            report[4] = sample.padButtons & 0xff;
+            report[5] = (sample.padButtons >> 8) & 0xff;
+            reports.push_back(report);
+        }
+
+        return reports;
+    }
+
+    int reportRate(uint64_t reportInterval) {
+        return reportInterval == 0 ? 1000 : (int)(1000000000 / reportInterval);
+    }
+
+    std::vector<unsigned char> stringDescriptor(const std::string& value) {
+        std::vector<unsigned char> descriptor = {(unsigned char)(2 + value.size() * 2), 0x03};
+        for (char character : value) {
+            descriptor.push_back(character);
+            descriptor.push_back(0x00);
+        }
+
+        return descriptor;
+    }
+}
+
+simulated_usb_transport::simulated_usb_transport()
+: eventLoop(nullptr), eventFd(-1), wakeupPending(false), timerId(-1), timerDeadline(0), nextCallbackHandle(1),
+  nextPort(1), reportsDelivered(0), reportsDropped(0) {
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+simulated_usb_transport::~simulated_usb_transport() {
+    if (eventLoop != nullptr) {
+        eventLoop->removeFd(eventFd);
+        if (timerId >= 0) {
+            eventLoop->cancelTimer(timerId);
+        }
+    }
+
+    ::close(eventFd);
+
+    for (auto device : devices) {
+        delete device;
+    }
+}
+
+simulated_tablet simulated_usb_transport::artist22RPro(uint64_t reportInterval, unsigned int seed) {
+    simulated_tablet tablet;
+    tablet.vendorId = 0x28bd;
+    tablet.productId = 0x091b;
+    tablet.interfaces = {
+            {{0x81, 64}},
+            {{0x82, 64}},
+            {{0x83, 12}, {0x04, 12}},
+    };
+
+    // Max width 47752, max height 26860 and max pressure 8191
+    tablet.stringDescriptors[0x64] = {0x0c, 0x03, 0x88, 0xba, 0xec, 0x68, 0x00, 0x00, 0xff, 0x1f, 0x00, 0x00};
+    tablet.reportEndpoint = 0x83;
+    tablet.reports = xpPenReports(pen_trajectory::session(seed, reportRate(reportInterval), 47752, 26860, 8191));
+    tablet.reportInterval = reportInterval;
+
+    return tablet;
+}
+
+simulated_tablet simulated_usb_transport::huionH1161(uint64_t reportInterval, unsigned int seed) {
+    simulated_tablet tablet;
+    tablet.vendorId = 0x256c;
+    tablet.productId = 0x006d;
+    tablet.interfaces = {
+            {{0x81, 12}},
+            {{0x82, 64}},
+    };
+
+    tablet.stringDescriptors[0xc9] = stringDescriptor("HUION_T191_190619");
+    // Max width 44000, max height 27500 and max pressure 8191
+    tablet.stringDescriptors[200] = {0x12, 0x03, 0xe0, 0xab, 0x00, 0x6c, 0x6b, 0x00, 0xff, 0x1f,
+                                     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    tablet.reportEndpoint = 0x81;
+    tablet.reports = huionReports(pen_trajectory::session(seed, reportRate(reportInterval), 44000, 27500, 8191));
+    tablet.reportInterval = reportInterval;
+
+    return tablet;
+}
+
+libusb_device* simulated_usb_transport::plug(const simulated_tablet& tablet) {
+    simulated_device* device = new simulated_device();
+    device->tablet = tablet;
+    device->connected = true;
+    device->openHandles = 0;
+    device->firstReportAt = 0;
+    device->delivered = 0;
+    device->dropped = 0;
+    device->noiseDelivered = 0;
+    device->responsesDue = 0;
+    if (device->tablet.port == 0) {
+        device->tablet.port = nextPort++;
+    }
+
+    // Lay out a config descriptor the same way libusb would parse it off the device
+    size_t interfaceCount = tablet.interfaces.size();
+    device->interfaces.resize(interfaceCount);
+    device->interfaceDescriptors.resize(interfaceCount);
+    device->endpoints.resize(interfaceCount);
+    for (size_t index = 0; index < interfaceCount; ++index) {
+        for (auto& endpoint : tablet.interfaces[index]) {
+            struct libusb_endpoint_descriptor endpointDescriptor;
+            memset(&endpointDescriptor, 0, sizeof(endpointDescriptor));
+            endpointDescriptor.bEndpointAddress = endpoint.address;
+            endpointDescriptor.bmAttributes = LIBUSB_TRANSFER_TYPE_INTERRUPT;
+            endpointDescriptor.wMaxPacketSize = endpoint.maxPacketSize;
+            endpointDescriptor.bInterval = 1;
+            device->endpoints[index].push_back(endpointDescriptor);
+        }
+
+        struct libusb_interface_descriptor& interfaceDescriptor = device->interfaceDescriptors[index];
+        memset(&interfaceDescriptor, 0, sizeof(interfaceDescriptor));
+        interfaceDescriptor.bInterfaceNumber = index;
+        interfaceDescriptor.bNumEndpoints = device->endpoints[index].size();
+        interfaceDescriptor.endpoint = device->endpoints[index].data();
+
+        device->interfaces[index].altsetting = &interfaceDescriptor;
+        device->interfaces[index].num_altsetting = 1;
+    }
+
+    memset(&device->config, 0, sizeof(device->config));
+    device->config.bNumInterfaces = interfaceCount;
+    device->config.interface = device->interfaces.data();
+
+    devices.push_back(device);
+    pendingHotplug.push_back({device, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED});
+    wake();
+
+    return reinterpret_cast<libusb_device*>(device);
+}
+
+void simulated_usb_transport::unplug(libusb_device* libusbDevice) {
+    simulated_device* device = toDevice(libusbDevice);
+    if (!device->connected) {
+        return;
+    }
+
+    device->connected = false;
+    for (auto& endpoint : device->submitted) {
+        for (auto transfer : endpoint.second) {
+            transfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+            transfer->actual_length = 0;
+            pendingCompletions.push_back(transfer);
+        }
+        endpoint.second.clear();
+    }
+
+    pendingHotplug.push_back({device, LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT});
+    wake();
+}
+
+unsigned long simulated_usb_transport::getReportsDelivered() const {
+    return reportsDelivered;
+}
+
+unsigned long simulated_usb_transport::getReportsDelivered(libusb_device* device) const {
+    return toDevice(device)->delivered;
+}
+
+unsigned long simulated_usb_transport::getNoiseDelivered(libusb_device* device) const {
+    return toDevice(device)->noiseDelivered;
+}
+
+unsigned long simulated_usb_transport::getReportsDropped() const {
+    return reportsDropped;
+}
+
+const latency_histogram& simulated_usb_transport::getDeliveryLag() const {
+    return deliveryLag;
+}
+
+void simulated_usb_transport::waitForAnswer(simulated_device* device) {
+    if (device->tablet.requestLatency > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(device->tablet.requestLatency));
+    }
+}
+
+simulated_usb_transport::simulated_device* simulated_usb_transport::toDevice(libusb_device* device) {
+    return reinterpret_cast<simulated_device*>(device);
+}
+
+simulated_usb_transport::simulated_device* simulated_usb_transport::toDevice(libusb_device_handle* handle) {
+    return reinterpret_cast<simulated_device*>(handle);
+}
+
+void simulated_usb_transport::registerEventSources(event_loop* loop) {
+    eventLoop = loop;
+    eventLoop->addFd(eventFd, EPOLLIN, [this](uint32_t readyEvents) {
+        handleEvents();
+    });
+
+    if (wakeupPending) {
+        wakeupPending = false;
+        wake();
+    }
+}
+
+void simulated_usb_transport::handleEvents() {
+    uint64_t counter;
+    while (read(eventFd, &counter, sizeof(counter)) == sizeof(counter)) {
+    }
+    wakeupPending = false;
+
+    while (!pendingHotplug.empty()) {
+        pending_hotplug hotplug = pendingHotplug.front();
+        pendingHotplug.pop_front();
+
+        for (auto registration : hotplugCallbacks) {
+            const hotplug_registration& callback = registration.second;
+            if ((callback.vendorId == LIBUSB_HOTPLUG_MATCH_ANY || callback.vendorId == hotplug.device->tablet.vendorId) &&
+                (callback.productId == LIBUSB_HOTPLUG_MATCH_ANY || callback.productId == hotplug.device->tablet.productId)) {
+                callback.callback(nullptr, reinterpret_cast<libusb_device*>(hotplug.device), hotplug.event,
+                                  callback.userData);
+            }
+        }
+    }
+
+    while (!pendingCompletions.empty()) {
+        struct libusb_transfer* transfer = pendingCompletions.front();
+        pendingCompletions.pop_front();
+        transfer->callback(transfer);
+    }
+
+    uint64_t now = event_loop::monotonicNow();
+    uint64_t nextDeadline = UINT64_MAX;
+    for (auto device : devices) {
+        if (!device->connected || device->tablet.reports.empty()) {
+            continue;
+        }
+
+        deliverReports(device, now);
+
+        auto submitted = device->submitted.find(device->tablet.reportEndpoint | LIBUSB_ENDPOINT_IN);
+        if (submitted == device->submitted.end() || submitted->second.empty()) {
+            continue;
+        }
+
+        if (device->tablet.reportInterval == 0) {
+            // Resubmitted transfers complete on the next pass through the event loop
+            wake();
+        } else {
+            nextDeadline = std::min(nextDeadline, device->firstReportAt +
+                                                  (device->delivered + device->dropped) * device->tablet.reportInterval);
+        }
+    }
+
+    if (nextDeadline != UINT64_MAX) {
+        scheduleWakeup(nextDeadline);
+    }
+}
+
+void simulated_usb_transport::deliverReports(simulated_device* device, uint64_t now) {
+    auto& submitted = device->submitted[device->tablet.reportEndpoint | LIBUSB_ENDPOINT_IN];
+    if (submitted.empty()) {
+        return;
+    }
+
+    // Responses don't take the place of a report in the tablet's schedule
+    while (device->responsesDue > 0 && !submitted.empty() && device->connected) {
+        struct libusb_transfer* transfer = submitted.front();
+        submitted.pop_front();
+
+        int length = std::min((int)device->tablet.messageResponse.size(), transfer->length);
+        memcpy(transfer->buffer, device->tablet.messageResponse.data(), length);
+        transfer->actual_length = length;
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+
+        device->responsesDue--;
+        transfer->callback(transfer);
+    }
+
+    // Reports are due from the moment the first transfer was waiting for one
+    if (device->firstReportAt == 0) {
+        device->firstReportAt = now;
+    }
+
+    // Only the transfers that were waiting when we got here, anything resubmitted from a callback waits for the next
+    // pass the same way it would with hardware
+    size_t due = submitted.size();
+    if (device->tablet.reportInterval > 0) {
+        unsigned long reportsDue = (now - device->firstReportAt) / device->tablet.reportInterval + 1;
+        unsigned long sent = device->delivered + device->dropped;
+        due = reportsDue > sent ? reportsDue - sent : 0;
+
+        // The tablet doesn't wait for the host, anything it had no transfer for by now got overwritten by newer
+        // reports and is lost
+        if (due > submitted.size()) {
+            device->dropped += due - submitted.size();
+            reportsDropped += due - submitted.size();
+            due = submitted.size();
+        }
+    }
+
+    for (size_t index = 0; index < due && !submitted.empty() && device->connected; ++index) {
+        struct libusb_transfer* transfer = submitted.front();
+        submitted.pop_front();
+
+        unsigned long sequence = device->delivered + device->dropped;
+        const std::vector<unsigned char>& report = device->tablet.reports[sequence % device->tablet.reports.size()];
+        int length = std::min((int)report.size(), transfer->length);
+        memcpy(transfer->buffer, report.data(), length);
+        transfer->actual_length = length;
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+
+        if (device->tablet.reportInterval > 0) {
+            deliveryLag.record(now - (device->firstReportAt + sequence * device->tablet.reportInterval));
+        }
+
+        device->delivered++;
+        reportsDelivered++;
+        transfer->callback(transfer);
+        deliverNoise(device);
+    }
+}
+
+void simulated_usb_transport::deliverNoise(simulated_device* device) {
+    if (device->tablet.noiseEndpoint == 0 || !device->connected) {
+        return;
+    }
+
+    // Lost when nothing is waiting for it, like any other report
+    auto& submitted = device->submitted[device->tablet.noiseEndpoint | LIBUSB_ENDPOINT_IN];
+    if (submitted.empty()) {
+        return;
+    }
+
+    struct libusb_transfer* transfer = submitted.front();
+    submitted.pop_front();
+
+    int length = std::min((int)device->tablet.noiseReport.size(), transfer->length);
+    memcpy(transfer->buffer, device->tablet.noiseReport.data(), length);
+    transfer->actual_length = length;
+    transfer->status = LIBUSB_TRANSFER_COMPLETED;
+
+    device->noiseDelivered++;
+    transfer->callback(transfer);
+}
+
+void simulated_usb_transport::scheduleWakeup(uint64_t deadline) {
+    if (eventLoop == nullptr || (timerId >= 0 && timerDeadline <= deadline)) {
+        return;
+    }
+
+    if (timerId >= 0) {
+        eventLoop->cancelTimer(timerId);
+    }
+
+    uint64_t now = event_loop::monotonicNow();
+    long delayMs = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+    timerDeadline = deadline;
+    timerId = eventLoop->addTimer(delayMs, [this]() {
+        timerId = -1;
+        handleEvents();
+    });
+}
+
+void simulated_usb_transport::wake() {
+    if (wakeupPending) {
+        return;
+    }
+
+    wakeupPending = true;
+    if (eventLoop != nullptr) {
+        uint64_t counter = 1;
+        if (write(eventFd, &counter, sizeof(counter)) != sizeof(counter)) {
+            std::cout << "Could not wake up the simulated transport" << std::endl;
+        }
+    }
+}
+
+int simulated_usb_transport::getNextTimeout() {
+    // All of the scheduling goes through the event loop timers
+    return -1;
+}
+
+ssize_t simulated_usb_transport::getDeviceList(libusb_device*** list) {
+    // Whatever is plugged in now is enumerated here rather than announced through hotplug
+    pendingHotplug.clear();
+
+    deviceList.clear();
+    for (auto device : devices) {
+        if (device->connected) {
+            deviceList.push_back(reinterpret_cast<libusb_device*>(device));
+        }
+    }
+
+    size_t count = deviceList.size();
+    deviceList.push_back(nullptr);
+    *list = deviceList.data();
+
+    return count;
+}
+
+int simulated_usb_transport::getDeviceDescriptor(libusb_device* libusbDevice,
+                                                 struct libusb_device_descriptor* descriptor) {
+    simulated_device* device = toDevice(libusbDevice);
+    memset(descriptor, 0, sizeof(*descriptor));
+    descriptor->bLength = sizeof(*descriptor);
+    descriptor->bDescriptorType = LIBUSB_DT_DEVICE;
+    descriptor->idVendor = device->tablet.vendorId;
+    descriptor->idProduct = device->tablet.productId;
+    descriptor->bNumConfigurations = 1;
+
+    return LIBUSB_SUCCESS;
+}
+
+void simulated_usb_transport::refDevice(libusb_device* device) {
+    // Unplugged devices stay around until the transport goes away
+}
+
+void simulated_usb_transport::unrefDevice(libusb_device* device) {
+}
+
+uint8_t simulated_usb_transport::getBusNumber(libusb_device* device) {
+    return 1;
+}
+
+int simulated_usb_transport::getPortNumbers(libusb_device* device, uint8_t* portNumbers, int length) {
+    if (length < 1) {
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+
+    // Every tablet sits right on the root hub
+    portNumbers[0] = toDevice(device)->tablet.port;
+    return 1;
+}
+
+int simulated_usb_transport::getConfigDescriptor(libusb_device* libusbDevice, uint8_t index,
+                                                 struct libusb_config_descriptor** config) {
+    if (index != 0) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    *config = &toDevice(libusbDevice)->config;
+
+    return LIBUSB_SUCCESS;
+}
+
+void simulated_usb_transport::freeConfigDescriptor(struct libusb_config_descriptor* config) {
+    // Owned by the simulated device
+}
+
+int simulated_usb_transport::registerHotplugCallback(int vendorId, int productId, libusb_hotplug_callback_fn callback,
+                                                     void* userData, libusb_hotplug_callback_handle* callbackHandle) {
+    *callbackHandle = nextCallbackHandle++;
+    hotplugCallbacks[*callbackHandle] = {vendorId, productId, callback, userData};
+
+    return LIBUSB_SUCCESS;
+}
+
+void simulated_usb_transport::deregisterHotplugCallback(libusb_hotplug_callback_handle callbackHandle) {
+    hotplugCallbacks.erase(callbackHandle);
+}
+
+int simulated_usb_transport::open(libusb_device* libusbDevice, libusb_device_handle** handle) {
+    simulated_device* device = toDevice(libusbDevice);
+    if (!device->connected) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    if (device->tablet.busyOpens > 0) {
+        device->tablet.busyOpens--;
+        return LIBUSB_ERROR_BUSY;
+    }
+
+    device->openHandles++;
+    *handle = reinterpret_cast<libusb_device_handle*>(device);
+
+    return LIBUSB_SUCCESS;
+}
+
+void simulated_usb_transport::close(libusb_device_handle* handle) {
+    simulated_device* device = toDevice(handle);
+    if (device->openHandles > 0) {
+        device->openHandles--;
+    }
+}
+
+int simulated_usb_transport::kernelDriverActive(libusb_device_handle* handle, int interfaceNumber) {
+    return 0;
+}
+
+int simulated_usb_transport::detachKernelDriver(libusb_device_handle* handle, int interfaceNumber) {
+    return LIBUSB_SUCCESS;
+}
+
+int simulated_usb_transport::attachKernelDriver(libusb_device_handle* handle, int interfaceNumber) {
+    return LIBUSB_SUCCESS;
+}
+
+int simulated_usb_transport::claimInterface(libusb_device_handle* handle, int interfaceNumber) {
+    simulated_device* device = toDevice(handle);
+    if (!device->connected) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    if (interfaceNumber < 0 || interfaceNumber >= (int)device->tablet.interfaces.size()) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    return LIBUSB_SUCCESS;
+}
+
+int simulated_usb_transport::releaseInterface(libusb_device_handle* handle, int interfaceNumber) {
+    return LIBUSB_SUCCESS;
+}
+
+int simulated_usb_transport::getStringDescriptor(libusb_device_handle* handle, uint8_t index, uint16_t langId,
+                                                 unsigned char* data, int length) {
+    simulated_device* device = toDevice(handle);
+    if (!device->connected) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    waitForAnswer(device);
+
+    // Devices stall on descriptors they don't have
+    auto descriptor = device->tablet.stringDescriptors.find(index);
+    if (descriptor == device->tablet.stringDescriptors.end()) {
+        return LIBUSB_ERROR_PIPE;
+    }
+
+    int copied = std::min(length, (int)descriptor->second.size());
+    memcpy(data, descriptor->second.data(), copied);
+
+    return copied;
+}
+
+int simulated_usb_transport::controlTransfer(libusb_device_handle* handle, uint8_t requestType, uint8_t request,
+                                             uint16_t value, uint16_t index, unsigned char* data, uint16_t length,
+                                             unsigned int timeout) {
+    if (!toDevice(handle)->connected) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    waitForAnswer(toDevice(handle));
+
+    // Class requests such as SET_PROTOCOL and SET_IDLE are accepted without a data stage
+    return 0;
+}
+
+int simulated_usb_transport::interruptTransfer(libusb_device_handle* handle, unsigned char endpoint,
+                                               unsigned char* data, int length, int* transferred,
+                                               unsigned int timeout) {
+    if (!toDevice(handle)->connected) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    // Anything sent to the tablet is accepted, but it never answers synchronous reads
+    if ((endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT) {
+        waitForAnswer(toDevice(handle));
+        *transferred = length;
+        return LIBUSB_SUCCESS;
+    }
+
+    *transferred = 0;
+    return LIBUSB_ERROR_TIMEOUT;
+}
+
+struct libusb_transfer* simulated_usb_transport::allocTransfer() {
+    struct libusb_transfer* transfer = new libusb_transfer();
+    memset(transfer, 0, sizeof(*transfer));
+
+    return transfer;
+}
+
+void simulated_usb_transport::freeTransfer(struct libusb_transfer* transfer) {
+    if (transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER) {
+        delete[] transfer->buffer;
+    }
+
+    delete transfer;
+}
+
+int simulated_usb_transport::submitTransfer(struct libusb_transfer* transfer) {
+    simulated_device* device = toDevice(transfer->dev_handle);
+    if (!device->connected) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    // Anything sent to the tablet is accepted straight away
+    if ((transfer->endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT) {
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = transfer->length;
+        pendingCompletions.push_back(transfer);
+        if (!device->tablet.messageResponse.empty()) {
+            device->responsesDue++;
+        }
+
+        wake();
+        return LIBUSB_SUCCESS;
+    }
+
+    device->submitted[transfer->endpoint].push_back(transfer);
+    if ((transfer->endpoint & ~LIBUSB_ENDPOINT_IN) == (device->tablet.reportEndpoint & ~LIBUSB_ENDPOINT_IN)) {
+        wake();
+    }
+
+    return LIBUSB_SUCCESS;
+}
+
+int simulated_usb_transport::cancelTransfer(struct libusb_transfer* transfer) {
+    simulated_device* device = toDevice(transfer->dev_handle);
+    auto& submitted = device->submitted[transfer->endpoint];
+    auto record = std::find(submitted.begin(), submitted.end(), transfer);
+    if (record == submitted.end()) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    submitted.erase(record);
+    transfer->status = LIBUSB_TRANSFER_CANCELLED;
+    transfer->actual_length = 0;
+    pendingCompletions.push_back(transfer);
+    wake();
+
+    return LIBUSB_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_SIMULATED_USB_TRANSPORT_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_SIMULATED_USB_TRANSPORT_H
+
+#include <map>
+#include <deque>
+#include <vector>
+#include "usb_transport.h"
+#include "latency_histogram.h"
+
+struct simulated_endpoint {
+    unsigned char address;
+    unsigned short maxPacketSize;
+};
+
+// Everything a simulated tablet answers with. Interfaces are numbered by their position and all of their endpoints
+// are interrupt endpoints.
+struct simulated_tablet {
+    unsigned short vendorId;
+    unsigned short productId;
+    std::vector<std::vector<simulated_endpoint> > interfaces;
+    // Raw string descriptors by index, exactly as the device would return them
+    std::map<unsigned char, std::vector<unsigned char> > stringDescriptors;
+
+    // The reports are played back in a loop on this IN endpoint
+    unsigned char reportEndpoint;
+    std::vector<std::vector<unsigned char> > reports;
+    // Nanoseconds between two reports, 0 completes every submitted transfer as soon as possible
+    uint64_t reportInterval;
+    // Opening the tablet fails as busy this many times before it succeeds, like a device still held by someone else
+    int busyOpens = 0;
+    // Nanoseconds the tablet takes to answer a synchronous request, as slow hubs and docks do
+    uint64_t requestLatency = 0;
+    // Another IN endpoint that sends this report alongside every one on the report endpoint, as the mouse
+    // emulation interfaces of some tablets do. 0 for none.
+    unsigned char noiseEndpoint = 0;
+    std::vector<unsigned char> noiseReport;
+    // Sent on the report endpoint ahead of the next report for every message the tablet gets, as tablets answer
+    // configuration requests. Empty for a tablet that doesn't answer.
+    std::vector<unsigned char> messageResponse;
+    // The port the tablet is plugged into, 0 for a free one. Plugging a tablet into the port of one just unplugged
+    // brings it back as a new device the way re-enumerating does.
+    uint8_t port = 0;
+};
+
+// An in-process USB stack that serves simulated tablets. Transfers complete from the event loop on the schedule of
+// their tablet, so the rest of the daemon runs exactly as it would with hardware attached.
+class simulated_usb_transport : public usb_transport {
+public:
+    simulated_usb_transport();
+    ~simulated_usb_transport();
+
+    // Tablets plugged in before getDeviceList is called are enumerated, later ones arrive through hotplug
+    libusb_device* plug(const simulated_tablet& tablet);
+    void unplug(libusb_device* device);
+    unsigned long getReportsDelivered() const;
+    unsigned long getReportsDelivered(libusb_device* device) const;
+    unsigned long getNoiseDelivered(libusb_device* device) const;
+    // Reports a tablet had ready while none of its transfers were submitted
+    unsigned long getReportsDropped() const;
+    // How late reports of paced tablets were handed to the daemon compared to when the tablet sent them
+    const latency_histogram& getDeliveryLag() const;
+
+    // Tablets the decoders know how to talk to, playing back a pen_trajectory session generated from the seed
+    static simulated_tablet artist22RPro(uint64_t reportInterval, unsigned int seed = 0);
+    static simulated_tablet huionH1161(uint64_t reportInterval, unsigned int seed = 0);
+
+    void registerEventSources(event_loop* loop) override;
+    void handleEvents() override;
+    int getNextTimeout() override;
+
+    ssize_t getDeviceList(libusb_device*** list) override;
+    int getDeviceDescriptor(libusb_device* device, struct libusb_device_descriptor* descriptor) override;
+    void refDevice(libusb_device* device) override;
+    void unrefDevice(libusb_device* device) override;
+    uint8_t getBusNumber(libusb_device* device) override;
+    int getPortNumbers(libusb_device* device, uint8_t* portNumbers, int length) override;
+    int getConfigDescriptor(libusb_device* device, uint8_t index, struct libusb_config_descriptor** config) override;
+    void freeConfigDescriptor(struct libusb_config_descriptor* config) override;
+    int registerHotplugCallback(int vendorId, int productId, libusb_hotplug_callback_fn callback, void* userData,
+                                libusb_hotplug_callback_handle* callbackHandle) override;
+    void deregisterHotplugCallback(libusb_hotplug_callback_handle callbackHandle) override;
+
+    int open(libusb_device* device, libusb_device_handle** handle) override;
+    void close(libusb_device_handle* handle) override;
+    int kernelDriverActive(libusb_device_handle* handle, int interfaceNumber) override;
+    int detachKernelDriver(libusb_device_handle* handle, int interfaceNumber) override;
+    int attachKernelDriver(libusb_device_handle* handle, int interfaceNumber) override;
+    int claimInterface(libusb_device_handle* handle, int interfaceNumber) override;
+    int releaseInterface(libusb_device_handle* handle, int interfaceNumber) override;
+
+    int getStringDescriptor(libusb_device_handle* handle, uint8_t index, uint16_t langId, unsigned char* data,
+                            int length) override;
+    int controlTransfer(libusb_device_handle* handle, uint8_t requestType, uint8_t request, uint16_t value,
+                        uint16_t index, unsigned char* data, uint16_t length, unsigned int timeout) override;
+    int interruptTransfer(libusb_device_handle* handle, unsigned char endpoint, unsigned char* data, int length,
+                          int* transferred, unsigned int timeout) override;
+
+    struct libusb_transfer* allocTransfer() override;
+    void freeTransfer(struct libusb_transfer* transfer) override;
+    int submitTransfer(struct libusb_transfer* transfer) override;
+    int cancelTransfer(struct libusb_transfer* transfer) override;
+private:
+    struct simulated_device {
+        simulated_tablet tablet;
+        bool connected;
+        int openHandles;
+
+        // Backing storage for the config descriptor handed out for this device
+        struct libusb_config_descriptor config;
+        std::vector<struct libusb_interface> interfaces;
+        std::vector<struct libusb_interface_descriptor> interfaceDescriptors;
+        std::vector<std::vector<struct libusb_endpoint_descriptor> > endpoints;
+
+        std::map<unsigned char, std::deque<struct libusb_transfer*> > submitted;
+        uint64_t firstReportAt;
+        unsigned long delivered;
+        unsigned long dropped;
+        unsigned long noiseDelivered;
+        unsigned long responsesDue;
+    };
+
+    struct hotplug_registration {
+        int vendorId;
+        int productId;
+        libusb_hotplug_callback_fn callback;
+        void* userData;
+    };
+
+    struct pending_hotplug {
+        simulated_device* device;
+        libusb_hotplug_event event;
+    };
+
+    static simulated_device* toDevice(libusb_device* device);
+    static simulated_device* toDevice(libusb_device_handle* handle);
+
+    void deliverReports(simulated_device* device, uint64_t now);
+    void deliverNoise(simulated_device* device);
+    static void waitForAnswer(simulated_device* device);
+    void scheduleWakeup(uint64_t deadline);
+    void wake();
+
+    event_loop* eventLoop;
+    int eventFd;
+    bool wakeupPending;
+    int timerId;
+    uint64_t timerDeadline;
+
+    std::vector<simulated_device*> devices;
+    // Handed out by getDeviceList, null terminated like the libusb list
+    std::vector<libusb_device*> deviceList;
+    std::map<libusb_hotplug_callback_handle, hotplug_registration> hotplugCallbacks;
+    libusb_hotplug_callback_handle nextCallbackHandle;
+    uint8_t nextPort;
+    std::deque<pending_hotplug> pendingHotplug;
+    // Cancelled transfers and those cut off by an unplug, their callbacks run from the event loop like libusb's
+    std::deque<struct libusb_transfer*> pendingCompletions;
+    unsigned long reportsDelivered;
+    unsigned long reportsDropped;
+    latency_histogram deliveryLag;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_SIMULATED_USB_TRANSPORT_H
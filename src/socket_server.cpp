@@ -36,7 +36,7 @@ namespace filesystem = std::filesystem;
 #include <fcntl.h>
 #include <iostream>
 #include <iomanip>
-#include <poll.h>
+#include <sys/epoll.h>
 #include "socket_server.h"
 #include "unix_socket_message.h"
 
@@ -66,14 +66,12 @@ socket_server::socket_server() {
     socketLocationDir << "/.local/var/run/";
 
     filesystem::create_directories(socketLocationDir.str());
-    std::stringstream  socketLocation;
-    socketLocation << socketLocationDir.str();
-    socketLocation << "userspace_tablet_driver_daemon.sock";
+    std::string socketLocation = getSocketLocation();
 
-    enabled = remove(socketLocation.str().c_str()) != -1;
+    enabled = remove(socketLocation.c_str()) != -1;
 
     if (!enabled && errno != ENOENT) {
-        std::cout << "Could not set socket location to " << socketLocation.str() << " errno: " << errno << std::endl;
+        std::cout << "Could not set socket location to " << socketLocation << " errno: " << errno << std::endl;
         close(sock);
         return;
     }
@@ -81,34 +79,49 @@ socket_server::socket_server() {
     struct sockaddr_un address;
     memset(&address, 0, sizeof(struct sockaddr_un));
     address.sun_family = AF_UNIX;
-    strncpy(address.sun_path, socketLocation.str().c_str(), sizeof(address.sun_path) - 1);
+    strncpy(address.sun_path, socketLocation.c_str(), sizeof(address.sun_path) - 1);
 
     enabled = bind(sock, (struct sockaddr*)&address, sizeof(struct sockaddr_un)) != -1;
 
     if (!enabled) {
-        std::cout << "Problem when binding socket " << socketLocation.str() << std::endl;
+        std::cout << "Problem when binding socket " << socketLocation << std::endl;
         close(sock);
         return;
     }
 
     listen(sock, 5);
-    std::cout << "Listening on socket " << socketLocation.str() << std::endl;
+    std::cout << "Listening on socket " << socketLocation << std::endl;
 }
 
 socket_server::~socket_server() {
-    for (auto socket : connectedSockets) {
-        close(socket);
-    }
-
+    // A daemon taking over waits for its connection to close before binding, so the socket has to be gone by then
     if (enabled) {
+        remove(getSocketLocation().c_str());
         close(sock);
     }
 
+    for (auto socket : connectedSockets) {
+        close(socket);
+    }
+}
+
+std::string socket_server::getSocketLocation() {
     std::stringstream  socketLocation;
     socketLocation << getenv("HOME");
     socketLocation << "/.local/var/run/userspace_tablet_driver_daemon.sock";
 
-    remove(socketLocation.str().c_str());
+    return socketLocation.str();
+}
+
+void socket_server::registerEventSources(event_loop* loop, unix_socket_message_queue* queue) {
+    eventLoop = loop;
+    messageQueue = queue;
+
+    if (enabled) {
+        eventLoop->addFd(sock, EPOLLIN, [this](uint32_t events) {
+            handleConnections();
+        });
+    }
 }
 
 void socket_server::handleConnections() {
@@ -125,106 +138,89 @@ void socket_server::handleConnections() {
 
             std::cout << "Got new socket connection" << std::endl;
             connectedSockets.push_back(newConnection);
+
+            if (eventLoop != nullptr) {
+                eventLoop->addFd(newConnection, EPOLLIN, [this, newConnection](uint32_t events) {
+                    handleMessage(newConnection, events);
+                });
+            }
         }
     }
 }
 
-void socket_server::handleMessages(unix_socket_message_queue* messageQueue) {
-    int socketCount = connectedSockets.size();
-    if (socketCount > 0) {
-        struct pollfd *fds = static_cast<struct pollfd*>(calloc(socketCount, sizeof(struct pollfd)));
-        char headerBuffer[sizeof(unix_socket_message_header)];
-
-        for (int i = 0; i < socketCount; ++i) {
-            fds[i].fd = connectedSockets[i];
-            fds[i].events = POLLIN;
-        }
-
-        int res = poll(fds, socketCount, 0);
-        if (res > 0) {
-            for (int idx = 0; idx < socketCount; ++idx) {
-                if (fds[idx].revents != 0) {
-                    if (fds[idx].revents & POLLIN) {
-                        memset(headerBuffer, 0, sizeof(unix_socket_message_header));
-                        ssize_t s = read(fds[idx].fd, headerBuffer, sizeof(headerBuffer));
-                        if (s == sizeof(headerBuffer)) {
-                            // Validate the signature
-                            struct unix_socket_message *message = new unix_socket_message();
-                            memcpy(message, headerBuffer, sizeof(headerBuffer));
-
-                            if (message->signature == versionSignature) {
-                                bool failed = false;
-                                if (message->length > 0) {
-                                    message->data = new unsigned char[message->length];
-                                    ssize_t totalRead = 0;
-
-                                    while (totalRead < message->length) {
-                                        s = read(fds[idx].fd, message->data + totalRead, message->length - totalRead);
-
-                                        if (s == -1) {
-                                            // Handle something going wrong
-                                            delete[] message->data;
-                                            delete message;
-                                            failed = true;
-                                            break;
-                                        } else if (s == 0) {
-                                            // We reached the end but not all read
-                                            std::cout << "We only read a total of " << totalRead << " when we expected "
-                                                      << message->length << std::endl;
-                                            delete[] message->data;
-                                            delete message;
-                                            failed = true;
-                                            break;
-                                        }
-                                        totalRead += s;
-                                    }
-                                }
-
-                                if (!failed) {
-                                    message->originatingSocket = fds[idx].fd;
-                                    messageQueue->addMessage(message);
-                                }
-                            } else {
-                                std::cout << "Ignoring packet because we got a signature of " << message->signature << " when it should be " << versionSignature << std::endl;
-                            }
-                        } else {
-                            if (s == 0) {
-                                std::cout << "Connection closed on socket" << std::endl;
-                                auto record = std::find(connectedSockets.begin(), connectedSockets.end(), fds[idx].fd);
-                                if (record != connectedSockets.end()) {
-                                    connectedSockets.erase(record);
-                                }
-                                close(fds[idx].fd);
-                            } else {
-                                std::cout << "Could not get all header bytes. Expected " << sizeof(unix_socket_message_header) << " but only received " << s << std::endl;
-                                for (int i = 0; i < s; ++i) {
-                                    std::cout << std::hex << std::setfill('0')  << std::setw(2) << (int)headerBuffer[i] << ":";
-                                }
-                                std::cout << std::endl;
-                            }
-                        }
-                    } else {
-                        auto record = std::find(connectedSockets.begin(), connectedSockets.end(), fds[idx].fd);
-                        if (record != connectedSockets.end()) {
-                            connectedSockets.erase(record);
-                        }
-                        close(fds[idx].fd);
+void socket_server::handleMessage(int fd, uint32_t events) {
+    unix_socket_message_header header;
+
+    if (events & EPOLLIN) {
+        memset(&header, 0, sizeof(header));
+        ssize_t s = read(fd, &header, sizeof(header));
+        if (s == sizeof(header)) {
+            // Validate the signature
+            if (header.signature == versionSignature) {
+                pooled_message message = messageQueue->newMessage(header.length > 0 ? header.length : 0);
+                unsigned char* data = message->data;
+                memcpy(message.get(), &header, sizeof(header));
+                message->data = data;
+
+                ssize_t totalRead = 0;
+                while (totalRead < message->length) {
+                    s = read(fd, message->data + totalRead, message->length - totalRead);
+
+                    if (s == -1) {
+                        // Handle something going wrong
+                        return;
+                    } else if (s == 0) {
+                        // We reached the end but not all read
+                        std::cout << "We only read a total of " << totalRead << " when we expected "
+                                  << message->length << std::endl;
+                        return;
                     }
+                    totalRead += s;
+                }
+
+                message->originatingSocket = fd;
+                messageQueue->addMessage(std::move(message));
+            } else {
+                std::cout << "Ignoring packet because we got a signature of " << header.signature << " when it should be " << versionSignature << std::endl;
+            }
+        } else {
+            if (s == 0) {
+                std::cout << "Connection closed on socket" << std::endl;
+                closeConnection(fd);
+            } else {
+                std::cout << "Could not get all header bytes. Expected " << sizeof(unix_socket_message_header) << " but only received " << s << std::endl;
+                for (int i = 0; i < s; ++i) {
+                    std::cout << std::hex << std::setfill('0')  << std::setw(2) << (int)((unsigned char*)&header)[i] << ":";
                 }
+                std::cout << std::dec << std::setfill(' ') << std::endl;
             }
         }
+    } else {
+        closeConnection(fd);
     }
 }
 
+void socket_server::closeConnection(int fd) {
+    auto record = std::find(connectedSockets.begin(), connectedSockets.end(), fd);
+    if (record != connectedSockets.end()) {
+        connectedSockets.erase(record);
+    }
+
+    if (eventLoop != nullptr) {
+        eventLoop->removeFd(fd);
+    }
+    close(fd);
+}
+
 void socket_server::handleResponses(unix_socket_message_queue *messageQueue) {
-    auto responses = messageQueue->getResponses();
-    for (auto response : responses) {
+    messageQueue->getResponses(responses);
+    for (auto& response : responses) {
         ssize_t written = 0;
         ssize_t s = 0;
         bool failed = false;
 
         while (written < sizeof(unix_socket_message_header)) {
-            s = write(response->originatingSocket, response + written, sizeof(unix_socket_message_header) - written);
+            s = write(response->originatingSocket, (unsigned char*)response.get() + written, sizeof(unix_socket_message_header) - written);
             if (s <= 0) {
                 failed = true;
                 std::cout << "Failed sending response header" << std::endl;
@@ -245,8 +241,7 @@ void socket_server::handleResponses(unix_socket_message_queue *messageQueue) {
 
             written += s;
         }
-
-        delete[] response->data;
-        delete response;
     }
+
+    responses.clear();
 }
@@ -21,23 +21,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 #include <vector>
+#include <string>
 #include "unix_socket_message_queue.h"
+#include "event_loop.h"
 
 class socket_server {
 public:
     socket_server();
     ~socket_server();
 
+    void registerEventSources(event_loop* loop, unix_socket_message_queue* messageQueue);
     void handleConnections();
-    void handleMessages(unix_socket_message_queue* messageQueue);
+    void handleMessage(int fd, uint32_t events);
     void handleResponses(unix_socket_message_queue* messageQueue);
 
+    static std::string getSocketLocation();
+
     static long versionSignature;
 private:
+    void closeConnection(int fd);
+
     int sock;
     bool enabled;
 
+    event_loop* eventLoop = nullptr;
+    unix_socket_message_queue* messageQueue = nullptr;
+
     std::vector<int> connectedSockets;
+    // Kept between calls so that sending responses doesn't allocate
+    std::vector<pooled_message> responses;
 };
 
 
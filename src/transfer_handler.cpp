@@ -17,21 +17,23 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <linux/uinput.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <iostream>
 #include <cstring>
+#include <sstream>
+#include <algorithm>
 #include "transfer_handler.h"
-#include "socket_server.h"
+#include "event_loop.h"
 
 transfer_handler::~transfer_handler() {
-    for (auto pen : uinputPens) {
-        destroy_uinput_device(pen.second);
+    for (auto context : deviceContexts) {
+        destroyOutputDevices(context.second);
+        delete context.second;
     }
 
-    for (auto pad : uinputPads) {
-        destroy_uinput_device(pad.second);
-    }
+    expireParkedDevices(UINT64_MAX);
 }
 
 std::vector<int> transfer_handler::handledProductIds() {
@@ -42,370 +44,414 @@ nlohmann::json transfer_handler::getConfig() {
     return jsonConfig;
 }
 
-bool transfer_handler::uinput_send(int fd, uint16_t type, uint16_t code, int32_t value) {
-    struct timeval timestamp;
-    gettimeofday(&timestamp, NULL);
-    struct input_event event = {
-            .time = timestamp,
-            .type = type,
-            .code = code,
-            .value = value
-    };
-    if (write(fd, &event, sizeof(event)) < 0) {
-        return false;
-    }
+bool transfer_handler::uinput_send(input_event_batch& batch, uint16_t type, uint16_t code, int32_t value) {
+    batch.add(type, code, value);
 
     return true;
 }
 
+device_context* transfer_handler::getDeviceContext(libusb_device_handle *handle) {
+    auto record = deviceContexts.find(handle);
+    if (record != deviceContexts.end()) {
+        return record->second;
+    }
+
+    device_context* context = new device_context();
+    context->handle = handle;
+    context->penEvents.setSink(outputSink);
+    context->padEvents.setSink(outputSink);
+    context->pointerEvents.setSink(outputSink);
+    deviceContexts[handle] = context;
+
+    return context;
+}
+
+bool transfer_handler::processTransfer(device_context* context, unsigned char* data, size_t dataLen, uint64_t completedAt) {
+    // All events of a report share the time at which the report came off the bus
+    struct timeval reportTime;
+    reportTime.tv_sec = completedAt / 1000000000;
+    reportTime.tv_usec = (completedAt % 1000000000) / 1000;
+    context->reportCompletedAt = completedAt;
+    uint64_t decodeStartedAt = event_loop::monotonicNow();
+    context->penEvents.setTimestamp(reportTime);
+    context->padEvents.setTimestamp(reportTime);
+    context->pointerEvents.setTimestamp(reportTime);
+
+    // A transfer may hold several reports. They are split by the lengths of their ids until one of unknown length
+    // or one cut off by the end of the transfer comes up. The first report gets whatever there is of the transfer,
+    // anything else is taken for padding.
+    bool handled = false;
+    size_t offset = 0;
+    while (offset < dataLen) {
+        size_t reportLength = reportLengths[data[offset]];
+        if (offset > 0 && (reportLength == 0 || offset + reportLength > dataLen)) {
+            break;
+        }
+
+        if (reportLength == 0 || reportLength > dataLen) {
+            reportLength = dataLen;
+        }
+        handled = handleTransferData(context, data + offset, reportLength) || handled;
+        offset += reportLength;
+    }
+
+    uint64_t decodedAt = event_loop::monotonicNow();
+
+    context->penEvents.flush();
+    context->padEvents.flush();
+    context->pointerEvents.flush();
+
+    uint64_t writtenAt = event_loop::monotonicNow();
+    context->lastWriteDelay = writtenAt > completedAt ? writtenAt - completedAt : 0;
+    context->totalWriteDelay += context->lastWriteDelay;
+    context->reportsWritten++;
+
+    uint64_t transferDelay = decodeStartedAt > completedAt ? decodeStartedAt - completedAt : 0;
+    context->latency[latency_stage::transferLatency].record(transferDelay);
+    context->latency[latency_stage::decodeLatency].record(decodedAt - decodeStartedAt);
+    context->latency[latency_stage::writeLatency].record(writtenAt - decodedAt);
+    context->latency[latency_stage::totalLatency].record(context->lastWriteDelay);
+
+    return handled;
+}
+
+std::vector<device_context*> transfer_handler::getDeviceContexts() {
+    std::vector<device_context*> contexts;
+    for (auto context : deviceContexts) {
+        contexts.push_back(context.second);
+    }
+
+    return contexts;
+}
+
+endpoint_subscription transfer_handler::getEndpointSubscription(unsigned char endpoint) {
+    return probeSubscription;
+}
+
+bool transfer_handler::prepareAttach(libusb_device_handle* handle, device_capabilities& capabilities) {
+    // Runs outside of the attach lock, so it must not look at what the device being attached left behind
+    return fetchCapabilities(handle, capabilities);
+}
+
+bool transfer_handler::attach(libusb_device_handle* handle, int interfaceId, const std::string& identity,
+                              const device_capabilities* capabilities) {
+    attachingIdentity = identity;
+    attachingHandle = handle;
+    attachingCapabilities = capabilities;
+    bool attached = attachDevice(handle, interfaceId);
+    attachingIdentity.clear();
+    attachingHandle = nullptr;
+    attachingCapabilities = nullptr;
+
+    return attached;
+}
+
 void transfer_handler::detachDevice(libusb_device_handle *handle) {
-    auto lastButtonRecord = lastPressedButton.find(handle);
-    if (lastButtonRecord != lastPressedButton.end()) {
-        lastPressedButton.erase(lastButtonRecord);
+    auto record = deviceContexts.find(handle);
+    if (record == deviceContexts.end()) {
+        return;
     }
 
-    auto uinputPenRecord = uinputPens.find(handle);
-    if (uinputPenRecord != uinputPens.end()) {
-        close(uinputPens[handle]);
-        uinputPens.erase(uinputPenRecord);
+    device_context* context = record->second;
+    if (disconnectGracePeriodMs > 0) {
+        parkOutputDevices(context);
+    } else {
+        destroyOutputDevices(context);
     }
 
-    auto uinputPadRecord = uinputPads.find(handle);
-    if (uinputPadRecord != uinputPads.end()) {
-        close(uinputPads[handle]);
-        uinputPads.erase(uinputPadRecord);
+    deviceContexts.erase(record);
+    delete context;
+}
+
+void transfer_handler::setOutputSink(output_sink* sink) {
+    outputSink = sink;
+    for (auto context : deviceContexts) {
+        context.second->penEvents.setSink(sink);
+        context.second->padEvents.setSink(sink);
+        context.second->pointerEvents.setSink(sink);
     }
 }
 
-std::vector<unix_socket_message*> transfer_handler::handleMessage(unix_socket_message *message) {
-    std::vector<unix_socket_message*> responses;
+void transfer_handler::setTransport(usb_transport* usbTransport) {
+    transport = usbTransport;
+}
 
-    for (auto pens : uinputPens) {
-        int sentBytes;
-        int ret = libusb_interrupt_transfer(pens.first, message->interface | LIBUSB_ENDPOINT_OUT, message->data, message->length, &sentBytes, 1000);
-        if (ret != LIBUSB_SUCCESS) {
-            std::cout << "Failed to send message on interface " << message->interface << " ret: " << ret << " errno: " << errno << std::endl;
-            return std::vector<unix_socket_message*>();
-        }
+void transfer_handler::setCapabilityCache(capability_cache* cache) {
+    capabilityCache = cache;
+}
 
-        if (sentBytes != message->length) {
-            std::cout << "Didn't send all of the message on interface " << message->interface << " only sent " << sentBytes << std::endl;
-            return std::vector<unix_socket_message*>();
+bool transfer_handler::getCapabilities(libusb_device_handle* handle, device_capabilities& capabilities) {
+    // Read by prepareAttach already, there is no point in asking the device again
+    if (attachingHandle == handle) {
+        if (attachingCapabilities == nullptr) {
+            return false;
         }
 
-        if (message->expectResponse) {
-            unix_socket_message* response = new unix_socket_message();
-            response->destination = message_destination::gui;
-            response->vendor = message->vendor;
-            response->device = message->device;
-            response->interface = message->interface;
-            response->length = message->responseLength;
-            response->originatingSocket = message->originatingSocket;
-            response->signature = socket_server::versionSignature;
-            response->data = new unsigned char[response->length];
-            int actual_length;
-            int ret = libusb_interrupt_transfer(pens.first, message->responseInterface | LIBUSB_ENDPOINT_IN, response->data, response->length, &actual_length, 1000);
-            if (ret != LIBUSB_SUCCESS) {
-                std::cout << "Could not receive response on interface " << message->responseInterface << " ret: " << ret << " errno: " << errno << std::endl;
-                delete[] response->data;
-                delete response;
-            } else {
-                if (actual_length != message->responseLength) {
-                    std::cout << "Got a response of " << actual_length << " bytes. Expected " << message->responseLength
-                              << std::endl;
-                } else {
-                    responses.push_back(response);
-                }
-            }
-        }
+        capabilities = *attachingCapabilities;
+        return true;
     }
 
-    return responses;
+    return fetchCapabilities(handle, capabilities);
 }
 
-int transfer_handler::create_pen(const uinput_pen_args& penArgs) {
-    int fd = -1;
-    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (fd < 0) {
-        std::cout << "Could not create uinput pen" << std::endl;
+bool transfer_handler::fetchCapabilities(libusb_device_handle* handle, device_capabilities& capabilities) {
+    if (capabilityCache != nullptr && capabilityCache->lookup(handle, capabilities)) {
+        return true;
+    }
+
+    if (!readCapabilities(handle, capabilities)) {
         return false;
     }
 
-    auto set_evbit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_EVBIT, evBit);
-    };
-
-    auto set_keybit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_KEYBIT, evBit);
-    };
-
-    auto set_absbit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_ABSBIT, evBit);
-    };
-
-    auto set_relbit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_RELBIT, evBit);
-    };
-
-    auto set_mscbit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_MSCBIT, evBit);
-    };
-
-    set_evbit(EV_SYN);
-    set_evbit(EV_KEY);
-    set_evbit(EV_ABS);
-    set_evbit(EV_REL);
-    set_evbit(EV_MSC);
-
-    set_keybit(BTN_LEFT);
-    set_keybit(BTN_RIGHT);
-    set_keybit(BTN_MIDDLE);
-    set_keybit(BTN_SIDE);
-    set_keybit(BTN_EXTRA);
-    set_keybit(BTN_TOOL_PEN);
-    set_keybit(BTN_TOOL_RUBBER);
-    set_keybit(BTN_TOOL_BRUSH);
-    set_keybit(BTN_TOOL_PENCIL);
-    set_keybit(BTN_TOOL_AIRBRUSH);
-    set_keybit(BTN_TOOL_MOUSE);
-    set_keybit(BTN_TOOL_LENS);
-    set_keybit(BTN_TOUCH);
-    set_keybit(BTN_STYLUS);
-    set_keybit(BTN_STYLUS2);
-
-    set_absbit(ABS_X);
-    set_absbit(ABS_Y);
-    set_absbit(ABS_Z);
-    set_absbit(ABS_RZ);
-    set_absbit(ABS_THROTTLE);
-    set_absbit(ABS_WHEEL);
-    set_absbit(ABS_PRESSURE);
-    set_absbit(ABS_DISTANCE);
-    set_absbit(ABS_TILT_X);
-    set_absbit(ABS_TILT_Y);
-    set_absbit(ABS_MISC);
-
-    set_relbit(REL_WHEEL);
-
-    set_mscbit(MSC_SERIAL);
-
-    // Setup X Axis
-    struct uinput_abs_setup uinput_abs_setup = (struct uinput_abs_setup) {
-            .code = ABS_X,
-            .absinfo = {
-                    .value = 0,
-                    .minimum = 0,
-                    .maximum = penArgs.maxWidth,
-            },
-    };
-
-    ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup);
-
-    // Setup Y Axis
-    uinput_abs_setup = (struct uinput_abs_setup) {
-            .code = ABS_Y,
-            .absinfo = {
-                    .value = 0,
-                    .minimum = 0,
-                    .maximum = penArgs.maxHeight,
-            },
-    };
-
-    ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup);
-
-    // Setup Pressure Axis
-    uinput_abs_setup = (struct uinput_abs_setup) {
-            .code = ABS_PRESSURE,
-            .absinfo = {
-                    .value = 0,
-                    .minimum = 0,
-                    .maximum = penArgs.maxPressure,
-            },
-    };
-
-    ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup);
-
-    /* Setup tilt X axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-            .code = ABS_TILT_X,
-            .absinfo = {
-                    .value = 0,
-                    .minimum = -penArgs.maxTiltX,
-                    .maximum = penArgs.maxTiltX,
-            },
-    };
-
-    ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup);
-
-    /* Setup tilt Y axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-            .code = ABS_TILT_Y,
-            .absinfo = {
-                    .value = 0,
-                    .minimum = -penArgs.maxTiltY,
-                    .maximum = penArgs.maxTiltY,
-            },
-    };
-
-    ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup);
-
-    struct uinput_setup uinput_setup = (struct uinput_setup) {
-        .id = {
-            .bustype = BUS_USB,
-            .vendor = penArgs.vendorId,
-            .product = penArgs.productId,
-            .version = penArgs.versionId,
-        },
-    };
-
-    memcpy(uinput_setup.name, penArgs.productName, UINPUT_MAX_NAME_SIZE);
-
-    ioctl(fd, UI_DEV_SETUP, &uinput_setup);
-    ioctl(fd, UI_DEV_CREATE);
-
-    return fd;
+    if (capabilityCache != nullptr) {
+        capabilityCache->store(handle, capabilities);
+    }
+
+    return true;
 }
 
-int transfer_handler::create_pad(const uinput_pad_args& padArgs) {
-    int fd = -1;
-    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (fd < 0) {
-        std::cout << "Could not create uinput pad" << std::endl;
-        return false;
+void transfer_handler::revalidateCapabilities(libusb_device_handle* handle) {
+    device_capabilities cached;
+    device_capabilities current;
+    if (capabilityCache == nullptr || !capabilityCache->lookup(handle, cached) ||
+        !readCapabilities(handle, current)) {
+        return;
+    }
+
+    if (current != cached) {
+        // The virtual devices keep what they were created with, the device picks up the new ranges when it is plugged
+        // in again
+        std::cout << "Cached capabilities were out of date. Got max-width: " << current.maxWidth << " max-height: "
+                  << current.maxHeight << " max-pressure: " << current.maxPressure << std::endl;
+        capabilityCache->store(handle, current);
+    }
+}
+
+void transfer_handler::setDisconnectGracePeriod(long ms) {
+    disconnectGracePeriodMs = std::max(0L, ms);
+}
+
+uint64_t transfer_handler::expireParkedDevices(uint64_t now) {
+    uint64_t nextExpiry = 0;
+    auto parked = parkedDevices.begin();
+    while (parked != parkedDevices.end()) {
+        if (parked->expiresAt <= now) {
+            std::cout << "Device did not come back in time, removing its virtual device" << std::endl;
+            deviceSignatures.erase(parked->device);
+            outputSink->destroyDevice(parked->device);
+            parked = parkedDevices.erase(parked);
+            continue;
+        }
+
+        if (nextExpiry == 0 || parked->expiresAt < nextExpiry) {
+            nextExpiry = parked->expiresAt;
+        }
+
+        ++parked;
     }
 
-    auto set_evbit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_EVBIT, evBit);
-    };
+    return nextExpiry;
+}
 
-    auto set_keybit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_KEYBIT, evBit);
-    };
+void transfer_handler::destroyOutputDevices(device_context* context) {
+    for (input_event_batch* batch : {&context->penEvents, &context->padEvents, &context->pointerEvents}) {
+        if (batch->getDevice() >= 0) {
+            deviceSignatures.erase(batch->getDevice());
+            outputSink->destroyDevice(batch->getDevice());
+            batch->setDevice(-1);
+        }
+    }
+}
 
-    auto set_absbit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_ABSBIT, evBit);
-    };
+void transfer_handler::parkOutputDevices(device_context* context) {
+    uint64_t now = event_loop::monotonicNow();
+
+    struct timeval eventTime;
+    eventTime.tv_sec = now / 1000000000;
+    eventTime.tv_usec = (now % 1000000000) / 1000;
+
+    // Lift the pen and let go of its buttons so that nothing stays pressed while the tablet is away
+    if (context->penEvents.getDevice() >= 0) {
+        context->penEvents.setTimestamp(eventTime);
+        uinput_send(context->penEvents, EV_KEY, BTN_TOUCH, 0);
+        uinput_send(context->penEvents, EV_ABS, ABS_PRESSURE, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_STYLUS2, 0);
+        uinput_send(context->penEvents, EV_KEY, BTN_TOOL_PEN, 0);
+        uinput_send(context->penEvents, EV_SYN, SYN_REPORT, 0);
+        context->penEvents.flush();
+    }
+
+    // The same goes for the keys of a pad button held down. The context that picks the pad up again doesn't know
+    // about that button, so its release would never be sent otherwise.
+    if (context->padEvents.getDevice() >= 0 && context->lastPressedButton > 0 &&
+        context->lastPressedButton <= (long)padButtonAliases.size()) {
+        context->padEvents.setTimestamp(eventTime);
+        auto padMap = padMapping.getPadMap(padButtonAliases[context->lastPressedButton - 1]);
+        for (auto pmap : padMap) {
+            uinput_send(context->padEvents, pmap.event_type, pmap.event_value, 0);
+        }
+        uinput_send(context->padEvents, EV_SYN, SYN_REPORT, 0);
+        context->padEvents.flush();
+        context->lastPressedButton = -1;
+    }
+
+    uint64_t expiresAt = now + (uint64_t)disconnectGracePeriodMs * 1000000;
+    for (input_event_batch* batch : {&context->penEvents, &context->padEvents, &context->pointerEvents}) {
+        int device = batch->getDevice();
+        if (device < 0) {
+            continue;
+        }
+
+        // Devices attached without an identity could be mistaken for another one of the same model
+        auto signature = deviceSignatures.find(device);
+        if (signature == deviceSignatures.end()) {
+            outputSink->destroyDevice(device);
+        } else {
+            parkedDevices.push_back({device, signature->second, expiresAt});
+        }
+
+        batch->setDevice(-1);
+    }
+}
+
+std::vector<handed_off_device> transfer_handler::handOffDevices() {
+    for (auto context : deviceContexts) {
+        parkOutputDevices(context.second);
+    }
+
+    std::vector<handed_off_device> handedOff;
+    for (auto parked : parkedDevices) {
+        int fd = outputSink->exportDevice(parked.device);
+        if (fd < 0) {
+            outputSink->destroyDevice(parked.device);
+            continue;
+        }
 
-    auto set_relbit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_RELBIT, evBit);
-    };
+        handedOff.push_back({0, 0, fd, parked.signature});
+        outputSink->releaseDevice(parked.device);
+    }
 
-    auto set_mscbit = [&fd](int evBit) {
-        ioctl(fd, UI_SET_MSCBIT, evBit);
-    };
+    parkedDevices.clear();
+    deviceSignatures.clear();
 
-    set_evbit(EV_SYN);
-    set_evbit(EV_KEY);
-    set_evbit(EV_ABS);
-    set_evbit(EV_REL);
+    return handedOff;
+}
 
-    // This is for all of the pad buttons
-    for (int index = 0; index < padArgs.padButtonAliases.size(); ++index) {
-        set_keybit(padArgs.padButtonAliases[index]);
+void transfer_handler::adoptDevice(const handed_off_device& handedOff, long gracePeriodMs) {
+    int device = outputSink->adoptDevice(handedOff.fd);
+    if (device < 0) {
+        close(handedOff.fd);
+        return;
     }
 
-    // But we also send through all the keys since they can be mapped
-    for (int index = KEY_RESERVED; index <= KEY_MICMUTE; ++index) {
-        set_keybit(index);
+    uint64_t expiresAt = event_loop::monotonicNow() + (uint64_t)std::max(0L, gracePeriodMs) * 1000000;
+    parkedDevices.push_back({device, handedOff.signature, expiresAt});
+    deviceSignatures[device] = handedOff.signature;
+}
+
+int transfer_handler::takeParkedDevice(const std::string& signature) {
+    if (signature.empty()) {
+        return -1;
     }
 
-    set_relbit(REL_X);
-    set_relbit(REL_Y);
-    set_relbit(REL_WHEEL);
-    set_relbit(REL_HWHEEL);
+    for (auto parked = parkedDevices.begin(); parked != parkedDevices.end(); ++parked) {
+        if (parked->signature == signature) {
+            int device = parked->device;
+            parkedDevices.erase(parked);
+            std::cout << "Device came back within its grace period, reusing its virtual device" << std::endl;
+            return device;
+        }
+    }
 
-    if (padArgs.hasWheel) {
+    return -1;
+}
 
-        // Setup relative wheel
-        struct uinput_abs_setup uinput_abs_setup = (struct uinput_abs_setup) {
-            .code = REL_WHEEL,
-            .absinfo = {
-                    .value = 0,
-                    .minimum = -padArgs.wheelMax,
-                    .maximum = padArgs.wheelMax,
-            },
-        };
+void transfer_handler::setReportLength(unsigned char reportId, size_t length) {
+    reportLengths[reportId] = length;
+}
 
-        ioctl(fd, UI_ABS_SETUP, uinput_abs_setup);
+void transfer_handler::rememberDevice(int device, const std::string& signature) {
+    if (device >= 0 && !signature.empty()) {
+        deviceSignatures[device] = signature;
     }
+}
 
-    if (padArgs.hasHWheel) {
-        // Setup relative hwheel
-        struct uinput_abs_setup uinput_abs_setup = (struct uinput_abs_setup) {
-                .code = REL_HWHEEL,
-                .absinfo = {
-                        .value = 0,
-                        .minimum = -padArgs.hWheelMax,
-                        .maximum = padArgs.hWheelMax,
-                },
-        };
+std::vector<libusb_device_handle*> transfer_handler::getMessageTargets() {
+    std::vector<libusb_device_handle*> targets;
 
-        ioctl(fd, UI_ABS_SETUP, uinput_abs_setup);
+    for (auto context : deviceContexts) {
+        if (context.second->penEvents.getDevice() >= 0) {
+            targets.push_back(context.first);
+        }
     }
 
-    struct uinput_setup uinput_setup = (struct uinput_setup) {
-        .id ={
-                .bustype = BUS_USB,
-                .vendor = padArgs.vendorId,
-                .product = padArgs.productId,
-                .version = padArgs.versionId,
-        },
-    };
+    return targets;
+}
 
-    memcpy(uinput_setup.name, padArgs.productName, UINPUT_MAX_NAME_SIZE);
+int transfer_handler::create_pen(const uinput_pen_args& penArgs) {
+    std::string signature;
+    if (!attachingIdentity.empty()) {
+        std::stringstream signatureStream;
+        signatureStream << attachingIdentity << "/pen/" << penArgs.maxWidth << "," << penArgs.maxHeight << ","
+                        << penArgs.maxPressure << "," << penArgs.maxTiltX << "," << penArgs.maxTiltY << ","
+                        << penArgs.vendorId << "," << penArgs.productId << "," << penArgs.versionId << ","
+                        << std::string(penArgs.productName, strnlen(penArgs.productName, UINPUT_MAX_NAME_SIZE));
+        signature = signatureStream.str();
+    }
 
-    ioctl(fd, UI_DEV_SETUP, &uinput_setup);
-    ioctl(fd, UI_DEV_CREATE);
+    int device = takeParkedDevice(signature);
+    if (device < 0) {
+        device = outputSink->createPen(penArgs);
+        rememberDevice(device, signature);
+    }
 
-    return fd;
+    return device;
 }
 
-int transfer_handler::create_pointer(const uinput_pointer_args &pointerArgs) {
-    int fd = -1;
-    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (fd < 0) {
-        std::cout << "Could not create uinput pointer" << std::endl;
-        return false;
+int transfer_handler::create_pad(const uinput_pad_args& padArgs) {
+    std::string signature;
+    if (!attachingIdentity.empty()) {
+        std::stringstream signatureStream;
+        signatureStream << attachingIdentity << "/pad/";
+        for (auto alias : padArgs.padButtonAliases) {
+            signatureStream << alias << ",";
+        }
+
+        signatureStream << padArgs.hasWheel << "," << padArgs.hasHWheel << "," << padArgs.wheelMax << ","
+                        << padArgs.hWheelMax << "," << padArgs.vendorId << "," << padArgs.productId << ","
+                        << padArgs.versionId << ","
+                        << std::string(padArgs.productName, strnlen(padArgs.productName, UINPUT_MAX_NAME_SIZE));
+        signature = signatureStream.str();
+    }
+
+    int device = takeParkedDevice(signature);
+    if (device < 0) {
+        device = outputSink->createPad(padArgs);
+        rememberDevice(device, signature);
     }
 
-    ioctl(fd, UI_SET_EVBIT, EV_KEY);
-    ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
-    ioctl(fd, UI_SET_EVBIT, EV_REL);
-    ioctl(fd, UI_SET_RELBIT, REL_X);
-    ioctl(fd, UI_SET_RELBIT, REL_Y);
-    ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
-
-    // Setup relative wheel
-    struct uinput_abs_setup uinput_abs_setup = (struct uinput_abs_setup) {
-            .code = REL_WHEEL,
-            .absinfo = {
-                    .value = 0,
-                    .minimum = -pointerArgs.wheelMax,
-                    .maximum = pointerArgs.wheelMax,
-            },
-    };
-
-    ioctl(fd, UI_ABS_SETUP, uinput_abs_setup);
-
-    struct uinput_setup uinput_setup = (struct uinput_setup) {
-            .id ={
-                    .bustype = BUS_USB,
-                    .vendor = pointerArgs.vendorId,
-                    .product = pointerArgs.productId,
-                    .version = pointerArgs.versionId,
-            },
-    };
-
-    memcpy(uinput_setup.name, pointerArgs.productName, UINPUT_MAX_NAME_SIZE);
-
-    ioctl(fd, UI_DEV_SETUP, &uinput_setup);
-    ioctl(fd, UI_DEV_CREATE);
-
-    return fd;
+    return device;
 }
 
-void transfer_handler::destroy_uinput_device(int fd) {
-    ioctl(fd, UI_DEV_DESTROY);
+int transfer_handler::create_pointer(const uinput_pointer_args& pointerArgs) {
+    std::string signature;
+    if (!attachingIdentity.empty()) {
+        std::stringstream signatureStream;
+        signatureStream << attachingIdentity << "/pointer/" << pointerArgs.wheelMax << "," << pointerArgs.vendorId
+                        << "," << pointerArgs.productId << "," << pointerArgs.versionId << ","
+                        << std::string(pointerArgs.productName,
+                                       strnlen(pointerArgs.productName, UINPUT_MAX_NAME_SIZE));
+        signature = signatureStream.str();
+    }
+
+    int device = takeParkedDevice(signature);
+    if (device < 0) {
+        device = outputSink->createPointer(pointerArgs);
+        rememberDevice(device, signature);
+    }
+
+    return device;
 }
 
 void transfer_handler::submitMapping(const nlohmann::json& config) {
@@ -446,4 +492,8 @@ void transfer_handler::submitMapping(const nlohmann::json& config) {
             }
         }
     }
+
+    // The decoders only ever read the compiled tables
+    padMapping.compile(padButtonAliases);
+    dialMapping.compile();
 }
\ No newline at end of file
@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <libusb-1.0/libusb.h>
 #include <vector>
 #include <string>
+#include <map>
 #include "uinput_pen_args.h"
 #include "uinput_pad_args.h"
 #include "uinput_pointer_args.h"
@@ -30,6 +31,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "pad_mapping.h"
 #include "dial_mapping.h"
 #include "unix_socket_message.h"
+#include "input_event_batch.h"
+#include "device_context.h"
+#include "output_sink.h"
+#include "uinput_output_sink.h"
+#include "usb_transport.h"
+#include "capability_cache.h"
+#include "handed_off_device.h"
+
+// Whether transfers are kept submitted on an IN endpoint of an attached interface
+enum endpoint_subscription {
+    alwaysSubscribe = 0,
+    neverSubscribe,
+    // Dropped again once the endpoint has sent a few reports and not one of them could be decoded
+    probeSubscription
+};
 
 class transfer_handler {
 public:
@@ -41,30 +57,91 @@ public:
     virtual nlohmann::json getConfig();
     virtual int sendInitKeyOnInterface() = 0;
     virtual bool attachToInterfaceId(int interfaceId) = 0;
+    virtual endpoint_subscription getEndpointSubscription(unsigned char endpoint);
     virtual bool attachDevice(libusb_device_handle* handle, int interfaceId) = 0;
+    // Reads what attaching the device needs to know about it. Talks to the device, so it is meant to be done before
+    // taking the attach lock. False when the tablet has no capabilities or they could not be read.
+    virtual bool prepareAttach(libusb_device_handle* handle, device_capabilities& capabilities);
+    // Attaches a device that can be told apart from others of the same model by its identity. Virtual devices parked
+    // under the same identity with the same ranges are taken over instead of created anew. The capabilities are the
+    // ones prepareAttach read, null when it couldn't.
+    bool attach(libusb_device_handle* handle, int interfaceId, const std::string& identity,
+                const device_capabilities* capabilities);
     virtual void detachDevice(libusb_device_handle* handle);
-    virtual bool handleTransferData(libusb_device_handle* handle, unsigned char* data, size_t dataLen) = 0;
-    virtual std::vector<unix_socket_message*> handleMessage(unix_socket_message* message);
+    virtual bool handleTransferData(device_context* context, unsigned char* data, size_t dataLen) = 0;
+    // The devices messages from the GUI for this product go out to, those that got a pen
+    virtual std::vector<libusb_device_handle*> getMessageTargets();
     virtual bool isAliasedProduct(int productId) { return false; }
     virtual int getAliasedProductId(libusb_device_handle* handle, int originalId) { return originalId; }
+
+    virtual device_context* getDeviceContext(libusb_device_handle* handle);
+    // Where the virtual devices get created and their events written to, uinput unless replaced
+    void setOutputSink(output_sink* sink);
+    // The USB stack the handled devices hang off, set by the vendor handler
+    void setTransport(usb_transport* usbTransport);
+    void setCapabilityCache(capability_cache* cache);
+    // How long the virtual devices of a detached device are kept in case it comes back, 0 destroys them right away
+    void setDisconnectGracePeriod(long ms);
+    // Destroys parked virtual devices whose grace period is over by now. Returns when the next one is up, 0 for never.
+    uint64_t expireParkedDevices(uint64_t now);
+    // Lifts the pens and lets go of every virtual device for another process to take over. Only the fds and
+    // signatures of the records are filled in.
+    std::vector<handed_off_device> handOffDevices();
+    // Parks a device handed over by another process until its tablet attaches here
+    void adoptDevice(const handed_off_device& handedOff, long gracePeriodMs);
+    // Reads the capabilities the tablet reports about itself, false when it has none or they could not be read
+    virtual bool readCapabilities(libusb_device_handle* handle, device_capabilities& capabilities) { return false; }
+    // Checks capabilities an attached device came up with from the cache against the device itself
+    void revalidateCapabilities(libusb_device_handle* handle);
+    std::vector<device_context*> getDeviceContexts();
+
+    // Decodes the reports of a completed transfer and writes out every event they produced, all stamped with the
+    // monotonic time in nanoseconds at which the transfer completed. Returns whether any of them could be decoded.
+    bool processTransfer(device_context* context, unsigned char* data, size_t dataLen, uint64_t completedAt);
 protected:
-    virtual bool uinput_send(int fd, uint16_t type, uint16_t code, int32_t value);
+    virtual bool uinput_send(input_event_batch& batch, uint16_t type, uint16_t code, int32_t value);
     virtual int create_pen(const uinput_pen_args& penArgs);
     virtual int create_pad(const uinput_pad_args& padArgs);
     virtual int create_pointer(const uinput_pointer_args& pointerArgs);
-    virtual void destroy_uinput_device(int fd);
+    void destroyOutputDevices(device_context* context);
+    void parkOutputDevices(device_context* context);
+    int takeParkedDevice(const std::string& signature);
+    void rememberDevice(int device, const std::string& signature);
+    // Lets a transfer holding several reports of this id back to back be split into them
+    void setReportLength(unsigned char reportId, size_t length);
+    // The ones read before attaching for the device being attached, otherwise fetched
+    bool getCapabilities(libusb_device_handle* handle, device_capabilities& capabilities);
+    // From the cache for tablets seen before, otherwise read from the device and cached
+    bool fetchCapabilities(libusb_device_handle* handle, device_capabilities& capabilities);
 
     virtual void submitMapping(const nlohmann::json& config);
 
     std::vector<int> productIds;
 
-    std::map<libusb_device_handle*, int> uinputPens;
-    std::map<libusb_device_handle*, int> uinputPads;
-    std::map<libusb_device_handle*, int> uinputPointers;
-
-    std::map<libusb_device_handle*, long> lastPressedButton;
+    // Only used when devices come and go, never while handling reports
+    std::map<libusb_device_handle*, device_context*> deviceContexts;
 
     std::vector<int> padButtonAliases;
+    // By report id, 0 where the length isn't known
+    size_t reportLengths[256] = {0};
+    output_sink* outputSink = uinput_output_sink::shared();
+    usb_transport* transport = nullptr;
+    capability_cache* capabilityCache = nullptr;
+
+    // Virtual devices of devices that went away, kept for the grace period
+    struct parked_device {
+        int device;
+        // Identity of the physical device plus everything the virtual device was created with
+        std::string signature;
+        uint64_t expiresAt;
+    };
+
+    std::string attachingIdentity;
+    libusb_device_handle* attachingHandle = nullptr;
+    const device_capabilities* attachingCapabilities = nullptr;
+    std::map<int, std::string> deviceSignatures;
+    std::vector<parked_device> parkedDevices;
+    long disconnectGracePeriodMs = 0;
 
     pad_mapping padMapping;
     dial_mapping dialMapping;
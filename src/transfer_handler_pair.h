@@ -19,10 +19,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef USERSPACE_TABLET_DRIVER_DAEMON_TRANSFER_HANDLER_PAIR_H
 #define USERSPACE_TABLET_DRIVER_DAEMON_TRANSFER_HANDLER_PAIR_H
 
+#include "transfer_queue.h"
+#include "device_context.h"
+
 struct transfer_handler_pair {
 public:
     vendor_handler* vendorHandler;
     transfer_handler* transferHandler;
+    device_context* context;
+    transfer_queue* queue;
 };
 
 #endif //USERSPACE_TABLET_DRIVER_DAEMON_TRANSFER_HANDLER_PAIR_H
@@ -0,0 +1,56 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_TRANSFER_QUEUE_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_TRANSFER_QUEUE_H
+
+#include <libusb-1.0/libusb.h>
+#include <vector>
+#include <deque>
+#include "device_message_exchange.h"
+
+// All of the transfers that are kept in flight on a single IN endpoint
+struct transfer_queue {
+public:
+    libusb_device_handle* handle;
+    unsigned char endpoint;
+    int productId;
+
+    std::vector<libusb_transfer*> transfers;
+    int submitted;
+
+    unsigned long completed;
+    // Completions where no other transfer was left submitted, meaning reports could have had to wait
+    unsigned long ranDry;
+
+    // Reports the decoder made use of and ones it had nothing for
+    unsigned long decoded;
+    unsigned long discarded;
+    // Still deciding whether the endpoint is worth keeping transfers on
+    bool probing;
+    // Set once the transfers are being taken down, when the device goes away or the endpoint is unsubscribed from.
+    // Whatever comes back from then on is released without being resubmitted or touching the device context, which may
+    // be gone already.
+    bool stopping;
+
+    // Messages sent to the device that it answers on this endpoint, in the order they went out
+    std::deque<device_message_exchange*> awaitingResponses;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_TRANSFER_QUEUE_H
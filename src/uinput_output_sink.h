@@ -0,0 +1,45 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_UINPUT_OUTPUT_SINK_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_UINPUT_OUTPUT_SINK_H
+
+#include "output_sink.h"
+
+// Creates real devices through /dev/uinput, the device ids are the uinput fds
+class uinput_output_sink : public output_sink {
+public:
+    // All handlers share this one unless told otherwise
+    static output_sink* shared();
+
+    int createPen(const uinput_pen_args& penArgs) override;
+    int createPad(const uinput_pad_args& padArgs) override;
+    int createPointer(const uinput_pointer_args& pointerArgs) override;
+
+    bool write(int device, const struct input_event* events, size_t count) override;
+    void destroyDevice(int device) override;
+
+    // A uinput device only goes away with the last fd referring to it, so a copy of its fd keeps it alive
+    int exportDevice(int device) override;
+    int adoptDevice(int fd) override;
+    void releaseDevice(int device) override;
+};
+
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_UINPUT_OUTPUT_SINK_H
@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define USERSPACE_TABLET_DRIVER_DAEMON_UINPUT_PAD_ARGS_H
 
 #include <linux/uinput.h>
+#include <vector>
 
 struct uinput_pad_args {
 public:
@@ -19,46 +19,103 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include "unix_socket_message_queue.h"
 
-unix_socket_message_queue::unix_socket_message_queue() {
-    messages[message_destination::driver] = std::map<short, std::vector<unix_socket_message*> >();
-    messages[message_destination::gui] = std::map<short, std::vector<unix_socket_message*> >();
+unix_socket_message_queue::unix_socket_message_queue() : droppedMessages(0) {
+    drained.reserve(capacity);
 }
 
 unix_socket_message_queue::~unix_socket_message_queue() {
+    unix_socket_message* message;
+    for (auto& queue : queues) {
+        while (queue.pop(message)) {
+            pool.release(message);
+        }
+    }
 
+    for (auto& consumer : sorted) {
+        for (auto sortedMessage : consumer.second) {
+            pool.release(sortedMessage);
+        }
+    }
 }
 
-void unix_socket_message_queue::addMessage(unix_socket_message *message) {
+void unix_socket_message_queue::addConsumer(message_destination destination, short vendor) {
+    // Sized up front so sorting never allocates
+    sorted[std::make_pair(destination, vendor)].reserve(capacity);
+}
+
+pooled_message unix_socket_message_queue::newMessage(size_t dataLength) {
+    return pool.acquire(dataLength);
+}
+
+bool unix_socket_message_queue::addMessage(pooled_message message) {
     if (message == nullptr) {
-        return;
+        return false;
+    }
+
+    // The destination comes straight off the socket
+    if (message->destination < message_destination::driver || message->destination > message_destination::gui) {
+        std::cout << "Dropping message for unknown destination " << message->destination << std::endl;
+        droppedMessages++;
+        return false;
     }
 
-    auto record = messages[message->destination].find(message->vendor);
-    if (record == messages[message->destination].end()) {
-        messages[message->destination][message->vendor] = std::vector<unix_socket_message*>();
+    if (!queues[message->destination].push(message.get())) {
+        std::cout << "Dropping message, the queue for destination " << message->destination << " is full" << std::endl;
+        droppedMessages++;
+        return false;
     }
 
-    messages[message->destination][message->vendor].push_back(message);
+    message.release();
+    return true;
 }
 
-std::vector<unix_socket_message*> unix_socket_message_queue::getMessagesFor(message_destination destination, short vendor) {
-    auto record = messages[destination].find(vendor);
-    if (record != messages[destination].end() && record->second.size() > 0) {
-        auto returnedItems = std::vector<unix_socket_message*>(record->second);
-        record->second.clear();
-        return returnedItems;
+void unix_socket_message_queue::getMessagesFor(message_destination destination, short vendor,
+                                               std::vector<pooled_message>& messages) {
+    if (destination < message_destination::driver || destination > message_destination::gui) {
+        return;
     }
 
-    return std::vector<unix_socket_message*>();
+    // Sort whatever came in since the last call by vendor, the other vendors pick theirs up from there. Nobody would
+    // ever take out the ones for a vendor without a consumer.
+    drained.clear();
+    queues[destination].popAll(drained);
+    for (auto message : drained) {
+        auto consumer = sorted.find(std::make_pair(destination, message->vendor));
+        if (consumer == sorted.end()) {
+            std::cout << "Dropping message for vendor " << message->vendor << ", nothing takes them out" << std::endl;
+            pool.release(message);
+            droppedMessages++;
+        } else if (consumer->second.size() >= capacity) {
+            std::cout << "Dropping message, too many are waiting for vendor " << message->vendor << std::endl;
+            pool.release(message);
+            droppedMessages++;
+        } else {
+            consumer->second.push_back(message);
+        }
+    }
+
+    auto record = sorted.find(std::make_pair(destination, vendor));
+    if (record != sorted.end()) {
+        for (auto message : record->second) {
+            messages.push_back(pool.adopt(message));
+        }
+
+        record->second.clear();
+    }
 }
 
-std::vector<unix_socket_message*> unix_socket_message_queue::getResponses() {
-    auto returnedItems = std::vector<unix_socket_message*>();
-    for (auto it = messages[message_destination::gui].begin(); it != messages[message_destination::gui].end(); ++it) {
-        returnedItems.insert(returnedItems.end(), it->second.begin(), it->second.end());
+void unix_socket_message_queue::getResponses(std::vector<pooled_message>& responses) {
+    drained.clear();
+    queues[message_destination::gui].popAll(drained);
+    for (auto response : drained) {
+        responses.push_back(pool.adopt(response));
     }
+}
 
-    messages[message_destination::gui].clear();
+unsigned long unix_socket_message_queue::getDroppedMessages() {
+    return droppedMessages;
+}
 
-    return returnedItems;
+message_pool* unix_socket_message_queue::getMessagePool() {
+    return &pool;
 }
@@ -21,19 +21,45 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 #include "unix_socket_message.h"
+#include "message_pool.h"
+#include "mpsc_queue.h"
+#include <atomic>
 #include <vector>
 #include <map>
+#include <utility>
 
+// Messages between the sockets, the vendor handlers and the event handler. Any thread may add messages, but only the
+// control thread takes them out. Each destination has a bounded lock-free queue of its own. The messages all come from
+// the queue's pool and go back there once their owner lets go of them.
 class unix_socket_message_queue {
 public:
     unix_socket_message_queue();
     ~unix_socket_message_queue();
 
-    void addMessage(unix_socket_message* message);
-    std::vector<unix_socket_message*> getMessagesFor(message_destination destination, short vendor);
-    std::vector<unix_socket_message*> getResponses();
+    // Only messages for destinations and vendors that are taken out are kept, the others are dropped when the queue is
+    // drained. Called by the control thread before it starts asking for them.
+    void addConsumer(message_destination destination, short vendor);
+
+    pooled_message newMessage(size_t dataLength);
+    // Takes over the message. One that doesn't fit is dropped right away and false is returned.
+    bool addMessage(pooled_message message);
+    // These append to the caller's vector, so one that is kept around doesn't have to grow again on every call
+    void getMessagesFor(message_destination destination, short vendor, std::vector<pooled_message>& messages);
+    void getResponses(std::vector<pooled_message>& responses);
+
+    unsigned long getDroppedMessages();
+    message_pool* getMessagePool();
+
+    static const size_t capacity = 1024;
 private:
-    std::map<message_destination, std::map<short, std::vector<unix_socket_message*> > > messages;
+    message_pool pool;
+
+    mpsc_queue<unix_socket_message*, capacity> queues[message_destination::gui + 1];
+    // Taken off the queues but not asked for yet, by destination and vendor. Each holds up to capacity messages and is
+    // only touched by the control thread.
+    std::map<std::pair<message_destination, short>, std::vector<unix_socket_message*> > sorted;
+    std::vector<unix_socket_message*> drained;
+    std::atomic<unsigned long> droppedMessages;
 };
 
 
@@ -18,37 +18,49 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
 #include "usb_devices.h"
 
-usb_devices::usb_devices() {
-    libusb_init(&context);
-//    libusb_set_option(context, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_DEBUG);
+usb_devices::usb_devices(usb_transport* transport) : transport(transport) {
 }
 
 void usb_devices::handleEvents() {
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 1;
-    libusb_handle_events_timeout_completed(context, &tv, NULL);
+    transport->handleEvents();
+}
+
+void usb_devices::registerEventSources(event_loop* loop) {
+    transport->registerEventSources(loop);
+}
+
+int usb_devices::getNextTimeout() {
+    return transport->getNextTimeout();
 }
 
-libusb_context* usb_devices::getContext() {
-    return context;
+usb_transport* usb_devices::getTransport() {
+    return transport;
+}
+
+void usb_devices::setProbeWorkers(int workers) {
+    probeWorkers = std::max(1, workers);
+}
+
+const std::vector<device_startup>& usb_devices::getStartupTimes() {
+    return startupTimes;
 }
 
 std::map<short, std::vector<short> > usb_devices::getCandidateDevices(const std::map<short, vendor_handler*> vendorHandlers) {
     std::map<short, std::vector<short> > supportedDevices;
-    ssize_t num = libusb_get_device_list(context, &lusb_list);
+    ssize_t num = transport->getDeviceList(&lusb_list);
     if (LIBUSB_ERROR_NO_MEM == num) {
         return supportedDevices;
     }
 
     // Handle any already connected devices
-    for (ssize_t index = 0; index < num; ++index) {
-        libusb_device *lusb_dev = lusb_list[index];
-
-        handleDeviceAttach(vendorHandlers, lusb_dev);
-    }
+    probeDevices(vendorHandlers, lusb_list, num);
 
     // Return a full list of handle-able devices
     for (auto handler : vendorHandlers) {
@@ -61,10 +73,94 @@ std::map<short, std::vector<short> > usb_devices::getCandidateDevices(const std:
     return supportedDevices;
 }
 
+void usb_devices::probeDevices(const std::map<short, vendor_handler*>& vendorHandlers, libusb_device** list,
+                               ssize_t count) {
+    struct probe {
+        vendor_handler* handler;
+        libusb_device* device;
+        struct libusb_device_descriptor descriptor;
+        device_startup startup;
+    };
+
+    std::vector<probe> probes;
+    for (ssize_t index = 0; index < count; ++index) {
+        struct libusb_device_descriptor descriptor;
+        transport->getDeviceDescriptor(list[index], &descriptor);
+
+        auto handler = vendorHandlers.find(descriptor.idVendor);
+        if (handler == vendorHandlers.end()) {
+            continue;
+        }
+
+        auto productIds = handler->second->getProductIds();
+        if (std::find(productIds.begin(), productIds.end(), descriptor.idProduct) == productIds.end()) {
+            continue;
+        }
+
+        probes.push_back({handler->second, list[index], descriptor,
+                          {descriptor.idVendor, descriptor.idProduct, false, 0, 0}});
+    }
+
+    if (probes.empty()) {
+        return;
+    }
+
+    // Claiming a device takes a number of synchronous control transfers that each may run into their timeout. Doing
+    // them for all devices at once means the slowest one decides how long startup takes rather than the sum of all.
+    for (auto handler : vendorHandlers) {
+        handler.second->holdTransfers();
+    }
+
+    uint64_t start = event_loop::monotonicNow();
+    std::atomic<size_t> nextProbe(0);
+    auto worker = [&probes, &nextProbe, start]() {
+        size_t index;
+        while ((index = nextProbe++) < probes.size()) {
+            probe& current = probes[index];
+            uint64_t probeStart = event_loop::monotonicNow();
+            current.startup.claimed = current.handler->probeProduct(current.device, current.descriptor);
+            uint64_t probeEnd = event_loop::monotonicNow();
+            current.startup.probeNs = probeEnd - probeStart;
+            current.startup.claimedAfterNs = probeEnd - start;
+        }
+    };
+
+    size_t workerCount = std::min((size_t)probeWorkers, probes.size());
+    std::vector<std::thread> workers;
+    for (size_t index = 1; index < workerCount; ++index) {
+        workers.emplace_back(worker);
+    }
+    worker();
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    for (auto handler : vendorHandlers) {
+        handler.second->releaseTransfers();
+    }
+
+    for (auto& current : probes) {
+        std::cout << "Probed " << std::hex << std::setfill('0') << std::setw(4) << current.startup.vendorId << ":"
+                  << std::setw(4) << current.startup.productId << std::dec << std::setfill(' ')
+                  << (current.startup.claimed ? " in " : " and failed after ")
+                  << current.startup.probeNs / 1000000.0 << "ms" << std::endl;
+        startupTimes.push_back(current.startup);
+
+        // Devices that weren't ready yet get retried from the event loop
+        if (!current.startup.claimed) {
+            current.handler->retryProductAttach(current.device, current.descriptor);
+        }
+    }
+
+    std::cout << "Probed " << probes.size() << " devices on " << workerCount << " threads in "
+              << (event_loop::monotonicNow() - start) / 1000000.0 << "ms" << std::endl;
+}
+
 void usb_devices::handleDeviceAttach(const std::map<short, vendor_handler *> vendorHandlers, struct libusb_device* device) {
     struct libusb_device_descriptor descriptor;
 
-    libusb_get_device_descriptor(device, &descriptor);
+    transport->getDeviceDescriptor(device, &descriptor);
     if (vendorHandlers.find(descriptor.idVendor) != vendorHandlers.end()) {
         if (vendorHandlers.at(descriptor.idVendor)->handleProductAttach(device, descriptor)) {
 
@@ -75,7 +171,7 @@ void usb_devices::handleDeviceAttach(const std::map<short, vendor_handler *> ven
 void usb_devices::handleDeviceDetach(const std::map<short, vendor_handler *> vendorHandlers, struct libusb_device *device) {
     struct libusb_device_descriptor descriptor;
 
-    libusb_get_device_descriptor(device, &descriptor);
+    transport->getDeviceDescriptor(device, &descriptor);
     if (vendorHandlers.find(descriptor.idVendor) != vendorHandlers.end()) {
         vendorHandlers.at(descriptor.idVendor)->handleProductDetach(device, descriptor);
     }
@@ -21,22 +21,45 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <libusb-1.0/libusb.h>
 #include <map>
+#include <vector>
 #include "vendor_handler.h"
+#include "event_loop.h"
+#include "usb_transport.h"
+
+// How long bringing up a device that was already connected at startup took
+struct device_startup {
+    unsigned short vendorId;
+    unsigned short productId;
+    bool claimed;
+    // Time spent claiming this device, and from the start of probing until it was claimed
+    uint64_t probeNs;
+    uint64_t claimedAfterNs;
+};
 
 class usb_devices {
 public:
-    usb_devices();
+    usb_devices(usb_transport* transport);
 
-    libusb_context* getContext();
+    usb_transport* getTransport();
 
     void handleEvents();
+    void registerEventSources(event_loop* loop);
+    int getNextTimeout();
+
+    // Devices connected at startup are probed on up to this many threads at once
+    void setProbeWorkers(int workers);
+    const std::vector<device_startup>& getStartupTimes();
 
     std::map<short, std::vector<short> > getCandidateDevices(const std::map<short, vendor_handler*> vendorHandlers);
     void handleDeviceAttach(const std::map<short, vendor_handler*> vendorHandlers, struct libusb_device* device);
     void handleDeviceDetach(const std::map<short, vendor_handler *> vendorHandlers, struct libusb_device* device);
 private:
-    libusb_context *context = NULL;
+    usb_transport* transport;
     libusb_device **lusb_list = NULL;
+    int probeWorkers = 4;
+    std::vector<device_startup> startupTimes;
+
+    void probeDevices(const std::map<short, vendor_handler*>& vendorHandlers, libusb_device** list, ssize_t count);
 };
 
 
@@ -0,0 +1,75 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef USERSPACE_TABLET_DRIVER_DAEMON_USB_TRANSPORT_H
+#define USERSPACE_TABLET_DRIVER_DAEMON_USB_TRANSPORT_H
+
+#include <libusb-1.0/libusb.h>
+#include <cstdint>
+#include "event_loop.h"
+
+// Everything the daemon asks of the USB stack. The libusb types are only used as opaque handles so that a transport
+// which isn't libusb can hand out its own. Return values follow the libusb conventions.
+class usb_transport {
+public:
+    virtual ~usb_transport() = default;
+
+    // Hooks the transport into the event loop so that transfer callbacks run from there
+    virtual void registerEventSources(event_loop* loop) = 0;
+    virtual void handleEvents() = 0;
+    // Milliseconds until the transport needs handleEvents called without any of its fds being ready, -1 for never
+    virtual int getNextTimeout() = 0;
+
+    virtual ssize_t getDeviceList(libusb_device*** list) = 0;
+    virtual int getDeviceDescriptor(libusb_device* device, struct libusb_device_descriptor* descriptor) = 0;
+    // Keeps a device around after it was unplugged for as long as we still hold on to it
+    virtual void refDevice(libusb_device* device) = 0;
+    virtual void unrefDevice(libusb_device* device) = 0;
+    // Where the device is plugged in. Unlike the device itself this stays the same when it re-enumerates.
+    virtual uint8_t getBusNumber(libusb_device* device) = 0;
+    virtual int getPortNumbers(libusb_device* device, uint8_t* portNumbers, int length) = 0;
+    virtual int getConfigDescriptor(libusb_device* device, uint8_t index, struct libusb_config_descriptor** config) = 0;
+    virtual void freeConfigDescriptor(struct libusb_config_descriptor* config) = 0;
+    virtual int registerHotplugCallback(int vendorId, int productId, libusb_hotplug_callback_fn callback,
+                                        void* userData, libusb_hotplug_callback_handle* callbackHandle) = 0;
+    virtual void deregisterHotplugCallback(libusb_hotplug_callback_handle callbackHandle) = 0;
+
+    virtual int open(libusb_device* device, libusb_device_handle** handle) = 0;
+    virtual void close(libusb_device_handle* handle) = 0;
+    virtual int kernelDriverActive(libusb_device_handle* handle, int interfaceNumber) = 0;
+    virtual int detachKernelDriver(libusb_device_handle* handle, int interfaceNumber) = 0;
+    virtual int attachKernelDriver(libusb_device_handle* handle, int interfaceNumber) = 0;
+    virtual int claimInterface(libusb_device_handle* handle, int interfaceNumber) = 0;
+    virtual int releaseInterface(libusb_device_handle* handle, int interfaceNumber) = 0;
+
+    virtual int getStringDescriptor(libusb_device_handle* handle, uint8_t index, uint16_t langId,
+                                    unsigned char* data, int length) = 0;
+    virtual int controlTransfer(libusb_device_handle* handle, uint8_t requestType, uint8_t request, uint16_t value,
+                                uint16_t index, unsigned char* data, uint16_t length, unsigned int timeout) = 0;
+    virtual int interruptTransfer(libusb_device_handle* handle, unsigned char endpoint, unsigned char* data,
+                                  int length, int* transferred, unsigned int timeout) = 0;
+
+    // Transfers must be allocated by the transport they get submitted to
+    virtual struct libusb_transfer* allocTransfer() = 0;
+    virtual void freeTransfer(struct libusb_transfer* transfer) = 0;
+    virtual int submitTransfer(struct libusb_transfer* transfer) = 0;
+    virtual int cancelTransfer(struct libusb_transfer* transfer) = 0;
+};
+
+#endif //USERSPACE_TABLET_DRIVER_DAEMON_USB_TRANSPORT_H
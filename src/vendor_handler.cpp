@@ -16,11 +16,32 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <unistd.h>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <chrono>
 #include "vendor_handler.h"
 #include "transfer_handler_pair.h"
+#include "event_loop.h"
+#include "socket_server.h"
+
+std::mutex vendor_handler::attachMutex;
 
 vendor_handler::~vendor_handler() {
+    while (!pendingAttaches.empty()) {
+        cancelAttach(pendingAttaches.begin()->first);
+    }
+
+    while (!revalidationTimers.empty()) {
+        cancelRevalidation(revalidationTimers.begin()->first);
+    }
+
+    if (parkedExpiryTimer >= 0) {
+        eventLoop->cancelTimer(parkedExpiryTimer);
+    }
+
     for (auto deviceInterface : deviceInterfaces) {
         cleanupDevice(deviceInterface);
     }
@@ -30,14 +51,112 @@ void vendor_handler::setMessageQueue(unix_socket_message_queue *queue) {
     messageQueue = queue;
 }
 
+void vendor_handler::setTransferQueueDepth(int depth) {
+    transferQueueDepth = std::max(1, depth);
+}
+
+std::vector<transfer_queue*> vendor_handler::getTransferQueues() {
+    return transferQueues;
+}
+
+std::vector<device_context*> vendor_handler::getDeviceContexts() {
+    // Several product ids can share one transfer handler
+    std::set<transfer_handler*> seenHandlers;
+    std::vector<device_context*> contexts;
+    for (auto handler : productHandlers) {
+        if (!seenHandlers.insert(handler.second).second) {
+            continue;
+        }
+
+        auto handlerContexts = handler.second->getDeviceContexts();
+        contexts.insert(contexts.end(), handlerContexts.begin(), handlerContexts.end());
+    }
+
+    return contexts;
+}
+
+std::map<std::pair<int, unsigned char>, unsigned long> vendor_handler::getUnusedEndpoints() {
+    return unusedEndpoints;
+}
+
+void vendor_handler::setTransport(usb_transport* usbTransport) {
+    transport = usbTransport;
+
+    // Several product ids can share one transfer handler
+    std::set<transfer_handler*> seenHandlers;
+    for (auto handler : productHandlers) {
+        if (seenHandlers.insert(handler.second).second) {
+            handler.second->setTransport(usbTransport);
+        }
+    }
+}
+
+usb_transport* vendor_handler::getTransport() {
+    return transport;
+}
+
+void vendor_handler::setDataPlane(data_plane* plane) {
+    dataPlane = plane;
+}
+
+void vendor_handler::setEventLoop(event_loop* loop) {
+    eventLoop = loop;
+}
+
+void vendor_handler::setCapabilityCache(capability_cache* cache) {
+    capabilityCache = cache;
+
+    // Several product ids can share one transfer handler
+    std::set<transfer_handler*> seenHandlers;
+    for (auto handler : productHandlers) {
+        if (seenHandlers.insert(handler.second).second) {
+            handler.second->setCapabilityCache(cache);
+        }
+    }
+}
+
+void vendor_handler::setDisconnectGracePeriod(long ms) {
+    // Several product ids can share one transfer handler
+    std::set<transfer_handler*> seenHandlers;
+    for (auto handler : productHandlers) {
+        if (seenHandlers.insert(handler.second).second) {
+            runOnDataPlane([&handler, ms]() {
+                handler.second->setDisconnectGracePeriod(ms);
+            });
+        }
+    }
+}
+
+void vendor_handler::runOnDataPlane(const std::function<void()>& task) {
+    if (dataPlane == nullptr) {
+        task();
+        return;
+    }
+
+    dataPlane->call(task);
+}
+
+void vendor_handler::setReportCapture(report_capture* capture) {
+    reportCapture = capture;
+}
+
+transfer_handler* vendor_handler::getProductHandler(int productId) {
+    auto record = productHandlers.find(productId);
+    if (record == productHandlers.end()) {
+        return nullptr;
+    }
+
+    return record->second;
+}
+
 bool vendor_handler::setupReportProtocol(libusb_device_handle* handle, unsigned char interface_number) {
-    int err = libusb_control_transfer(handle,
-                                  0x21,
-                                  0x0b,
-                                  1,
-                                  interface_number,
-                                  NULL, 0,
-                                  1000);
+    int err = transport->controlTransfer(handle,
+                                         0x21,
+                                         0x0b,
+                                         1,
+                                         interface_number,
+                                         NULL, 0,
+                                         1000);
     if (err != LIBUSB_SUCCESS && err != LIBUSB_ERROR_PIPE) {
         std::cout << "Could not set report protocol on interface " << interface_number << " errno: " << err << std::endl;
         return false;
@@ -47,13 +166,13 @@ bool vendor_handler::setupReportProtocol(libusb_device_handle* handle, unsigned
 }
 
 bool vendor_handler::setupInfiniteIdle(libusb_device_handle* handle, unsigned char interface_number) {
-    int err = libusb_control_transfer(handle,
-                                  0x21,
-                                  0x0a,
-                                  0 << 8,
-                                  interface_number,
-                                  NULL, 0,
-                                  1000);
+    int err = transport->controlTransfer(handle,
+                                         0x21,
+                                         0x0a,
+                                         0 << 8,
+                                         interface_number,
+                                         NULL, 0,
+                                         1000);
 
     if (err != LIBUSB_SUCCESS && err != LIBUSB_ERROR_PIPE) {
         std::cout << "Could not set infinite idle on interface " << interface_number << " errno: " << err << std::endl;
@@ -65,17 +184,23 @@ bool vendor_handler::setupInfiniteIdle(libusb_device_handle* handle, unsigned ch
 
 void vendor_handler::cleanupDevice(device_interface_pair *pair) {
     for (auto interface: pair->claimedInterfaces) {
-        libusb_release_interface(pair->deviceHandle, interface);
+        transport->releaseInterface(pair->deviceHandle, interface);
+    }
+
+    if (!reattachKernelDrivers) {
+        return;
     }
 
     for (auto interface: pair->detachedInterfaces) {
-        libusb_attach_kernel_driver(pair->deviceHandle, interface);
+        transport->attachKernelDriver(pair->deviceHandle, interface);
     }
 }
 
 void vendor_handler::addHandler(transfer_handler *handler) {
     for (auto productId : handler->handledProductIds()) {
         productHandlers[productId] = handler;
+        handler->setTransport(transport);
+        handler->setCapabilityCache(capabilityCache);
         handledProducts.push_back(productId);
     }
 }
@@ -85,16 +210,26 @@ device_interface_pair* vendor_handler::claimDevice(libusb_device *device, libusb
     int err;
 
     struct libusb_config_descriptor* configDescriptor;
-    err = libusb_get_config_descriptor(device, 0, &configDescriptor);
+    err = transport->getConfigDescriptor(device, 0, &configDescriptor);
     if (err != LIBUSB_SUCCESS) {
         std::cout << "Could not get config descriptor" << std::endl;
     }
 
     auto productId = descriptor.idProduct;
     bool checkedForAliasing = false;
+    bool capabilitiesRead = false;
+    bool hasCapabilities = false;
+    device_capabilities capabilities;
 
-    if ((err = libusb_open(device, &handle)) == LIBUSB_SUCCESS) {
+    if ((err = transport->open(device, &handle)) == LIBUSB_SUCCESS) {
         deviceInterface->deviceHandle = handle;
+
+        // Tells this device apart from others of the same model, also when it comes back after a disconnect
+        std::string identity = capability_cache::makeKey(descriptor, getSerialNumber(handle, descriptor));
+        if (capabilityCache != nullptr) {
+            capabilityCache->bind(handle, identity);
+        }
+
         unsigned char interfaceCount = configDescriptor->bNumInterfaces;
 
         for (unsigned char interface_number = 0; interface_number < interfaceCount; ++interface_number) {
@@ -103,8 +238,8 @@ device_interface_pair* vendor_handler::claimDevice(libusb_device *device, libusb
                 continue;
             }
 
-            if (libusb_kernel_driver_active(handle, interface_number)) {
-                err = libusb_detach_kernel_driver(handle, interface_number);
+            if (transport->kernelDriverActive(handle, interface_number)) {
+                err = transport->detachKernelDriver(handle, interface_number);
                 if (LIBUSB_SUCCESS == err) {
                     deviceInterface->detachedInterfaces.push_back(interface_number);
                 } else {
@@ -112,7 +247,7 @@ device_interface_pair* vendor_handler::claimDevice(libusb_device *device, libusb
                 }
             }
 
-            err = libusb_claim_interface(handle, interface_number);
+            err = transport->claimInterface(handle, interface_number);
             if (LIBUSB_SUCCESS == err) {
                 deviceInterface->claimedInterfaces.push_back(interface_number);
 
@@ -126,8 +261,22 @@ device_interface_pair* vendor_handler::claimDevice(libusb_device *device, libusb
                 // Even though we claim the interface, we only actually care about specific ones. We still do
                 // the claim so that no other driver mangles events while we are handling it
                 if (productHandlers[productId]->attachToInterfaceId(interface_number)) {
+                    // The capabilities take the slow requests to the device, devices probed at the same time have
+                    // them read in parallel. The lock is only held for creating the virtual devices.
+                    if (!capabilitiesRead) {
+                        hasCapabilities = productHandlers[productId]->prepareAttach(handle, capabilities);
+                        capabilitiesRead = true;
+                    }
+
                     // Attach to our handler
-                    if (!productHandlers[productId]->attachDevice(handle, interface_number)) {
+                    bool attached;
+                    {
+                        std::lock_guard<std::mutex> lock(attachMutex);
+                        attached = productHandlers[productId]->attach(handle, interface_number, identity,
+                                                                      hasCapabilities ? &capabilities : nullptr);
+                    }
+
+                    if (!attached) {
                         delete deviceInterface;
                         return nullptr;
                     }
@@ -161,12 +310,17 @@ device_interface_pair* vendor_handler::claimDevice(libusb_device *device, libusb
                                     ep->wMaxPacketSize,
                                     productId
                             };
+                            std::lock_guard<std::mutex> lock(attachMutex);
                             transfersSetUp.push_back(setupData);
-                            setupTransfers(handle, ep->bEndpointAddress, ep->wMaxPacketSize, productId);
+                            if (transfersHeld) {
+                                heldTransfers.push_back(setupData);
+                            } else {
+                                setupTransfers(handle, ep->bEndpointAddress, ep->wMaxPacketSize, productId);
+                            }
                         }
                     }
 
-                    std::cout << std::dec << "Setup completed on interface " << (int)interface_number << std::endl;
+                    std::cout << "Setup completed on interface " << (int)interface_number << std::endl;
                 }
             } else {
                 std::cout << "Could not claim interface " << (int)interface_number << " retcode: " << err << " errno: " << errno << std::endl;
@@ -186,76 +340,734 @@ device_interface_pair* vendor_handler::claimDevice(libusb_device *device, libusb
     deviceInterface->productId = productId;
     auto productString = std::to_string(productId);
     std::cout << "Set up config for device " << productString << std::endl;
-    productHandlers[productId]->setConfig(getConfig()[productString]);
+    std::lock_guard<std::mutex> lock(attachMutex);
+    nlohmann::json productConfig = getConfig()[productString];
+    runOnDataPlane([this, productId, &productConfig]() {
+        productHandlers[productId]->setConfig(productConfig);
+    });
     return deviceInterface;
 }
 
-bool vendor_handler::setupTransfers(libusb_device_handle *handle, unsigned char interface_number, int maxPacketSize, int productId) {
-    struct libusb_transfer* transfer = libusb_alloc_transfer(0);
-    if (transfer == NULL) {
-        std::cout << "Could not allocate a transfer for interface " << interface_number << std::endl;
+bool vendor_handler::probeProduct(libusb_device* device, const libusb_device_descriptor descriptor) {
+    if (std::find(handledProducts.begin(), handledProducts.end(), descriptor.idProduct) == handledProducts.end()) {
         return false;
     }
 
-    transfer->user_data = NULL;
-    unsigned char* buff = new unsigned char[maxPacketSize];
+    std::cout << "Probing " << productHandlers[descriptor.idProduct]->getProductName(descriptor.idProduct) << std::endl;
+    return tryAttach(device, descriptor);
+}
+
+void vendor_handler::holdTransfers() {
+    transfersHeld = true;
+}
+
+void vendor_handler::releaseTransfers() {
+    transfersHeld = false;
+    for (auto setupData : heldTransfers) {
+        setupTransfers(setupData.handle, setupData.interface_number, setupData.maxPacketSize, setupData.productId);
+    }
+
+    heldTransfers.clear();
 
-    struct transfer_handler_pair* dataPair = new transfer_handler_pair();
-    dataPair->vendorHandler = this;
-    dataPair->transferHandler = productHandlers[productId];
+    // Probing is over, so this is back on the thread that runs the event loop
+    scheduleRevalidations();
+}
 
-    libusb_fill_interrupt_transfer(transfer,
-                                   handle, interface_number | LIBUSB_ENDPOINT_IN,
-                                   buff, maxPacketSize,
-                                   transferCallback, dataPair,
-                                   60000);
+bool vendor_handler::attachProduct(libusb_device* device, const libusb_device_descriptor descriptor) {
+    // A device that shows up again while it is waiting for a retry starts over
+    cancelAttach(device);
 
-    transfer->flags |= LIBUSB_TRANSFER_FREE_BUFFER;
-    int ret = libusb_submit_transfer(transfer);
-    if (ret != LIBUSB_SUCCESS) {
-        std::cout << "Could not submit transfer on interface " << (int)interface_number << " ret: " << ret << " errno: " << errno << std::endl;
+    if (tryAttach(device, descriptor)) {
+        scheduleRevalidations();
+        return true;
+    }
+
+    retryProductAttach(device, descriptor);
+    return false;
+}
+
+void vendor_handler::retryProductAttach(libusb_device* device, const libusb_device_descriptor descriptor) {
+    cancelAttach(device);
+
+    if (eventLoop == nullptr) {
+        std::cout << "Could not claim device and there is no event loop to retry it from. Giving up" << std::endl;
+        return;
+    }
+
+    // Hold on to the device in case it goes away before the retry comes around
+    transport->refDevice(device);
+    attach_attempt& attempt = pendingAttaches[device];
+    attempt = attach_attempt {
+            device,
+            descriptor,
+            1,
+            initialAttachRetryMs,
+            -1
+    };
+    scheduleAttachRetry(attempt);
+}
+
+void vendor_handler::cancelAttach(libusb_device* device) {
+    auto record = pendingAttaches.find(device);
+    if (record == pendingAttaches.end()) {
+        return;
+    }
+
+    if (record->second.timerId >= 0) {
+        eventLoop->cancelTimer(record->second.timerId);
+    }
+
+    pendingAttaches.erase(record);
+    transport->unrefDevice(device);
+}
+
+bool vendor_handler::tryAttach(libusb_device* device, const libusb_device_descriptor descriptor) {
+    libusb_device_handle* handle = NULL;
+    device_interface_pair* interfacePair = claimDevice(device, handle, descriptor);
+    if (interfacePair == nullptr) {
         return false;
     }
 
-    libusbTransfers.push_back(transfer);
+    std::lock_guard<std::mutex> lock(attachMutex);
+    deviceInterfaces.push_back(interfacePair);
+    deviceInterfaceMap[device] = interfacePair;
+    if (capabilityCache != nullptr && capabilityCache->wasServedFromCache(interfacePair->deviceHandle)) {
+        revalidationsDue.push_back(device);
+    }
 
     return true;
 }
 
+void vendor_handler::scheduleAttachRetry(attach_attempt& attempt) {
+    std::cout << "Could not claim device on attempt " << attempt.attempts << ". Trying again in "
+              << attempt.retryDelayMs << "ms" << std::endl;
+
+    libusb_device* device = attempt.device;
+    attempt.timerId = eventLoop->addTimer(attempt.retryDelayMs, [this, device]() {
+        retryAttach(device);
+    });
+}
+
+void vendor_handler::retryAttach(libusb_device* device) {
+    auto record = pendingAttaches.find(device);
+    if (record == pendingAttaches.end()) {
+        return;
+    }
+
+    attach_attempt& attempt = record->second;
+    attempt.timerId = -1;
+    attempt.attempts++;
+
+    if (tryAttach(device, attempt.descriptor)) {
+        std::cout << "Claimed device on attempt " << attempt.attempts << std::endl;
+        cancelAttach(device);
+        scheduleRevalidations();
+        return;
+    }
+
+    if (attempt.attempts >= maxAttachAttempts) {
+        std::cout << "Could not claim device after " << attempt.attempts << " attempts. Giving up" << std::endl;
+        cancelAttach(device);
+        return;
+    }
+
+    attempt.retryDelayMs = std::min(attempt.retryDelayMs * 2, maxAttachRetryMs);
+    scheduleAttachRetry(attempt);
+}
+
+std::string vendor_handler::getSerialNumber(libusb_device_handle* handle, const libusb_device_descriptor descriptor) {
+    std::string serial;
+    if (descriptor.iSerialNumber == 0) {
+        return serial;
+    }
+
+    // A raw string descriptor, UTF-16 after the two header bytes
+    unsigned char buffer[128];
+    int length = transport->getStringDescriptor(handle, descriptor.iSerialNumber, 0x0409, buffer, sizeof(buffer));
+    for (int index = 2; index + 1 < length; index += 2) {
+        serial.push_back(buffer[index + 1] == 0 ? (char)buffer[index] : '?');
+    }
+
+    return serial;
+}
+
+void vendor_handler::scheduleRevalidations() {
+    std::vector<libusb_device*> devices;
+    {
+        std::lock_guard<std::mutex> lock(attachMutex);
+        devices.swap(revalidationsDue);
+    }
+
+    if (eventLoop == nullptr) {
+        return;
+    }
+
+    for (auto device : devices) {
+        cancelRevalidation(device);
+        revalidationTimers[device] = eventLoop->addTimer(revalidationDelayMs, [this, device]() {
+            revalidationTimers.erase(device);
+
+            auto deviceInterface = deviceInterfaceMap.find(device);
+            if (deviceInterface == deviceInterfaceMap.end()) {
+                return;
+            }
+
+            auto handler = productHandlers.find(deviceInterface->second->productId);
+            if (handler != productHandlers.end()) {
+                handler->second->revalidateCapabilities(deviceInterface->second->deviceHandle);
+            }
+        });
+    }
+}
+
+void vendor_handler::cancelRevalidation(libusb_device* device) {
+    auto timer = revalidationTimers.find(device);
+    if (timer == revalidationTimers.end()) {
+        return;
+    }
+
+    eventLoop->cancelTimer(timer->second);
+    revalidationTimers.erase(timer);
+}
+
+std::vector<handed_off_device> vendor_handler::handOffDevices() {
+    reattachKernelDrivers = false;
+
+    // Several product ids can share one transfer handler
+    std::set<transfer_handler*> seenHandlers;
+    std::vector<handed_off_device> handedOff;
+    for (auto handler : productHandlers) {
+        if (!seenHandlers.insert(handler.second).second) {
+            continue;
+        }
+
+        std::vector<handed_off_device> handlerDevices;
+        runOnDataPlane([&handler, &handlerDevices]() {
+            handlerDevices = handler.second->handOffDevices();
+        });
+
+        for (auto& device : handlerDevices) {
+            device.vendorId = getVendorId();
+            device.productId = handler.first;
+            handedOff.push_back(device);
+        }
+    }
+
+    return handedOff;
+}
+
+void vendor_handler::adoptDevice(const handed_off_device& handedOff, long gracePeriodMs) {
+    auto handler = productHandlers.find(handedOff.productId);
+    if (handler == productHandlers.end()) {
+        close(handedOff.fd);
+        return;
+    }
+
+    runOnDataPlane([&handler, &handedOff, gracePeriodMs]() {
+        handler->second->adoptDevice(handedOff, gracePeriodMs);
+    });
+    scheduleParkedExpiry();
+}
+
+void vendor_handler::scheduleParkedExpiry() {
+    // Several product ids can share one transfer handler
+    std::set<transfer_handler*> seenHandlers;
+    uint64_t nextExpiry = 0;
+    for (auto handler : productHandlers) {
+        if (!seenHandlers.insert(handler.second).second) {
+            continue;
+        }
+
+        // Without a loop to wait on there is no coming back, so everything parked goes right away
+        uint64_t now = eventLoop == nullptr ? UINT64_MAX : event_loop::monotonicNow();
+        uint64_t handlerExpiry;
+        runOnDataPlane([&handler, &handlerExpiry, now]() {
+            handlerExpiry = handler.second->expireParkedDevices(now);
+        });
+
+        if (handlerExpiry != 0 && (nextExpiry == 0 || handlerExpiry < nextExpiry)) {
+            nextExpiry = handlerExpiry;
+        }
+    }
+
+    if (eventLoop == nullptr || nextExpiry == 0 || (parkedExpiryTimer >= 0 && parkedExpiryAt <= nextExpiry)) {
+        return;
+    }
+
+    if (parkedExpiryTimer >= 0) {
+        eventLoop->cancelTimer(parkedExpiryTimer);
+    }
+
+    uint64_t now = event_loop::monotonicNow();
+    long delayMs = nextExpiry > now ? (long)((nextExpiry - now + 999999) / 1000000) : 0;
+    parkedExpiryAt = nextExpiry;
+    parkedExpiryTimer = eventLoop->addTimer(delayMs, [this]() {
+        parkedExpiryTimer = -1;
+        scheduleParkedExpiry();
+    });
+}
+
+void vendor_handler::forgetCapabilities(libusb_device_handle* handle) {
+    if (capabilityCache != nullptr) {
+        capabilityCache->unbind(handle);
+    }
+}
+
+bool vendor_handler::setupTransfers(libusb_device_handle *handle, unsigned char interface_number, int maxPacketSize, int productId) {
+    bool setUp = false;
+    int depth = transferQueueDepth;
+
+    // The transfers complete on the data plane, so they get submitted and tracked from there as well
+    runOnDataPlane([&]() {
+        endpoint_subscription subscription = productHandlers[productId]->getEndpointSubscription(interface_number);
+        if (subscription == neverSubscribe ||
+            (subscription == probeSubscription && unusedEndpoints.count({productId, interface_number}) > 0)) {
+            return;
+        }
+
+        transfer_queue* queue = new transfer_queue {
+            handle,
+            interface_number,
+            productId,
+            std::vector<libusb_transfer*>(),
+            0,
+            0,
+            0,
+            0,
+            0,
+            subscription == probeSubscription,
+            false,
+            std::deque<device_message_exchange*>()
+        };
+
+        struct transfer_handler_pair* dataPair = new transfer_handler_pair();
+        dataPair->vendorHandler = this;
+        dataPair->transferHandler = productHandlers[productId];
+        dataPair->context = dataPair->transferHandler->getDeviceContext(handle);
+        dataPair->context->productId = productId;
+        dataPair->queue = queue;
+
+        // Keep several transfers submitted on the endpoint so that a report arriving while we are still handling the
+        // previous one already has a transfer waiting for it. The kernel completes them in submission order.
+        for (int index = 0; index < depth; ++index) {
+            struct libusb_transfer* transfer = transport->allocTransfer();
+            if (transfer == NULL) {
+                std::cout << "Could not allocate a transfer for interface " << interface_number << std::endl;
+                break;
+            }
+
+            unsigned char* buff = new unsigned char[maxPacketSize];
+
+            libusb_fill_interrupt_transfer(transfer,
+                                           handle, interface_number | LIBUSB_ENDPOINT_IN,
+                                           buff, maxPacketSize,
+                                           transferCallback, dataPair,
+                                           60000);
+
+            transfer->flags |= LIBUSB_TRANSFER_FREE_BUFFER;
+            int ret = transport->submitTransfer(transfer);
+            if (ret != LIBUSB_SUCCESS) {
+                std::cout << "Could not submit transfer on interface " << (int)interface_number << " ret: " << ret << " errno: " << errno << std::endl;
+                transport->freeTransfer(transfer);
+                break;
+            }
+
+            queue->transfers.push_back(transfer);
+            queue->submitted++;
+            libusbTransfers.push_back(transfer);
+        }
+
+        if (queue->transfers.empty()) {
+            delete queue;
+            delete dataPair;
+            return;
+        }
+
+        transferQueues.push_back(queue);
+        setUp = true;
+    });
+
+    return setUp;
+}
+
+void vendor_handler::releaseTransfer(struct libusb_transfer *transfer) {
+    struct transfer_handler_pair* dataPair = (transfer_handler_pair*)transfer->user_data;
+    transfer_queue* queue = dataPair->queue;
+
+    auto transferRecord = std::find(libusbTransfers.begin(), libusbTransfers.end(), transfer);
+    if (transferRecord != libusbTransfers.end()) {
+        libusbTransfers.erase(transferRecord);
+    }
+
+    auto queueTransferRecord = std::find(queue->transfers.begin(), queue->transfers.end(), transfer);
+    if (queueTransferRecord != queue->transfers.end()) {
+        queue->transfers.erase(queueTransferRecord);
+    }
+
+    transport->freeTransfer(transfer);
+
+    // The last transfer of the endpoint takes the queue down with it
+    if (queue->transfers.empty()) {
+        // Nothing is going to answer the messages still waiting on the endpoint now
+        for (auto exchange : queue->awaitingResponses) {
+            getDataPlaneLoop()->cancelTimer(exchange->timeoutTimer);
+            finishExchange(exchange, false);
+        }
+
+        auto queueRecord = std::find(transferQueues.begin(), transferQueues.end(), queue);
+        if (queueRecord != transferQueues.end()) {
+            transferQueues.erase(queueRecord);
+        }
+
+        delete queue;
+        delete dataPair;
+    }
+}
+
+void vendor_handler::unsubscribe(struct libusb_transfer* transfer) {
+    struct transfer_handler_pair* dataPair = (transfer_handler_pair*)transfer->user_data;
+    transfer_queue* queue = dataPair->queue;
+
+    std::cout << "Unsubscribing from endpoint " << (int)queue->endpoint << " of product " << queue->productId
+              << " after " << queue->discarded << " reports without anything to decode" << std::endl;
+    unusedEndpoints[{queue->productId, queue->endpoint}] = queue->discarded;
+
+    // The others are released when they come back, even those that complete with a report before the cancel lands
+    queue->stopping = true;
+    for (auto other : std::vector<libusb_transfer*>(queue->transfers)) {
+        if (other != transfer) {
+            transport->cancelTransfer(other);
+        }
+    }
+
+    releaseTransfer(transfer);
+}
+
+void vendor_handler::stopTransfers(libusb_device_handle* handle) {
+    bool pending = false;
+    for (auto queue : transferQueues) {
+        if (queue->handle != handle) {
+            continue;
+        }
+
+        queue->stopping = true;
+        for (auto transfer : queue->transfers) {
+            transport->cancelTransfer(transfer);
+        }
+        pending = true;
+    }
+
+    // They come back through transferCallback, which releases them and the queue with the last one. The handle can't
+    // be closed before that.
+    uint64_t deadline = event_loop::monotonicNow() + transferDrainTimeoutMs * 1000000ULL;
+    while (pending && event_loop::monotonicNow() < deadline) {
+        transport->handleEvents();
+
+        pending = false;
+        for (auto queue : transferQueues) {
+            if (queue->handle == handle) {
+                pending = true;
+                break;
+            }
+        }
+
+        if (pending) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    if (pending) {
+        std::cout << "Transfers on a detached device did not come back in time" << std::endl;
+    }
+}
+
 void vendor_handler::transferCallback(struct libusb_transfer *transfer) {
     int err;
     struct transfer_handler_pair* dataPair = (transfer_handler_pair*)transfer->user_data;
+    transfer_queue* queue = dataPair->queue;
+
+    // Synchronous transfers on the control thread may end up handling libusb events there, hand anything they
+    // complete over to the data plane where it belongs
+    data_plane* plane = dataPair->vendorHandler->dataPlane;
+    if (plane != nullptr && plane->isRunning() && !plane->isDataPlaneThread()) {
+        plane->post([transfer]() {
+            transferCallback(transfer);
+        });
+        return;
+    }
+
+    queue->submitted--;
+
+    if (queue->stopping) {
+        dataPair->vendorHandler->releaseTransfer(transfer);
+        return;
+    }
 
     switch (transfer->status) {
-        case LIBUSB_TRANSFER_COMPLETED:
-            // Send the packet data to the registered handler
-            dataPair->transferHandler->handleTransferData(transfer->dev_handle, transfer->buffer, transfer->actual_length);
+        case LIBUSB_TRANSFER_COMPLETED: {
+            // Taken before anything else so that the report is stamped as close to its arrival as we can get
+            uint64_t completedAt = event_loop::monotonicNow();
+            queue->completed++;
+            if (queue->submitted == 0) {
+                queue->ranDry++;
+            }
+
+            if (dataPair->vendorHandler->reportCapture != nullptr) {
+                dataPair->vendorHandler->reportCapture->record(dataPair->vendorHandler->getVendorId(), queue->productId,
+                                                               queue->endpoint, completedAt,
+                                                               transfer->buffer, transfer->actual_length);
+            }
+
+            // A device answering a message does so in between its reports, the response isn't one for the decoder
+            bool answered = !queue->awaitingResponses.empty() &&
+                    dataPair->vendorHandler->answerMessage(queue, transfer->buffer, transfer->actual_length);
+
+            if (!answered) {
+                // Send the packet data to the registered handler
+                if (dataPair->transferHandler->processTransfer(dataPair->context, transfer->buffer,
+                                                               transfer->actual_length, completedAt)) {
+                    queue->decoded++;
+                } else {
+                    queue->discarded++;
+                }
+
+                // An endpoint that only ever sends reports nobody decodes isn't worth a wakeup for each of them
+                if (queue->probing && queue->decoded + queue->discarded >= dataPair->vendorHandler->endpointProbeReports) {
+                    queue->probing = false;
+                    if (queue->decoded == 0) {
+                        dataPair->vendorHandler->unsubscribe(transfer);
+                        break;
+                    }
+                }
+            }
 
             // Resubmit the transfer
-            err = libusb_submit_transfer(transfer);
+            err = dataPair->vendorHandler->transport->submitTransfer(transfer);
             if (err != LIBUSB_SUCCESS) {
                 std::cout << "Could not resubmit my transfer" << std::endl;
+                dataPair->vendorHandler->releaseTransfer(transfer);
+            } else {
+                queue->submitted++;
             }
 
             break;
+        }
 
         case LIBUSB_TRANSFER_TIMED_OUT:
             // Resubmit the transfer
-            err = libusb_submit_transfer(transfer);
+            err = dataPair->vendorHandler->transport->submitTransfer(transfer);
             if (err != LIBUSB_SUCCESS) {
                 std::cout << "Could not resubmit my transfer" << std::endl;
+                dataPair->vendorHandler->releaseTransfer(transfer);
+            } else {
+                queue->submitted++;
             }
 
             break;
 
         case LIBUSB_TRANSFER_CANCELLED:
-            break;
-
         case LIBUSB_TRANSFER_NO_DEVICE:
+            dataPair->vendorHandler->releaseTransfer(transfer);
             break;
 
         default:
             std::cout << "Unknown status received " << transfer->status << std::endl;
+            dataPair->vendorHandler->releaseTransfer(transfer);
             break;
     }
 }
+
+bool vendor_handler::sendMessage(unix_socket_message* message) {
+    auto handler = productHandlers.find(message->device);
+    if (handler == productHandlers.end()) {
+        return false;
+    }
+
+    // Only the submission happens over there, the transfers streaming reports keep going the whole time
+    runOnDataPlane([&]() {
+        for (auto handle : handler->second->getMessageTargets()) {
+            device_message_exchange* exchange = new device_message_exchange {
+                this,
+                handle,
+                (unsigned char)(message->responseInterface | LIBUSB_ENDPOINT_IN),
+                messageQueue->newMessage(message->length),
+                pooled_message(),
+                -1
+            };
+            memcpy(exchange->request->data, message->data, message->length);
+
+            if (message->expectResponse) {
+                pooled_message response = messageQueue->newMessage(message->responseLength);
+                response->destination = message_destination::gui;
+                response->vendor = message->vendor;
+                response->device = message->device;
+                response->interface = message->interface;
+                response->originatingSocket = message->originatingSocket;
+                response->signature = socket_server::versionSignature;
+                exchange->response = std::move(response);
+            }
+
+            struct libusb_transfer* transfer = transport->allocTransfer();
+            if (transfer == NULL) {
+                std::cout << "Could not allocate a transfer for a message on interface " << message->interface << std::endl;
+                finishExchange(exchange, false);
+                continue;
+            }
+
+            libusb_fill_interrupt_transfer(transfer,
+                                           handle, message->interface | LIBUSB_ENDPOINT_OUT,
+                                           exchange->request->data, message->length,
+                                           messageCallback, exchange,
+                                           messageTimeoutMs);
+
+            int ret = transport->submitTransfer(transfer);
+            if (ret != LIBUSB_SUCCESS) {
+                std::cout << "Failed to send message on interface " << message->interface << " ret: " << ret << " errno: " << errno << std::endl;
+                transport->freeTransfer(transfer);
+                finishExchange(exchange, false);
+            }
+        }
+    });
+
+    return true;
+}
+
+void vendor_handler::messageCallback(struct libusb_transfer* transfer) {
+    device_message_exchange* exchange = (device_message_exchange*)transfer->user_data;
+    vendor_handler* vendorHandler = exchange->vendorHandler;
+
+    // Same as the streaming transfers, these are only handled on the data plane
+    data_plane* plane = vendorHandler->dataPlane;
+    if (plane != nullptr && plane->isRunning() && !plane->isDataPlaneThread()) {
+        plane->post([transfer]() {
+            messageCallback(transfer);
+        });
+        return;
+    }
+
+    bool sent = (transfer->endpoint & LIBUSB_ENDPOINT_IN) == 0;
+    libusb_transfer_status status = transfer->status;
+    int length = transfer->length;
+    int actualLength = transfer->actual_length;
+    vendorHandler->transport->freeTransfer(transfer);
+
+    if (status != LIBUSB_TRANSFER_COMPLETED) {
+        if (sent) {
+            std::cout << "Failed to send message to the device, status: " << status << std::endl;
+        } else {
+            std::cout << "Could not receive response on endpoint " << (int)exchange->responseEndpoint << " status: " << status << std::endl;
+        }
+
+        vendorHandler->finishExchange(exchange, false);
+        return;
+    }
+
+    if (sent) {
+        if (actualLength != length) {
+            std::cout << "Didn't send all of the message, only sent " << actualLength << std::endl;
+            vendorHandler->finishExchange(exchange, false);
+            return;
+        }
+
+        vendorHandler->receiveResponse(exchange);
+        return;
+    }
+
+    if (actualLength != exchange->response->length) {
+        std::cout << "Got a response of " << actualLength << " bytes. Expected " << exchange->response->length << std::endl;
+        vendorHandler->finishExchange(exchange, false);
+        return;
+    }
+
+    vendorHandler->finishExchange(exchange, true);
+}
+
+void vendor_handler::receiveResponse(device_message_exchange* exchange) {
+    if (exchange->response == nullptr) {
+        finishExchange(exchange, false);
+        return;
+    }
+
+    // Reading the response off an endpoint we stream from would race our own transfers for it, so it is picked out
+    // of the reports coming in there instead
+    for (auto queue : transferQueues) {
+        if (queue->handle == exchange->handle && queue->endpoint == exchange->responseEndpoint) {
+            queue->awaitingResponses.push_back(exchange);
+            exchange->timeoutTimer = getDataPlaneLoop()->addTimer(messageTimeoutMs, [this, queue, exchange]() {
+                auto waiting = std::find(queue->awaitingResponses.begin(), queue->awaitingResponses.end(), exchange);
+                if (waiting != queue->awaitingResponses.end()) {
+                    queue->awaitingResponses.erase(waiting);
+                }
+
+                std::cout << "No response on endpoint " << (int)exchange->responseEndpoint << std::endl;
+                finishExchange(exchange, false);
+            });
+
+            return;
+        }
+    }
+
+    struct libusb_transfer* transfer = transport->allocTransfer();
+    if (transfer == NULL) {
+        std::cout << "Could not allocate a transfer for a response on endpoint " << (int)exchange->responseEndpoint << std::endl;
+        finishExchange(exchange, false);
+        return;
+    }
+
+    libusb_fill_interrupt_transfer(transfer,
+                                   exchange->handle, exchange->responseEndpoint,
+                                   exchange->response->data, exchange->response->length,
+                                   messageCallback, exchange,
+                                   messageTimeoutMs);
+
+    int ret = transport->submitTransfer(transfer);
+    if (ret != LIBUSB_SUCCESS) {
+        std::cout << "Could not receive response on endpoint " << (int)exchange->responseEndpoint << " ret: " << ret << " errno: " << errno << std::endl;
+        transport->freeTransfer(transfer);
+        finishExchange(exchange, false);
+    }
+}
+
+bool vendor_handler::answerMessage(transfer_queue* queue, unsigned char* data, int length) {
+    // Pen reports can be as long as the response, so it also has to start like the request. Tablets answer with the
+    // report id and the command they were sent.
+    for (auto waiting = queue->awaitingResponses.begin(); waiting != queue->awaitingResponses.end(); ++waiting) {
+        device_message_exchange* exchange = *waiting;
+        size_t matchLength = std::min(responseMatchLength, (size_t)exchange->request->length);
+        if (length != exchange->response->length || (size_t)length < matchLength ||
+            memcmp(data, exchange->request->data, matchLength) != 0) {
+            continue;
+        }
+
+        queue->awaitingResponses.erase(waiting);
+        getDataPlaneLoop()->cancelTimer(exchange->timeoutTimer);
+        memcpy(exchange->response->data, data, length);
+        finishExchange(exchange, true);
+
+        return true;
+    }
+
+    return false;
+}
+
+void vendor_handler::finishExchange(device_message_exchange* exchange, bool deliver) {
+    if (deliver && exchange->response != nullptr) {
+        // The queue takes messages from any thread. The control thread sends responses out after every pass through
+        // its loop, so it only needs waking up.
+        messageQueue->addMessage(std::move(exchange->response));
+        if (eventLoop != nullptr) {
+            eventLoop->post([]() {});
+        }
+    }
+
+    // Whatever is left goes back to the pool with it
+    delete exchange;
+}
+
+event_loop* vendor_handler::getDataPlaneLoop() {
+    if (dataPlane != nullptr && dataPlane->isRunning()) {
+        return dataPlane->getEventLoop();
+    }
+
+    return eventLoop;
+}
@@ -21,12 +21,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <vector>
 #include <set>
+#include <mutex>
 #include <libusb-1.0/libusb.h>
 #include "includes/json.hpp"
 #include "unix_socket_message_queue.h"
 #include "device_interface_pair.h"
 #include "transfer_handler.h"
 #include "transfer_setup_data.h"
+#include "transfer_queue.h"
+#include "device_message_exchange.h"
+#include "report_capture.h"
+#include "usb_transport.h"
+#include "data_plane.h"
+#include "event_loop.h"
+#include "attach_attempt.h"
+#include "capability_cache.h"
+#include "handed_off_device.h"
 
 class vendor_handler {
 public:
@@ -38,11 +48,46 @@ public:
     virtual void setConfig(nlohmann::json config) {};
     virtual nlohmann::json getConfig() { return nlohmann::json({}); };
     virtual void setMessageQueue(unix_socket_message_queue* queue);
+    virtual void setTransferQueueDepth(int depth);
+    // Owned by the data plane, only to be looked at from there
+    virtual std::vector<transfer_queue*> getTransferQueues();
+    virtual std::vector<device_context*> getDeviceContexts();
+    // Endpoints by product that only sent reports nobody could decode, with how many of those they sent
+    virtual std::map<std::pair<int, unsigned char>, unsigned long> getUnusedEndpoints();
+    virtual void setTransport(usb_transport* usbTransport);
+    virtual usb_transport* getTransport();
+    // Transfers, their queues and the device contexts belong to the data plane thread once one is set
+    virtual void setDataPlane(data_plane* plane);
+    // The loop the handler gets driven from, attach retries are timed on it
+    virtual void setEventLoop(event_loop* loop);
+    virtual void setCapabilityCache(capability_cache* cache);
+    virtual void setDisconnectGracePeriod(long ms);
+    virtual void setReportCapture(report_capture* capture);
+    virtual transfer_handler* getProductHandler(int productId);
     virtual void handleMessages() { };
     virtual std::set<short> getConnectedDevices() { return std::set<short>(); }
     virtual bool handleProductAttach(libusb_device* device, const struct libusb_device_descriptor descriptor) { return false; };
     virtual void handleProductDetach(libusb_device* device, const struct libusb_device_descriptor descriptor) {};
+
+    // Claims a device of ours once without retrying. Several devices may be probed at once from other threads as long
+    // as transfers are held.
+    virtual bool probeProduct(libusb_device* device, const struct libusb_device_descriptor descriptor);
+    // Keeps retrying a device that could not be claimed from the event loop
+    virtual void retryProductAttach(libusb_device* device, const struct libusb_device_descriptor descriptor);
+    // While held, endpoints of claimed devices are only recorded and get their transfers once released. Nothing
+    // streams, so no transfer callback can end up on a probing thread.
+    virtual void holdTransfers();
+    virtual void releaseTransfers();
+
+    // Gives up the virtual devices for a daemon taking over. Claimed devices are left without kernel driver from here
+    // on, so nothing else grabs them before the new daemon claims them.
+    virtual std::vector<handed_off_device> handOffDevices();
+    // Keeps a virtual device from the previous daemon until its tablet attaches here
+    virtual void adoptDevice(const handed_off_device& handedOff, long gracePeriodMs);
 protected:
+    // Runs anything touching state owned by the data plane over there, waiting until it is done
+    void runOnDataPlane(const std::function<void()>& task);
+
     virtual bool setupReportProtocol(libusb_device_handle* handle, unsigned char interface_number);
     virtual bool setupInfiniteIdle(libusb_device_handle* handle, unsigned char interface_number);
 
@@ -51,12 +96,49 @@ protected:
     virtual void cleanupDevice(device_interface_pair* pair);
     virtual device_interface_pair* claimDevice(libusb_device* device, libusb_device_handle* handle, const libusb_device_descriptor descriptor);
 
+    // Claims the device, or keeps retrying it from the event loop with an increasing delay when that fails. Returns
+    // whether the device was claimed straight away.
+    bool attachProduct(libusb_device* device, const libusb_device_descriptor descriptor);
+    void cancelAttach(libusb_device* device);
+
+    // Devices that came up with cached capabilities get them checked against the device a little later
+    void scheduleRevalidations();
+    void cancelRevalidation(libusb_device* device);
+    void forgetCapabilities(libusb_device_handle* handle);
+
+    // Virtual devices of a detached device are parked for a while, this removes them once that is over
+    void scheduleParkedExpiry();
+
     virtual void sendInitKey(libusb_device_handle* handle, int interface_number) {}
 
     virtual bool setupTransfers(libusb_device_handle* handle, unsigned char interface_number, int maxPacketSize, int productId);
     static void LIBUSB_CALL transferCallback(struct libusb_transfer* transfer);
+    void releaseTransfer(struct libusb_transfer* transfer);
+    // Cancels the transfers on a device that is going away and waits for them to come back, so that none completes into
+    // its context or handle afterwards. Runs on the data plane.
+    void stopTransfers(libusb_device_handle* handle);
+    // Stops the transfers on the endpoint of this one, which is released right away
+    void unsubscribe(struct libusb_transfer* transfer);
+    // Sends a message from the GUI to every device of its product without waiting on them. Returns whether the product
+    // is one of ours.
+    bool sendMessage(unix_socket_message* message);
+    static void LIBUSB_CALL messageCallback(struct libusb_transfer* transfer);
+    void receiveResponse(device_message_exchange* exchange);
+    // Takes the report as the response a message on this endpoint waits for if it has the expected length and starts
+    // with the same bytes as the message
+    bool answerMessage(transfer_queue* queue, unsigned char* data, int length);
+    void finishExchange(device_message_exchange* exchange, bool deliver);
+    // Where the transfers complete and their timers have to go
+    event_loop* getDataPlaneLoop();
+    std::string getSerialNumber(libusb_device_handle* handle, const libusb_device_descriptor descriptor);
+
+    bool tryAttach(libusb_device* device, const libusb_device_descriptor descriptor);
+    void scheduleAttachRetry(attach_attempt& attempt);
+    void retryAttach(libusb_device* device);
 
     unix_socket_message_queue* messageQueue;
+    // Kept between calls so that handling messages doesn't allocate
+    std::vector<pooled_message> receivedMessages;
 
     std::map<libusb_device*, device_interface_pair*> deviceInterfaceMap;
     std::vector<device_interface_pair*> deviceInterfaces;
@@ -67,6 +149,40 @@ protected:
 
     std::vector<transfer_setup_data> transfersSetUp;
     std::vector<libusb_transfer*> libusbTransfers;
+    std::vector<transfer_queue*> transferQueues;
+    int transferQueueDepth = 4;
+    // Owned by the data plane like the queues. Other devices of the same product skip these endpoints as well.
+    std::map<std::pair<int, unsigned char>, unsigned long> unusedEndpoints;
+    const unsigned long endpointProbeReports = 32;
+    const unsigned int messageTimeoutMs = 1000;
+    const unsigned int transferDrainTimeoutMs = 500;
+    // How many of the leading bytes of a message its response repeats
+    const size_t responseMatchLength = 2;
+    report_capture* reportCapture = nullptr;
+    usb_transport* transport = nullptr;
+    data_plane* dataPlane = nullptr;
+    event_loop* eventLoop = nullptr;
+
+    // Guards what claimDevice shares between devices while they are probed in parallel. The product handlers of all
+    // vendors share an output sink, so this is held across vendors as well.
+    static std::mutex attachMutex;
+    bool transfersHeld = false;
+    std::vector<transfer_setup_data> heldTransfers;
+
+    capability_cache* capabilityCache = nullptr;
+    // Claimed from a cache, waiting to be scheduled from the event loop's thread
+    std::vector<libusb_device*> revalidationsDue;
+    std::map<libusb_device*, int> revalidationTimers;
+    const long revalidationDelayMs = 2000;
+
+    bool reattachKernelDrivers = true;
+    int parkedExpiryTimer = -1;
+    uint64_t parkedExpiryAt = 0;
+
+    std::map<libusb_device*, attach_attempt> pendingAttaches;
+    const int maxAttachAttempts = 5;
+    const long initialAttachRetryMs = 250;
+    const long maxAttachRetryMs = 4000;
 };
 
 #endif //USERSPACE_TABLET_DRIVER_DAEMON_VENDOR_HANDLER_H
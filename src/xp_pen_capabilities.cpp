@@ -0,0 +1,32 @@
+/*
+userspace_tablet_driver_daemon
+Copyright (C) 2021 - Aren Villanueva <https://github.com/kurikaesu/>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "xp_pen_capabilities.h"
+
+bool readXpPenCapabilities(usb_transport* transport, libusb_device_handle* handle, device_capabilities& capabilities) {
+    unsigned char buf[12];
+    if (transport->getStringDescriptor(handle, 0x64, 0x0409, buf, sizeof(buf)) != sizeof(buf)) {
+        return false;
+    }
+
+    capabilities.maxWidth = (buf[3] << 8) + buf[2];
+    capabilities.maxHeight = (buf[5] << 8) + buf[4];
+    capabilities.maxPressure = (buf[9] << 8) + buf[8];
+
+    return true;
+}
@@ -18,7 +18,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <algorithm>
-#include <thread>
 #include <set>
 #include "xp_pen_handler.h"
 #include "transfer_handler_pair.h"
@@ -76,38 +75,25 @@ nlohmann::json xp_pen_handler::getConfig() {
     return jsonConfig;
 }
 
+void xp_pen_handler::setMessageQueue(unix_socket_message_queue* queue) {
+    vendor_handler::setMessageQueue(queue);
+    queue->addConsumer(message_destination::driver, getVendorId());
+}
+
 void xp_pen_handler::handleMessages() {
-    auto messages = messageQueue->getMessagesFor(message_destination::driver, getVendorId());
+    messageQueue->getMessagesFor(message_destination::driver, getVendorId(), receivedMessages);
     size_t handledMessages = 0;
-    size_t totalMessages = messages.size();
+    size_t totalMessages = receivedMessages.size();
 
     if (totalMessages > 0) {
-        // Cancel transfers first
-        for (auto transfer: libusbTransfers) {
-            libusb_cancel_transfer(transfer);
-        }
-
-        libusbTransfers.clear();
-
-        for (auto message: messages) {
-            auto handler = productHandlers.find(message->device);
-            if (handler != productHandlers.end()) {
-                auto responses = handler->second->handleMessage(message);
-                delete message;
-
-                for (auto response: responses) {
-                    messageQueue->addMessage(response);
-                }
-
+        // Responses come back through the message queue once the devices answered
+        for (auto& message: receivedMessages) {
+            if (sendMessage(message.get())) {
                 handledMessages++;
             }
         }
 
-        // Re-enable transfers
-        for (auto setupData: transfersSetUp) {
-            setupTransfers(setupData.handle, setupData.interface_number, setupData.maxPacketSize, setupData.productId);
-        }
-
+        receivedMessages.clear();
         std::cout << "Handled " << handledMessages << " out of " << totalMessages << " messages." << std::endl;
     }
 }
@@ -123,31 +109,9 @@ std::set<short> xp_pen_handler::getConnectedDevices() {
 }
 
 bool xp_pen_handler::handleProductAttach(libusb_device* device, const libusb_device_descriptor descriptor) {
-    libusb_device_handle* handle = NULL;
-    device_interface_pair* interfacePair = nullptr;
-    const int maxRetries = 5;
-    int currentAttept = 0;
-
     if (std::find(handledProducts.begin(), handledProducts.end(), descriptor.idProduct) != handledProducts.end()) {
         std::cout << "Handling " << productHandlers[descriptor.idProduct]->getProductName(descriptor.idProduct) << std::endl;
-        while (interfacePair == nullptr  && currentAttept < maxRetries) {
-            interfacePair = claimDevice(device, handle, descriptor);
-            if (interfacePair == nullptr) {
-                std::cout << "Could not claim device on attempt " << currentAttept << ". Detaching and then waiting" << std::endl;
-                handleProductDetach(device, descriptor);
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-                ++currentAttept;
-            }
-        }
-
-        if (interfacePair != nullptr) {
-            deviceInterfaces.push_back(interfacePair);
-            deviceInterfaceMap[device] = interfacePair;
-            return true;
-        }
-
-        std::cout << "Giving up" << std::endl;
-        return false;
+        return attachProduct(device, descriptor);
     }
 
     std::cout << "Unknown product " << descriptor.idProduct << std::endl;
@@ -156,16 +120,38 @@ bool xp_pen_handler::handleProductAttach(libusb_device* device, const libusb_dev
 }
 
 void xp_pen_handler::handleProductDetach(libusb_device *device, struct libusb_device_descriptor descriptor) {
+    // It may still be waiting for another try at claiming it, or for its cached capabilities to be checked
+    cancelAttach(device);
+    cancelRevalidation(device);
+
     for (auto deviceObj : deviceInterfaceMap) {
         if (deviceObj.first == device) {
             std::cout << "Handling device detach" << std::endl;
 
-            if (productHandlers.find(descriptor.idProduct) != productHandlers.end()) {
-                productHandlers[descriptor.idProduct]->detachDevice(deviceObj.second->deviceHandle);
+            // Nothing may complete into the device context once it is deleted
+            runOnDataPlane([this, &deviceObj]() {
+                stopTransfers(deviceObj.second->deviceHandle);
+            });
+
+            // Aliased devices are attached to the handler of the product they were aliased to
+            auto handler = productHandlers.find(deviceObj.second->productId);
+            if (handler != productHandlers.end()) {
+                runOnDataPlane([&handler, &deviceObj]() {
+                    handler->second->detachDevice(deviceObj.second->deviceHandle);
+                });
+                scheduleParkedExpiry();
             }
 
+            // Don't set up transfers on this handle again once it is closed
+            auto setupIterator = std::remove_if(transfersSetUp.begin(), transfersSetUp.end(),
+                                                [&deviceObj](const transfer_setup_data& setupData) {
+                return setupData.handle == deviceObj.second->deviceHandle;
+            });
+            transfersSetUp.erase(setupIterator, transfersSetUp.end());
+
             cleanupDevice(deviceObj.second);
-            libusb_close(deviceObj.second->deviceHandle);
+            forgetCapabilities(deviceObj.second->deviceHandle);
+            transport->close(deviceObj.second->deviceHandle);
 
             auto deviceInterfacesIterator = std::find(deviceInterfaces.begin(), deviceInterfaces.end(), deviceObj.second);
             if (deviceInterfacesIterator != deviceInterfaces.end()) {
@@ -187,7 +173,7 @@ void xp_pen_handler::sendInitKey(libusb_device_handle *handle, int interface_num
 
     unsigned char key[] = {0x02, 0xb0, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
     int sentBytes;
-    int ret = libusb_interrupt_transfer(handle, interface_number | LIBUSB_ENDPOINT_OUT, key, sizeof(key), &sentBytes, 1000);
+    int ret = transport->interruptTransfer(handle, interface_number | LIBUSB_ENDPOINT_OUT, key, sizeof(key), &sentBytes, 1000);
     if (ret != LIBUSB_SUCCESS) {
         std::cout << "Failed to send key on interface " << interface_number << " ret: " << ret << " errno: " << errno << std::endl;
         return;
@@ -33,6 +33,7 @@ public:
     std::string vendorName();
     void setConfig(nlohmann::json config);
     nlohmann::json getConfig();
+    void setMessageQueue(unix_socket_message_queue* queue);
     void handleMessages();
     std::set<short> getConnectedDevices();
     bool handleProductAttach(libusb_device* device, const libusb_device_descriptor descriptor);